@@ -0,0 +1,96 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+#if !defined(_SCOREP_UCX_H_)
+#define _SCOREP_UCX_H_
+
+/*
+   Score-P UCX plugin application API: phase markers and live counter reads.
+
+   Link the application with -lscorep_plugin_ucx (the instance loaded by Score-P
+   is used). All the calls read the plugin counters snapshot (refreshed when
+   Score-P samples the counters, or by scorep_ucx_snapshot_refresh()), so they
+   cost tens of nano seconds. The calls fail (return -1) until the plugin
+   metrics are defined.
+
+   Counter IDs are the plugin counter indices, in the order of the Score-P
+   metrics (UCX@N_<counter name>), see scorep_ucx_counter_id_get().
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Maximum number of phases (distinct names) */
+#define SCOREP_UCX_PHASES_MAX       64
+
+/* Maximum phase name length */
+#define SCOREP_UCX_PHASE_NAME_MAX   64
+
+/* Maximum nesting depth of the phases of a thread */
+#define SCOREP_UCX_PHASE_DEPTH_MAX  16
+
+/* Number of counters, -1 if the plugin is not active */
+int
+scorep_ucx_counters_num_get(void);
+
+/* Counter ID of a counter name (without the Score-P metric prefix), -1 if not found */
+int
+scorep_ucx_counter_id_get(const char *counter_name);
+
+/* Read the current values (snapshot) of count counters, returns 0 on success */
+int
+scorep_ucx_read(const uint32_t *counter_ids, uint64_t *values, size_t count);
+
+/*
+   Refresh the snapshot now (micro seconds, never blocks): the backends that wait for
+   another process (legacy) keep their last values, and a refresh already in progress
+   is not waited for. returns 0 on success
+*/
+int
+scorep_ucx_snapshot_refresh(void);
+
+/*
+   Bind the calling thread (Score-P location) to its UCP worker (ucp_worker_h), for the
+   per UCP worker counters (SCOREP_UCX_PLUGIN_PER_WORKER_ENABLE=1). NULL: the thread
+   has no worker. Once a thread binds, the unbound threads no longer claim the workers
+   in creation order.
+
+   returns: 0 on success, -1 if the per UCP worker counters are not active.
+*/
+int
+scorep_ucx_worker_bind(const void *ucp_worker);
+
+/*
+   Begin / end a named phase of the calling thread (nested phases allowed).
+   The counter deltas of every begin/end pair are accumulated per phase name.
+
+   returns: 0 on success, -1 otherwise (plugin not active, too many phases or
+            nesting depth exceeded, end without begin).
+*/
+int
+scorep_ucx_phase_begin(const char *name);
+
+int
+scorep_ucx_phase_end(const char *name);
+
+/*
+   Get the accumulated counter deltas of a phase (count counters from counter ID 0)
+   and the number of begin/end pairs.
+
+   returns: 0 on success, -1 if the phase is not found.
+*/
+int
+scorep_ucx_phase_get(const char *name, uint64_t *deltas, size_t count, uint64_t *num_calls);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SCOREP_UCX_H_ */
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdint.h>
 #include <algorithm>
 //#include <boost/filesystem.hpp>
 #include <sstream>
@@ -39,3 +40,23 @@ to_mb(std::size_t nbytes);
 
 size_t
 convert_thread_id(std::thread::id tid);
+
+/* Job ID from the resource manager / MPI launcher environment ("0" if unknown) */
+std::string
+job_id_get();
+
+/* UCX statistics receiver UDP port of the job */
+int
+stats_udp_port_get();
+
+/* MPI rank from the launcher environment, before MPI_Init (-1 if unknown) */
+int
+mpi_rank_env_get();
+
+/* Monotonic time (nano seconds) */
+uint64_t
+time_nsec_get();
+
+/* Process start time in the monotonic time domain (nano seconds, 0 if unknown) */
+uint64_t
+process_start_nsec_get();
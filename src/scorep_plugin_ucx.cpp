@@ -9,37 +9,48 @@
 #include <sstream>
 #include <utils.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <algorithm>
 
 
-/* Global argc and argv*/
-static int global_argc = 0;
-static char **global_argv = NULL;
+/* Delta mode: previous values are kept per thread (Score-P location) */
+thread_local std::vector<uint64_t> scorep_plugin_ucx::m_delta_prev_values;
+thread_local std::vector<uint64_t> scorep_plugin_ucx::m_profile_start_values;
+thread_local std::vector<uint8_t> scorep_plugin_ucx::m_profile_start_recorded;
 
-/*
-   putting the constructor in the .init_array section.
-   Functions in the .init_array (unlike .init) are called with the same arguments
-   main will be called with: argc, argv and env.
-*/
-static int
-printargs(int argc, char **argv, char **env)
-{
-    DEBUG_PRINT("In printargs:\n");
-    global_argc = argc;
-    global_argv = argv;
+/* Async mode: the plugin instance (for the static Score-P callbacks) */
+scorep_plugin_ucx *scorep_plugin_ucx::m_async_instance = NULL;
 
-   return 0;
-}
-
-/* Put the function into the init_array */
-__attribute__((section(".init_array"))) static void *ctr = (void *)&printargs;
+/* Trace volume, self-overhead and governor state of this thread (location) */
+thread_local ucx_location_t *scorep_plugin_ucx::m_location = NULL;
 
 
 scorep_plugin_ucx::scorep_plugin_ucx()
 {
     DEBUG_PRINT("Loading Metric Plugin: UCX Sampling\n");
 
+    /* Startup timing? (disabled by default) */
+    m_startup_timing_enable = 0;
+    const char *startup_timing = getenv(ENV_SCOREP_UCX_PLUGIN_STARTUP_TIMING_ENABLE);
+    if (startup_timing != NULL) {
+        m_startup_timing_enable = atoi(startup_timing);
+    }
+    memset(m_startup_phase_nsec, 0, sizeof(m_startup_phase_nsec));
+    m_startup_metrics_defined_nsec = 0;
+    m_startup_process_start_nsec = process_start_nsec_get();
+    if (m_startup_process_start_nsec) {
+        m_startup_phase_nsec[UCX_STARTUP_PHASE_PLUGIN_LOAD] = time_nsec_get() - m_startup_process_start_nsec;
+    }
+
     m_mpi_t_initialized = 0;
 
+    /* Until MPI is initialized: the rank from the launcher environment (-1 if unknown) */
+    m_mpi_rank = mpi_rank_env_get();
+    m_metric_names_file_write = 0;
+    m_temporary_names_num = 0;
+    m_pSCOREP_metric_name_update_func = NULL;
+
     /* Enable UCX counters collection? (enabled by default) */
     m_ucx_counters_collect_enable = 1;
     const char *ucx_enable = getenv(ENV_SCOREP_UCX_PLUGIN_UCX_COUNTERS_COLLECTION_ENABLE);
@@ -54,150 +65,182 @@ scorep_plugin_ucx::scorep_plugin_ucx()
         m_nic_counters_collect_enable = atoi(nic_enable);
     }
 
-    printf("ucx_counters_collect_enable=%d, nic_counters_collect_enable=%d\n",
-        m_ucx_counters_collect_enable, m_nic_counters_collect_enable);
-
-    /* Calling UCX sampling constructor */
-    m_ucx_sampling.configuration_set(m_ucx_counters_collect_enable, m_nic_counters_collect_enable);
+    /* Score-P profiling: report start relative values (opt-in profile mode) */
+    m_profiling_enable = profile_mode_enabled();
 
-#if defined(SCOREP_PLUGIN_MICROBENCHMARK_ENABLE)
-    m_ticks_cnt_get_total = 0;
-    m_ticks_cnt_get_num_times = 0;
-#endif
-}
-
-scorep_plugin_ucx::~scorep_plugin_ucx()
-{
-#if defined(SCOREP_PLUGIN_MICROBENCHMARK_ENABLE)
-    double mean_get_count_ticks = m_ticks_cnt_get_total / m_ticks_cnt_get_num_times;
-    printf("==================================================\n");
-    printf("Performance: mean_get_count_ticks=%lf, cnt_get_num_times=%lf\n", mean_get_count_ticks,
-            m_ticks_cnt_get_num_times);
-    printf("==================================================\n");
-#endif
-}
+    /* Tracing: record monotonic counters as deltas? (absolute by default) */
+    m_delta_mode_enable = 0;
+    const char *metric_mode = getenv(ENV_SCOREP_UCX_PLUGIN_METRIC_MODE);
+    if ((metric_mode != NULL) && (strcmp(metric_mode, "delta") == 0)) {
+        if (m_profiling_enable) {
+            printf("Warning: %s=delta is ignored in the profile mode (%s)\n", ENV_SCOREP_UCX_PLUGIN_METRIC_MODE,
+                ENV_SCOREP_UCX_PLUGIN_PROFILE_MODE_ENABLE);
+        }
+        else {
+            m_delta_mode_enable = 1;
+        }
+    }
 
-void
-scorep_plugin_ucx::metrics_names_serialize(void **names, size_t *size)
-{
-    size_t n_counters = m_ucx_counters_list.size();
-    size_t total_size;
-    size_t offset;
-    uint32_t i;
-    char *serialized = NULL;
+    /* Tracing: threshold-triggered asynchronous events? */
+    m_async_mode_enable = async_mode_enabled();
+    m_async_period_usec = UCX_ASYNC_WATCHER_PERIOD_USEC_DEFAULT;
+    const char *async_period = getenv(ENV_SCOREP_UCX_PLUGIN_ASYNC_PERIOD_USEC);
+    if (async_period != NULL) {
+        m_async_period_usec = std::max(strtoull(async_period, NULL, 0), 1ULL);
+    }
+    if (m_async_mode_enable) {
+        m_async_instance = this;
+    }
 
-    *names = NULL;
-    *size = 0;
+    /* Live shared-memory export? (disabled by default) */
+    m_shm_export_enable = 0;
+    const char *shm_export_enable = getenv(ENV_SCOREP_UCX_PLUGIN_SHM_EXPORT_ENABLE);
+    if (shm_export_enable != NULL) {
+        m_shm_export_enable = atoi(shm_export_enable);
+    }
+    m_shm_export_period_msec = UCX_SHM_EXPORT_PERIOD_MSEC_DEFAULT;
+    const char *shm_export_period = getenv(ENV_SCOREP_UCX_PLUGIN_SHM_EXPORT_PERIOD_MSEC);
+    if (shm_export_period != NULL) {
+        m_shm_export_period_msec = strtoull(shm_export_period, NULL, 0);
+    }
 
-    total_size = 0;
-    for (i = 0; i < n_counters; i++) {
-        total_size += (::strlen(m_ucx_counters_list[i]->name) + 1);
+    /* Per UCP worker counters? (disabled by default) */
+    m_per_worker_enable = 0;
+    m_worker_first = 0;
+    m_worker_count = 0;
+    m_worker_refresh_id = 0;
+    const char *per_worker_enable = getenv(ENV_SCOREP_UCX_PLUGIN_PER_WORKER_ENABLE);
+    if (per_worker_enable != NULL) {
+        m_per_worker_enable = atoi(per_worker_enable);
     }
 
-    serialized = (char *)malloc(total_size);
-    if (serialized == NULL) {
-        printf("metrics_names_serialize(): Error! Could not allocate serialized,"
-                "total_size = %zu\n", total_size);
-        exit(-1);
+    if (m_per_worker_enable && !ucx_sampling_worker::is_supported()) {
+        printf("Warning: %s requires the UCX destroyed statistics nodes to be kept"
+               " (UCX_STATS_TRIGGER=exit), using the process-wide counters\n",
+            ENV_SCOREP_UCX_PLUGIN_PER_WORKER_ENABLE);
+        m_per_worker_enable = 0;
     }
 
-    offset = 0;
-    for (i = 0; i < n_counters; i++) {
-        ::strcpy(&serialized[offset], m_ucx_counters_list[i]->name);
-        DEBUG_PRINT("&serialized[%zu] = %s\n", offset, &serialized[offset]);
-        offset += (::strlen(m_ucx_counters_list[i]->name) + 1);
+    if (m_per_worker_enable && getenv(ENV_SCOREP_UCX_PLUGIN_PER_PROCESS_ENABLE) &&
+        !per_process_enabled()) {
+        printf("Warning: %s is ignored with the per UCP worker counters\n",
+            ENV_SCOREP_UCX_PLUGIN_PER_PROCESS_ENABLE);
     }
 
-    *size = total_size;
-    *names = (void *)serialized;
-}
+    /* Columnar sidecar output? (disabled by default) */
+    m_sidecar_enable = 0;
+    const char *sidecar_enable = getenv(ENV_SCOREP_UCX_PLUGIN_SIDECAR_ENABLE);
+    if (sidecar_enable != NULL) {
+        m_sidecar_enable = atoi(sidecar_enable);
+    }
+    m_sidecar_period_usec = UCX_SIDECAR_PERIOD_USEC_DEFAULT;
+    const char *sidecar_period = getenv(ENV_SCOREP_UCX_PLUGIN_SIDECAR_PERIOD_USEC);
+    if (sidecar_period != NULL) {
+        m_sidecar_period_usec = std::max(strtoull(sidecar_period, NULL, 0), 1ULL);
+    }
 
-void
-scorep_plugin_ucx::ucx_statistics_enumerate_legacy(uint64_t dummy)
-{
-    int root = 0;
-    uint32_t index = 0;
-    int ret;
-    int world_size;
-    uint64_t data[2];
-    uint64_t prev_val;
-    uint64_t value;
-    size_t metric_names_size;
+    /* Trace volume estimate (tracing, sync mode: the profile / async records are not sampled) */
+    m_trace_budget_enable = tracing_enabled() && !m_profiling_enable && !m_async_mode_enable;
+    m_trace_budget_bytes = 0;
+    const char *trace_budget = getenv(ENV_SCOREP_UCX_PLUGIN_TRACE_BUDGET);
+    if (trace_budget != NULL) {
+        m_trace_budget_bytes = strtoull(trace_budget, NULL, 0);
+    }
+    m_trace_event_rate = 0;
+    const char *trace_event_rate = getenv(ENV_SCOREP_UCX_PLUGIN_TRACE_EVENT_RATE);
+    if (trace_event_rate != NULL) {
+        m_trace_event_rate = strtoull(trace_event_rate, NULL, 0);
+    }
+    m_trace_decimation_max = UCX_TRACE_BUDGET_DECIMATION_MAX_DEFAULT;
+    const char *trace_decimation_max = getenv(ENV_SCOREP_UCX_PLUGIN_TRACE_DECIMATION_MAX);
+    if (trace_decimation_max != NULL) {
+        m_trace_decimation_max = std::max(atoi(trace_decimation_max), 1);
+    }
+    m_trace_decimation = 1;
+    m_record_first_id = 0;
+    m_trace_calib_ticks = 0;
+    m_trace_calib_nsec = 0;
+    if (m_trace_budget_enable) {
+        /* Measurement clock frequency: from the plugin load to the metrics definition */
+        m_trace_calib_ticks = async_clock_get();
+        m_trace_calib_nsec = time_nsec_get();
+    }
 
-    if (m_mpi_rank == 0) {
-        /* Start UCX statistics server */
-        ret = m_ucx_sampling.ucx_statistics_server_start(UCS_STATS_DEFAULT_UDP_PORT);
+    printf("ucx_counters_collect_enable=%d, nic_counters_collect_enable=%d, profiling_enable=%d\n",
+        m_ucx_counters_collect_enable, m_nic_counters_collect_enable, m_profiling_enable);
 
-        /* Get UCX statistics */
-        ret = m_ucx_sampling.ucx_statistics_current_value_get(m_mpi_rank, index,
-                  &m_ucx_counters_list, &value, &prev_val);
-        PMPI_Barrier(MPI_COMM_WORLD);
-        // If we are the root process, send our data to everyone
-        PMPI_Comm_size(MPI_COMM_WORLD, &world_size);
+    /* Calling UCX sampling constructor */
+    m_ucx_sampling.configuration_set(m_ucx_counters_collect_enable, m_nic_counters_collect_enable);
 
-        /* Serialize metric names */
-        metrics_names_serialize((void **)&m_metric_names, &metric_names_size);
+    /* Self-overhead measurement? (disabled by default) */
+    m_overhead_enable = 0;
+    const char *overhead_enable = getenv(ENV_SCOREP_UCX_PLUGIN_OVERHEAD_ENABLE);
+    if (overhead_enable != NULL) {
+        m_overhead_enable = atoi(overhead_enable);
+    }
+    m_overhead_id = UINT32_MAX;
+
+    /* Overhead governor? (CPU budget percentage, disabled by default) */
+    m_governor_enable = 0;
+    m_governor_id = UINT32_MAX;
+    const char *governor_budget = getenv(ENV_SCOREP_UCX_PLUGIN_GOVERNOR_BUDGET);
+    if ((governor_budget != NULL) && (strtod(governor_budget, NULL) > 0)) {
+        if (m_async_mode_enable) {
+            printf("Warning: %s is ignored in the async mode\n", ENV_SCOREP_UCX_PLUGIN_GOVERNOR_BUDGET);
+        }
+        else {
+            m_governor_enable = 1;
+            m_governor.budget_set(strtod(governor_budget, NULL) / 100);
+        }
+    }
+}
 
-        /* 1. Broadcast size */
-        data[0] = m_ucx_counters_list.size();
-        MPI_Bcast(&data[0], 1, MPI_LONG_LONG, root, MPI_COMM_WORLD);
+scorep_plugin_ucx::~scorep_plugin_ucx()
+{
+    if (m_async_watcher) {
+        m_async_watcher->stop();
+    }
+    m_async_instance = NULL;
 
-        data[1] = (uint64_t)metric_names_size;
-        MPI_Bcast(&data[1], 1, MPI_LONG_LONG, root, MPI_COMM_WORLD);
+    m_sidecar_writer.stop();
+    ucx_api_detach(m_mpi_rank);
+    counters_activity_write();
 
-        /* 2. Broadcast names */
-        MPI_Bcast((void *)m_metric_names, metric_names_size, MPI_CHAR, root, MPI_COMM_WORLD);
+    if (m_trace_budget_enable && (m_mpi_rank <= 0)) {
+        trace_budget_report();
     }
-    else {
-        PMPI_Barrier(MPI_COMM_WORLD);
-        // If we are a receiver process, receive the data from the root
-        MPI_Bcast(&data[0], 1, MPI_LONG_LONG, root, MPI_COMM_WORLD);
 
-        MPI_Bcast(&data[1], 1, MPI_LONG_LONG, root, MPI_COMM_WORLD);
-        metric_names_size = (size_t)data[1];
+    /* All the ranks: summary, rank 0: histogram */
+    if (m_overhead_enable) {
+        std::vector<const ucx_overhead::location_t *> overhead_locations;
 
-        m_metric_names = (char *)malloc(metric_names_size);
-        if (m_metric_names == NULL) {
-            printf("UCX get_metric_properties(): Error! could not allocate metric_names,"
-                " size=%zu\n", metric_names_size);
-        }
-
-        /* 2. Receive metrics names */
-        MPI_Bcast((void *)m_metric_names, metric_names_size, MPI_CHAR, root, MPI_COMM_WORLD);
+        m_locations.locations_get(&ucx_location_t::overhead, &overhead_locations);
+        m_overhead.report(m_mpi_rank, m_mpi_rank <= 0, overhead_locations);
     }
-    DEBUG_PRINT("ucx_statistics_current_value_get() - Done\n");
+    if (m_governor_enable) {
+        std::vector<const ucx_governor::location_t *> governor_locations;
 
-    /* Allow user to set the number of UCX counters */
-    m_n_ucx_counters = (size_t)data[0];
-    if (dummy != 1) {
-        m_n_ucx_counters = std::min((size_t)m_n_ucx_counters, (size_t)dummy);
+        m_locations.locations_get(&ucx_location_t::governor, &governor_locations);
+        m_governor.report(m_mpi_rank, governor_locations);
     }
-
-    DEBUG_PRINT("Number of UCX counters detected: %u, metric_names_size=%zu\n",
-            m_n_ucx_counters, metric_names_size);
 }
 
-
 std::vector<MetricProperty>
 scorep_plugin_ucx::get_metric_properties(const std::string& metric_name)
 {
     int assigned_event = 0;
-    uint32_t index = 0;
-    size_t count = 1;
     unsigned long long int hex_dummy;
     std::vector<MetricProperty> metric_properties;
     uint32_t i;
     int ret;
-    int is_initialized;
-    int flag;
-    int is_value_updated;
-    int j;
-    uint32_t offset;
     const ucs_stats_aggrgt_counter_name_t *counter_names;
     size_t size;
-    uint64_t value;
     int metrics_names_file_exists = 0;
     std::vector<std::string> counters_list;
+    size_t num_counters;
+    std::vector<uint8_t> selected;
+    uint32_t aggregate_first = 0;
+    uint32_t aggregate_count = 0;
 
     DEBUG_PRINT("scorep_plugin_ucx::get_metric_properties() called with: %s\n",
             metric_name);
@@ -207,108 +250,223 @@ scorep_plugin_ucx::get_metric_properties(const std::string& metric_name)
     DEBUG_PRINT("Event=%s dummy=%u, hex_dummy=%lx\n", event, dummy, hex_dummy);
 
     if (event == "UCX") {
+        uint64_t start_nsec = time_nsec_get();
+        uint64_t phase_nsec = start_nsec;
+
         m_ucx_metric_name = metric_name;
-        m_n_ucx_counters = UCX_NUM_TEMPORARY_COUNTERS;
+        /* UCX@N: at most N aggregate counters (UCX@1: all) */
+        m_n_ucx_counters = (dummy > 1) ? dummy : 0;
 
         /* UCX counters collection enabled? */
-        if (m_ucx_counters_collect_enable) {
+        if ((m_ucx_sampling.backend_enabled(UCX_SAMPLING_BACKEND_AGGREGATE)) ||
+            (m_ucx_sampling.backend_enabled(UCX_SAMPLING_BACKEND_LEGACY))) {
             /* Check if we have the metrics name file from the previous run */
-            metrics_names_file_exists = metric_name_read_counters_list_from_file(&counters_list);
-            if (!metrics_names_file_exists) {
-                /* Don't re-initialize MPI if already iniitalized */
-                ret = PMPI_Initialized(&is_initialized);
-                DEBUG_PRINT("MPI_Init(): Checking if initialized: %d\n", is_initialized);
-                if (!is_initialized) {
-                   DEBUG_PRINT("get_metric_properties: global_argc=%d, global_argv=%p",
-                       global_argc, global_argv);
-                   PMPI_Init(&global_argc, &global_argv);
+            metrics_names_file_exists = metric_name_read_counters_list_from_file(&counters_list,
+                                            &m_counters_activity);
+            m_metric_names_file_write = !metrics_names_file_exists;
+
+            /* Aggregate-sum counter names */
+            if (metrics_names_file_exists) {
+                std::string prefix = metric_name + "_";
+
+                /* Assign counters read from file (without the metric prefix) */
+                for (i = 0; i < counters_list.size(); i++) {
+                    if (counters_list[i].compare(0, prefix.size(), prefix) == 0) {
+                        counters_list[i] = counters_list[i].substr(prefix.size());
+                    }
+                }
+                m_ucx_sampling.ucx_statistics_aggregate_counter_names_assign(counters_list);
+            }
+            else {
+                /* Local names: no MPI (nor UCX) initialization is required */
+                ret = m_ucx_sampling.ucx_statistics_aggregate_counter_names_get(&counter_names, &size);
+                if (!ret) {
+                    /*
+                       Names are not known before the application's MPI_Init:
+                       register temporary names, renamed after MPI_Init.
+                    */
+                    m_temporary_names_num = std::min((size_t)UCX_NUM_TEMPORARY_COUNTERS,
+                                                     (size_t)UCX_AGGREGATE_SUM_NUM_COUNTERS_MAX);
+                    for (i = 0; i < m_temporary_names_num; i++) {
+                        std::string temp_counter_name;
+
+                        TEMPORARY_UCX_COUNTER_NAME_GEN(temp_counter_name, std::string(""),
+                            temp_counter_name, i);
+                        counters_list.push_back(temp_counter_name.substr(1));
+                    }
+                    m_ucx_sampling.ucx_statistics_aggregate_counter_names_assign(counters_list);
                 }
+            }
+        }
 
-                /* get global rank */
-                PMPI_Comm_rank(MPI_COMM_WORLD, &m_mpi_rank);
+        m_startup_phase_nsec[UCX_STARTUP_PHASE_NAMES_DISCOVERY] = time_nsec_get() - phase_nsec;
+        phase_nsec = time_nsec_get();
 
-                m_mpi_t_initialized = 1;
+        /* Compose the selected backends: aggregate, legacy, ethtool, sysfs */
+        num_counters = m_ucx_sampling.backends_init();
 
-                /*
-                   Need MPI_T initialization here since the UDP port number of the
-                   UCX statistics server is derived from the process_id.
-                   Also, all statistics are aggregated by MPI_rank 0 (root).
-                */
-                DEBUG_PRINT("m_mpi_rank = %d\n", m_mpi_rank);
+        m_startup_phase_nsec[UCX_STARTUP_PHASE_BACKENDS_INIT] = time_nsec_get() - phase_nsec;
 
-                /* ===> New mode: Use the UCX aggregate-sum API to reduce the amount of collected information */
-                /* For now, we need to enable the server to enable UCX counters collection */
-                if (m_mpi_rank == 0) {
-                    /* Start UCX statistics server */
-                    ret = m_ucx_sampling.ucx_statistics_server_start(UCS_STATS_DEFAULT_UDP_PORT);
-                }
+        /* Per UCP worker counters replace the aggregate backend counters */
+        if (m_per_worker_enable) {
+            std::vector<std::string> worker_counter_names;
 
-                index = 0;
-                ret = m_ucx_sampling.ucx_statistics_aggregate_counter_get(index, &value);
-                if (!ret) {
-                    printf("Warning! ucx_statistics_aggregate_counter_get() failed, ret=%d\n", ret);
-                }
+            m_ucx_sampling.backend_counters_range_get(UCX_SAMPLING_BACKEND_AGGREGATE,
+                &m_worker_first, &m_worker_count);
+            for (i = m_worker_first; i < (m_worker_first + m_worker_count); i++) {
+                std::string counter_name;
+
+                m_ucx_sampling.counter_name_get(i, &counter_name);
+                worker_counter_names.push_back(counter_name);
             }
+            m_ucx_sampling_worker.counter_names_set(worker_counter_names);
 
-            /* Update Score-P with metrics names */
-            if (metrics_names_file_exists) {
-                /* Assign number of counters */
-                m_ucx_sampling.ucx_statistics_aggregate_counter_size_assign(counters_list.size());
+            if (m_worker_count == 0) {
+                printf("Warning: %s requires the %s backend\n", ENV_SCOREP_UCX_PLUGIN_PER_WORKER_ENABLE,
+                    UCX_SAMPLING_BACKEND_AGGREGATE);
+                m_per_worker_enable = 0;
+            }
+        }
 
-                /* Add counters read from file */
-                for (i = 0; i < counters_list.size(); i++) {
-                    DEBUG_PRINT("[%d] Adding metric name: %s\n", m_mpi_rank, counters_list[i].c_str());
+        if ((m_shm_export_enable) && (num_counters > 0)) {
+            if (m_shm_export.attach(&m_ucx_sampling, m_shm_export_period_msec) != 0) {
+                m_shm_export_enable = 0;
+            }
+            else if (m_mpi_t_initialized) {
+                m_shm_export.rank_set(m_mpi_rank);
+            }
+        }
 
-                    metric_properties.insert(metric_properties.end(),
-                       MetricProperty(counters_list[i].c_str(), "", "").absolute_point().value_uint().decimal());
+        /* Trace volume: decimation, fewer recorded counters (UCX@N) under the budget */
+        if (m_trace_budget_enable && (num_counters > 0)) {
+            trace_budget_plan(num_counters);
+        }
+
+        /* UCX@N: select the aggregate counters recorded by Score-P */
+        selected.assign(num_counters, 1);
+        if (m_ucx_sampling.backend_counters_range_get(UCX_SAMPLING_BACKEND_AGGREGATE,
+                &aggregate_first, &aggregate_count)) {
+            counters_select(aggregate_first, aggregate_count, &selected);
+
+            /* Score-P reads the selected counters only: refresh at the first one */
+            for (i = aggregate_first; i < (aggregate_first + aggregate_count); i++) {
+                if (selected[i]) {
+                    m_ucx_sampling.refresh_counter_set(aggregate_first, i);
+                    m_worker_refresh_id = i;
+                    break;
                 }
             }
-            else {
-                ret = m_ucx_sampling.ucx_statistics_aggregate_counter_names_get(&counter_names, &size);
-                if (!ret) {
-                    printf("Warning! ucx_statistics_aggregate_counter_get() failed, ret=%d\n", ret);
-                }
+        }
 
-                /* Add counters from aggregate-sum */
-                for (i = 0; i < size; i++) {
-                    std::string temp_counter_name;
+        if (m_async_mode_enable) {
+            const char *thresholds = getenv(ENV_SCOREP_UCX_PLUGIN_ASYNC_THRESHOLDS);
 
-                    DEBUG_PRINT("[%d] Adding metric name: %s\n", m_mpi_rank, temp_counter_name.c_str());
+            m_async_watcher.reset(new ucx_async_watcher(&m_ucx_sampling, async_clock_get));
+            m_async_watcher->thresholds_parse((thresholds != NULL) ? thresholds : "*=1");
+        }
 
-                    temp_counter_name = metric_name + "_" + counter_names[i].class_name + "_" + counter_names[i].counter_name;
+        for (i = 0; i < num_counters; i++) {
+            std::string counter_name;
+            std::string temp_counter_name;
 
+            m_ucx_sampling.counter_name_get(i, &counter_name);
+            temp_counter_name = metric_name + "_" + counter_name;
+
+            DEBUG_PRINT("[%d] Adding metric name: %s\n", m_mpi_rank, temp_counter_name.c_str());
+
+            if (!selected[i]) {
+                /* Not recorded (UCX@N), still sampled (sidecar, shm export, application API) */
+            }
+            else if (m_async_mode_enable) {
+                /* Only the watched counters are recorded */
+                if (!m_async_watcher->counter_watch(i, counter_name, m_ucx_sampling.counter_is_monotonic(i))) {
+                    selected[i] = 0;
+                }
+                else if (m_ucx_sampling.counter_is_monotonic(i)) {
+                    /* Change since the previous record */
+                    metric_properties.insert(metric_properties.end(),
+                       MetricProperty(temp_counter_name.c_str(), "", "").relative_last().value_uint().decimal());
+                }
+                else {
                     metric_properties.insert(metric_properties.end(),
                        MetricProperty(temp_counter_name.c_str(), "", "").absolute_point().value_uint().decimal());
-
-                    /* Add metric to file for the next run */
-                    if (m_mpi_rank == 0) {
-                        metric_name_add_to_file((char *)temp_counter_name.c_str());
-                    }
                 }
             }
-        }
+            else if ((m_profiling_enable) && (m_ucx_sampling.counter_is_monotonic(i))) {
+                /* Profile accumulates the start relative value per call path */
+                metric_properties.insert(metric_properties.end(),
+                   MetricProperty(temp_counter_name.c_str(), "", "").accumulated_start().value_uint().decimal());
+            }
+            else if ((m_delta_mode_enable) && (m_ucx_sampling.counter_is_monotonic(i))) {
+                /* Difference to the previous sample of the location */
+                metric_properties.insert(metric_properties.end(),
+                   MetricProperty(temp_counter_name.c_str(), "", "").relative_last().value_uint().decimal());
+            }
+            else {
+                metric_properties.insert(metric_properties.end(),
+                   MetricProperty(temp_counter_name.c_str(), "", "").absolute_point().value_uint().decimal());
+            }
 
-#if defined(UCX_STATS_NIC_COUNTERS_ENABLE)
-        /* UCX counters collection enabled? */
-        if (m_nic_counters_collect_enable) {
-            /*
-               NIC Counters aggregate sum (As NIC counters have thousands of counters,
-               we trace the aggregate-sum of each type
-             */
-            uint32_t nic_cnts_agrgt_num = m_ucx_sampling.nic_counters_aggregate();
-            for (i = 0; i < nic_cnts_agrgt_num; i++) {
-                std::string counter_name;
-                std::string temp_counter_name;
+            /* Score-P counter ID == dispatch table index */
+            m_scorep_metric_names.push_back(temp_counter_name);
+            /* Worker counters start with the worker: already start relative */
+            m_profile_start_relative.push_back((m_ucx_sampling.counter_is_monotonic(i) &&
+                !(m_per_worker_enable && ((i - m_worker_first) < m_worker_count))) ? 1 : 0);
+            m_delta_counters.push_back(m_ucx_sampling.counter_is_monotonic(i) ? 1 : 0);
+        }
 
-                /* Get counter name */
-                m_ucx_sampling.nic_counter_name_get(i, &counter_name);
-                temp_counter_name = metric_name + "_nic_cnt_" + counter_name;
+        /* Self-overhead: the plugin cycles of each location, after the counters */
+        if (m_overhead_enable && (num_counters > 0) && !m_async_mode_enable) {
+            std::string overhead_metric_name = metric_name + "_plugin_cycles";
 
+            if (m_profiling_enable) {
+                /* Plugin cycles per call path */
                 metric_properties.insert(metric_properties.end(),
-                   MetricProperty(temp_counter_name.c_str(), "", "").absolute_point().value_uint().decimal());
+                   MetricProperty(overhead_metric_name.c_str(), "", "cycles").accumulated_start().value_uint().decimal());
+            }
+            else {
+                /* Plugin cycles per sample interval */
+                metric_properties.insert(metric_properties.end(),
+                   MetricProperty(overhead_metric_name.c_str(), "", "cycles").relative_last().value_uint().decimal());
+            }
+
+            m_overhead_id = (uint32_t)m_scorep_metric_names.size();
+            m_scorep_metric_names.push_back(overhead_metric_name);
+            m_profile_start_relative.push_back(0);
+            m_delta_counters.push_back(0);
+        }
+
+        /* Overhead governor: the state of each location, after the counters */
+        if (m_governor_enable && (num_counters > 0)) {
+            std::string governor_metric_name = metric_name + "_governor_throttled";
+
+            metric_properties.insert(metric_properties.end(),
+               MetricProperty(governor_metric_name.c_str(), "", "").absolute_point().value_uint().decimal());
+
+            m_governor_id = (uint32_t)m_scorep_metric_names.size();
+            m_scorep_metric_names.push_back(governor_metric_name);
+            m_profile_start_relative.push_back(0);
+            m_delta_counters.push_back(0);
+        }
+
+        m_recorded = selected;
+        for (i = 0; i < num_counters; i++) {
+            if (selected[i]) {
+                m_record_first_id = i;
+                break;
             }
         }
-#endif /* UCX_STATS_NIC_COUNTERS_ENABLE */
+
+        /* Application API (include/scorep_ucx.h): reads the same counters */
+        if (num_counters > 0) {
+            ucx_api_attach(&m_ucx_sampling);
+            if (m_per_worker_enable) {
+                ucx_api_worker_attach(&m_ucx_sampling_worker);
+            }
+        }
+
+        m_startup_metrics_defined_nsec = time_nsec_get();
+        m_startup_phase_nsec[UCX_STARTUP_PHASE_METRIC_PROPERTIES] = m_startup_metrics_defined_nsec - start_nsec;
     }
     else if ((event == SCOREP_STRICTLY_SYNCHRONOUS_METRIC_NAME_UPDATE_FUNC_NAME) ||
              (event == SCOREP_METRIC_NAME_UPDATE_FUNC_NAME)) {
@@ -326,6 +484,296 @@ scorep_plugin_ucx::get_metric_properties(const std::string& metric_name)
 }
 
 
+void
+scorep_plugin_ucx::metric_names_finalize(void)
+{
+    const ucs_stats_aggrgt_counter_name_t *counter_names;
+    std::vector<std::string> worker_counter_names;
+    std::vector<uint32_t> enumerated_ids;
+    size_t size = 0;
+    uint32_t i;
+
+    /* Deferred backends (per-object counters): discover the objects, rename the temporary metrics */
+    m_ucx_sampling.backends_enumerate(m_mpi_rank, &enumerated_ids);
+    for (auto id : enumerated_ids) {
+        std::string counter_name;
+
+        if ((id >= m_recorded.size()) || !m_recorded[id]) {
+            continue;
+        }
+
+        m_ucx_sampling.counter_name_get(id, &counter_name);
+        if (m_pSCOREP_metric_name_update_func != NULL) {
+            m_pSCOREP_metric_name_update_func(m_scorep_metric_names[id].c_str(),
+                (m_ucx_metric_name + "_" + counter_name).c_str(), m_ucx_metric_name.c_str(), 0);
+        }
+        else if (id == enumerated_ids[0]) {
+            printf("Warning: cannot rename the temporary UCX per-object metrics (no Score-P rename function)\n");
+        }
+    }
+
+    if (!m_metric_names_file_write && !m_temporary_names_num) {
+        return;
+    }
+
+    m_ucx_sampling.ucx_statistics_aggregate_counter_names_get(&counter_names, &size);
+
+    for (i = 0; i < std::max(size, (size_t)m_temporary_names_num); i++) {
+        std::string counter_name;
+        std::string temp_counter_name;
+
+        if (i >= size) {
+            /* Unused temporary counter: keep its name */
+            TEMPORARY_UCX_COUNTER_NAME_GEN(temp_counter_name, std::string(""), temp_counter_name, i);
+            worker_counter_names.push_back(temp_counter_name.substr(1));
+            continue;
+        }
+
+        counter_name = std::string(counter_names[i].class_name) + "_" + counter_names[i].counter_name;
+        temp_counter_name = m_ucx_metric_name + "_" + counter_name;
+
+        /* Temporary names: rename the Score-P metrics (UCX@N: the first N are recorded) */
+        if ((i < m_temporary_names_num) && ((m_n_ucx_counters == 0) || (i < m_n_ucx_counters))) {
+            if (m_pSCOREP_metric_name_update_func != NULL) {
+                scorep_metric_rename(i, temp_counter_name.c_str(), size);
+            }
+            else if (i == 0) {
+                printf("Warning: cannot rename the temporary UCX metrics (no Score-P rename function),\n"
+                       "the names are available from the next run (%s)\n", METRIC_NAMES_FILENAME);
+            }
+        }
+
+        /* Add metric to file for the next run */
+        if ((m_metric_names_file_write) && (m_mpi_rank == 0)) {
+            metric_name_add_to_file((char *)temp_counter_name.c_str());
+        }
+
+        worker_counter_names.push_back(counter_name);
+    }
+
+    /* Real names for the counter consumers (per-worker mapping, sidecar, shm export) */
+    if (m_temporary_names_num) {
+        worker_counter_names.resize(m_temporary_names_num);
+        m_ucx_sampling.ucx_statistics_aggregate_counter_names_assign(worker_counter_names);
+        if (m_per_worker_enable) {
+            m_ucx_sampling_worker.counter_names_set(worker_counter_names);
+        }
+    }
+
+    m_metric_names_file_write = 0;
+}
+
+
+void
+scorep_plugin_ucx::counters_select(uint32_t first, uint32_t count, std::vector<uint8_t> *selected)
+{
+    std::vector<uint32_t> order;
+    std::string selection;
+    uint32_t i;
+
+    if ((m_n_ucx_counters == 0) || (count <= m_n_ucx_counters)) {
+        return;
+    }
+
+    for (i = 0; i < count; i++) {
+        order.push_back(i);
+    }
+
+    /*
+       Activity of the previous run (names file): the counters with the largest
+       total change first, then the most often changed ones. Counters that never
+       moved keep their names file order. Without activity: the first N counters.
+    */
+    if (m_counters_activity.size() == count) {
+        std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+            if (m_counters_activity[a].second != m_counters_activity[b].second) {
+                return m_counters_activity[a].second > m_counters_activity[b].second;
+            }
+            return m_counters_activity[a].first > m_counters_activity[b].first;
+        });
+    }
+    else if (!m_counters_activity.empty()) {
+        printf("Warning: %s activity does not match the UCX counters (%zu != %u), using the first %zu\n",
+            METRIC_NAMES_FILENAME, m_counters_activity.size(), count, m_n_ucx_counters);
+    }
+
+    for (i = 0; i < count; i++) {
+        (*selected)[first + i] = 0;
+    }
+    for (i = 0; i < m_n_ucx_counters; i++) {
+        std::string counter_name;
+
+        (*selected)[first + order[i]] = 1;
+        m_ucx_sampling.counter_name_get(first + order[i], &counter_name);
+        selection += " " + counter_name;
+    }
+
+    printf("UCX@%zu: recording %zu of %u UCX counters:%s\n", m_n_ucx_counters, m_n_ucx_counters, count,
+        selection.c_str());
+}
+
+
+void
+scorep_plugin_ucx::counters_activity_write(void)
+{
+    uint32_t first = 0;
+    uint32_t count = 0;
+    uint64_t num_changes_total = 0;
+    FILE *file;
+    uint32_t i;
+
+    if ((m_mpi_rank != 0) ||
+        (!m_ucx_sampling.backend_counters_range_get(UCX_SAMPLING_BACKEND_AGGREGATE, &first, &count))) {
+        return;
+    }
+
+    for (i = first; i < (first + count); i++) {
+        uint64_t num_changes;
+        uint64_t total_delta;
+
+        m_ucx_sampling.counter_activity_get(i, &num_changes, &total_delta);
+        num_changes_total += num_changes;
+    }
+
+    /* Nothing sampled (e.g. no MPI_Init, per UCP worker counters): keep the previous profile */
+    if (num_changes_total == 0) {
+        return;
+    }
+
+    file = fopen(METRIC_NAMES_FILENAME, "w");
+    if (file == NULL) {
+        printf("Warning: cannot write %s: %s\n", METRIC_NAMES_FILENAME, strerror(errno));
+        return;
+    }
+
+    /* "<metric name> <number of changes> <total change>" */
+    for (i = first; i < (first + count); i++) {
+        std::string counter_name;
+        uint64_t num_changes;
+        uint64_t total_delta;
+
+        m_ucx_sampling.counter_name_get(i, &counter_name);
+        if (counter_name.compare(0, strlen(TEMPORARY_COUNTER_NAME_TEMPLATE),
+                TEMPORARY_COUNTER_NAME_TEMPLATE) == 0) {
+            /* Unused temporary counter */
+            break;
+        }
+
+        m_ucx_sampling.counter_activity_get(i, &num_changes, &total_delta);
+        fprintf(file, "%s_%s %" PRIu64 " %" PRIu64 "\n", m_ucx_metric_name.c_str(), counter_name.c_str(),
+            num_changes, total_delta);
+    }
+
+    fclose(file);
+}
+
+
+void
+scorep_plugin_ucx::trace_budget_plan(size_t num_counters)
+{
+    uint32_t aggregate_first = 0;
+    uint32_t aggregate_count = 0;
+    uint32_t aggregate_recorded;
+    uint32_t num_recorded;
+    uint64_t now_ticks = async_clock_get();
+    uint64_t now_nsec = time_nsec_get();
+    double clock_hz = 0;
+
+    /* Measurement clock ticks per second (delta_t is in ticks), 0: unknown */
+    if ((now_nsec > m_trace_calib_nsec) && (now_ticks > m_trace_calib_ticks)) {
+        clock_hz = (double)(now_ticks - m_trace_calib_ticks) * 1e9 / (now_nsec - m_trace_calib_nsec);
+    }
+
+    /* The aggregate counters can be reduced (UCX@N selection), not the NIC counters */
+    m_ucx_sampling.backend_counters_range_get(UCX_SAMPLING_BACKEND_AGGREGATE,
+        &aggregate_first, &aggregate_count);
+    aggregate_recorded = ((m_n_ucx_counters != 0) && (m_n_ucx_counters < aggregate_count)) ?
+                         (uint32_t)m_n_ucx_counters : aggregate_count;
+    num_recorded = (uint32_t)num_counters - aggregate_count + aggregate_recorded;
+    if (m_overhead_enable) {
+        /* The plugin cycles metric */
+        num_recorded++;
+    }
+    if (m_governor_enable) {
+        /* The governor state metric */
+        num_recorded++;
+    }
+
+    m_trace_budget.plan(clock_hz, SCOREP_UCX_PLUGIN_DELTA_T, m_trace_event_rate, num_recorded,
+        aggregate_recorded, m_trace_budget_bytes, m_trace_decimation_max);
+    m_trace_decimation = m_trace_budget.decimation_get();
+
+    /* Fewer aggregate counters (UCX@N, 0 is all: at least one is recorded) */
+    if (m_trace_budget.counters_num_get() < num_recorded) {
+        uint32_t reduced = num_recorded - m_trace_budget.counters_num_get();
+
+        m_n_ucx_counters = (reduced < aggregate_recorded) ? (aggregate_recorded - reduced) : 1;
+    }
+
+    if (m_mpi_rank <= 0) {
+        m_trace_budget.plan_report();
+    }
+}
+
+
+void
+scorep_plugin_ucx::trace_budget_report(void)
+{
+    std::vector<const ucx_trace_budget::location_t *> trace_locations;
+    uint64_t value_bytes = 0;
+    uint32_t i;
+
+    /* Value sizes of the last snapshot: absolute values, or the average delta */
+    for (i = 0; i < m_recorded.size(); i++) {
+        uint64_t value;
+
+        if (!m_recorded[i]) {
+            continue;
+        }
+
+        value = m_ucx_sampling.counter_snapshot_get(i);
+        if (m_delta_mode_enable && m_delta_counters[i] && (m_location != NULL) &&
+            (m_location->trace.records > 0)) {
+            value /= m_location->trace.records;
+        }
+        value_bytes += 1 + ucx_trace_budget::compressed_size(value);
+    }
+
+    m_locations.locations_get(&ucx_location_t::trace, &trace_locations);
+    m_trace_budget.finalize_report(value_bytes, trace_locations);
+}
+
+
+void
+scorep_plugin_ucx::startup_timing_report(void)
+{
+    static const char *phase_names[UCX_STARTUP_PHASE_LAST] = {
+        "plugin_load",
+        "names_discovery",
+        "backends_init",
+        "metric_properties",
+        "mpi_init_wait",
+        "mpi_init_update",
+        "first_sample"
+    };
+    std::ostringstream report;
+    uint32_t i;
+
+    if (m_startup_process_start_nsec) {
+        m_startup_phase_nsec[UCX_STARTUP_PHASE_FIRST_SAMPLE] = time_nsec_get() - m_startup_process_start_nsec;
+    }
+
+    /* One line per rank (parsed by tools/ucx_startup_bench.sh) */
+    report << "UCX plugin startup: rank=" << m_mpi_rank;
+    for (i = 0; i < UCX_STARTUP_PHASE_LAST; i++) {
+        report << " " << phase_names[i] << "_usec=" << (m_startup_phase_nsec[i] / 1000);
+    }
+
+    printf("%s\n", report.str().c_str());
+    fflush(stdout);
+}
+
+
 int32_t
 scorep_plugin_ucx::add_metric(const std::string& metric)
 {
@@ -336,18 +784,72 @@ scorep_plugin_ucx::add_metric(const std::string& metric)
 
     DEBUG_PRINT("add_metric() called with: %s\n", metric);
 
-    /* UCX? */
+    /* UCX? Same counter ID for all the threads (locations) */
     if (event == "UCX") {
-        static uint32_t current_id = 0;
-
-        id = current_id;
-        current_id++;
+        auto it = std::find(m_scorep_metric_names.begin(), m_scorep_metric_names.end(), metric);
+        if (it != m_scorep_metric_names.end()) {
+            id = (int32_t)(it - m_scorep_metric_names.begin());
+        }
+        else {
+            printf("Warning: add_metric(): unknown UCX metric %s\n", metric.c_str());
+        }
     }
 
     return id;
 }
 
 
+uint64_t
+scorep_plugin_ucx::async_clock_get(void)
+{
+    return scorep::chrono::measurement_clock::now().count();
+}
+
+
+uint64_t
+scorep_plugin_ucx::async_get_all_values(int32_t id, SCOREP_MetricTimeValuePair **time_value_list)
+{
+    scorep_plugin_ucx *plugin = m_async_instance;
+
+    *time_value_list = NULL;
+
+    if ((plugin == NULL) || (!plugin->m_async_watcher)) {
+        return 0;
+    }
+
+    /* UCX is up after MPI_Init: start watching */
+    if (unlikely(!plugin->m_mpi_t_initialized)) {
+        if (!plugin->mpi_initialized_update()) {
+            return 0;
+        }
+        plugin->m_async_watcher->start(plugin->m_async_period_usec);
+    }
+
+    /* The watcher refreshes the snapshot: export it at the first watched counter (rate limited) */
+    if (((uint32_t)id == plugin->m_record_first_id) && plugin->m_shm_export_enable &&
+        plugin->m_shm_export.publish_due()) {
+        plugin->m_shm_export.publish();
+    }
+
+    return plugin->m_async_watcher->records_get((uint32_t)id, time_value_list);
+}
+
+
+void
+scorep_plugin_ucx::async_synchronize(bool is_responsible, SCOREP_MetricSynchronizationMode sync_mode)
+{
+    scorep_plugin_ucx *plugin = m_async_instance;
+
+    if ((plugin == NULL) || (!plugin->m_async_watcher)) {
+        return;
+    }
+
+    if (sync_mode == SCOREP_METRIC_SYNCHRONIZATION_MODE_END) {
+        plugin->m_async_watcher->stop();
+    }
+}
+
+
 void
 scorep_plugin_ucx::start()
 {
@@ -378,31 +880,6 @@ scorep_plugin_ucx::scorep_metric_rename(uint32_t counter_id, const char *counter
 }
 
 
-void
-scorep_plugin_ucx::ucx_counters_scorep_update(void)
-{
-    uint32_t i;
-
-    DEBUG_PRINT("ucx_counters_scorep_update() called\n");
-
-    /* Check if Score-P function pointers are initalized */
-    if (!m_pSCOREP_metric_name_update_func) {
-        printf("ucx_counters_scorep_update() error! SCOREP_metric_name_update_func is NULL,\n"
-                "was not provided by the Score-P framework.\n"
-                "Please use the Huawei Score-P 6.0 (branch: huawei-ucx-workaround) at this point\n");
-        return;
-    }
-
-    for (i = 0; i < m_ucx_counters_list.size(); i++) {
-         if (m_ucx_counters_list[i]->scorep_metric_already_renamed == 0) {
-             size_t num_metrics_set = m_ucx_counters_list.size();
-             DEBUG_PRINT("Renaming counter: %p\n", m_ucx_counters_list[i]->name);
-             scorep_metric_rename(i, m_ucx_counters_list[i]->name, 0);
-             m_ucx_counters_list[i]->scorep_metric_already_renamed = 1;
-         }
-    }
-}
-
 void
 scorep_plugin_ucx::metric_name_add_to_file(char *metric_name)
 {
@@ -417,10 +894,12 @@ scorep_plugin_ucx::metric_name_add_to_file(char *metric_name)
 }
 
 int
-scorep_plugin_ucx::metric_name_read_counters_list_from_file(std::vector<std::string> *counters_list)
+scorep_plugin_ucx::metric_name_read_counters_list_from_file(std::vector<std::string> *counters_list,
+    std::vector<std::pair<uint64_t, uint64_t> > *counters_activity)
 {
     FILE *file;
     char temp_counter_name[512];
+    int activity_found = 1;
 
     file = fopen(METRIC_NAMES_FILENAME, "r");
     if (file) {
@@ -435,8 +914,27 @@ scorep_plugin_ucx::metric_name_read_counters_list_from_file(std::vector<std::str
                 temp_counter_name[len - 1] = 0x00;
             }
 
+            /* Optional activity of the previous run: "<name> <changes> <total change>" */
+            char *activity = strchr(temp_counter_name, ' ');
+            unsigned long long num_changes = 0;
+            unsigned long long total_delta = 0;
+
+            if (activity != NULL) {
+                *activity = 0x00;
+                if (sscanf(activity + 1, "%llu %llu", &num_changes, &total_delta) != 2) {
+                    activity_found = 0;
+                }
+            }
+            else {
+                activity_found = 0;
+            }
+
             counters_list->push_back(temp_counter_name);
+            counters_activity->push_back(std::make_pair(num_changes, total_delta));
+        }
 
+        if (!activity_found) {
+            counters_activity->clear();
         }
 
         fclose(file);
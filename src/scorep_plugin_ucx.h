@@ -10,8 +10,10 @@
 #include <scorep/plugin/plugin.hpp>
 
 #include <iostream>
+#include <atomic>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <tuple>
@@ -29,10 +31,31 @@ extern "C" {
 #include <scorep_plugin_ucx_config.h>
 
 #include <ucx_sampling.h>
+#include <ucx_async_watcher.h>
+#include <ucx_shm_export.h>
+#include <ucx_sidecar_writer.h>
+#include <ucx_sampling_worker.h>
+#include <ucx_api.h>
+#include <ucx_location.h>
 #include <plugin_types.h>
 
 #define METRIC_NAMES_FILENAME "ucx_plugin_metric_names.txt"
 
+/* Tracing: minimal measurement clock ticks between two samples of a location (Score-P delta_t) */
+#define SCOREP_UCX_PLUGIN_DELTA_T (8*80000)
+
+/* Startup timing phases */
+typedef enum {
+    UCX_STARTUP_PHASE_PLUGIN_LOAD,          /* Process start -> plugin constructor */
+    UCX_STARTUP_PHASE_NAMES_DISCOVERY,      /* Names file read / local UCX counter names */
+    UCX_STARTUP_PHASE_BACKENDS_INIT,        /* Dispatch table composition */
+    UCX_STARTUP_PHASE_METRIC_PROPERTIES,    /* get_metric_properties() (all of it) */
+    UCX_STARTUP_PHASE_MPI_INIT_WAIT,        /* Metrics defined -> application MPI_Init seen */
+    UCX_STARTUP_PHASE_MPI_INIT_UPDATE,      /* Deferred MPI initialization (rename, names file, server) */
+    UCX_STARTUP_PHASE_FIRST_SAMPLE,         /* Process start -> first sample */
+    UCX_STARTUP_PHASE_LAST
+} ucx_startup_phase_t;
+
 using namespace scorep::plugin::policy;
 using ThreadId = std::thread::id;
 using TimeValuePair = std::pair<scorep::chrono::ticks, double>;
@@ -68,27 +91,167 @@ class scorep_plugin_ucx : public scorep::plugin::base<scorep_plugin_ucx,
         template <typename Proxy>
         void get_optional_value(int32_t id, Proxy& proxy);
 
-        /* Override, in order to set the delta_t */
-        static SCOREP_Metric_Plugin_Info
-        get_info()
+        /* Is Score-P profiling enabled? (SCOREP_ENABLE_PROFILING, enabled by default) */
+        static int
+        profiling_enabled()
         {
             const char *profiling_enabled_env = getenv("SCOREP_ENABLE_PROFILING");
 
+            if (profiling_enabled_env == NULL) {
+                return 1;
+            }
+
+            return ((strcasecmp(profiling_enabled_env, "true") == 0) ||
+                    (strcasecmp(profiling_enabled_env, "yes") == 0) ||
+                    (strcmp(profiling_enabled_env, "1") == 0));
+        }
+
+        /* Is Score-P profiling explicitly enabled? (SCOREP_ENABLE_PROFILING set to true) */
+        static int
+        profiling_explicitly_enabled()
+        {
+            return ((getenv("SCOREP_ENABLE_PROFILING") != NULL) && profiling_enabled());
+        }
+
+        /* Is Score-P tracing enabled? (SCOREP_ENABLE_TRACING, disabled by default) */
+        static int
+        tracing_enabled()
+        {
+            const char *tracing_enabled_env = getenv("SCOREP_ENABLE_TRACING");
+
+            if (tracing_enabled_env == NULL) {
+                return 0;
+            }
+
+            return ((strcasecmp(tracing_enabled_env, "true") == 0) ||
+                    (strcasecmp(tracing_enabled_env, "yes") == 0) ||
+                    (strcmp(tracing_enabled_env, "1") == 0));
+        }
+
+        /*
+           Is the per call path profile mode enabled? With Score-P profiling: on by
+           default when it is explicitly enabled, off when it is only the Score-P
+           default (SCOREP_ENABLE_PROFILING unset).
+        */
+        static int
+        profile_mode_enabled()
+        {
+            const char *profile_mode_env = getenv(ENV_SCOREP_UCX_PLUGIN_PROFILE_MODE_ENABLE);
+
+            if (profile_mode_env == NULL) {
+                return profiling_explicitly_enabled();
+            }
+
+            return ((atoi(profile_mode_env) != 0) && profiling_enabled());
+        }
+
+        /* Is the threshold-triggered async mode enabled? (tracing only) */
+        static int
+        async_mode_enabled()
+        {
+            const char *metric_mode = getenv(ENV_SCOREP_UCX_PLUGIN_METRIC_MODE);
+
+            return ((metric_mode != NULL) && (strcmp(metric_mode, "async") == 0) &&
+                    !profiling_enabled());
+        }
+
+        /* Record the counters once per process? (not with the per UCP worker counters) */
+        static int
+        per_process_enabled()
+        {
+            const char *per_process_env = getenv(ENV_SCOREP_UCX_PLUGIN_PER_PROCESS_ENABLE);
+            const char *per_worker_env = getenv(ENV_SCOREP_UCX_PLUGIN_PER_WORKER_ENABLE);
+
+            return ((per_process_env != NULL) && (atoi(per_process_env) != 0) &&
+                    ((per_worker_env == NULL) || (atoi(per_worker_env) == 0)));
+        }
+
+        /* Override, in order to set the delta_t, the async mode and the per process recording */
+        static SCOREP_Metric_Plugin_Info
+        get_info()
+        {
             SCOREP_Metric_Plugin_Info info =
             scorep::plugin::base<scorep_plugin_ucx, sync, per_thread, scorep_clock>::get_info();
 
-            /* Cannot update the delta_t when profiling */
-            if (strcmp(profiling_enabled_env, "true") != 0) {
+            /*
+               Cannot update the delta_t when profiling (explicitly, or in the
+               profile mode): the profile needs a value on every region enter/exit.
+            */
+            if (!profile_mode_enabled() && !profiling_explicitly_enabled()) {
                 /* Update the delta_t: Required for reduction of TRACING overhead */
-                info.delta_t = 8*80000;
+                info.delta_t = SCOREP_UCX_PLUGIN_DELTA_T;
+            }
+
+            /* Process-wide values: only the main thread location reads and records them */
+            if (per_process_enabled()) {
+                info.run_per = SCOREP_METRIC_PER_PROCESS;
+            }
+
+            /* Async mode: a single watcher per process, records drained at events */
+            if (async_mode_enabled()) {
+                info.sync = SCOREP_METRIC_ASYNC_EVENT;
+                info.run_per = SCOREP_METRIC_PER_PROCESS;
+                info.get_all_values = async_get_all_values;
+                info.synchronize = async_synchronize;
             }
 
             return info;
         }
 
     private:
+        /* Async mode: Score-P get_all_values() callback */
+        static uint64_t
+        async_get_all_values(int32_t id, SCOREP_MetricTimeValuePair **time_value_list);
+
+        /* Async mode: Score-P synchronize() callback */
+        static void
+        async_synchronize(bool is_responsible, SCOREP_MetricSynchronizationMode sync_mode);
+
+        /* Async mode: watcher timestamps (Score-P measurement clock) */
+        static uint64_t
+        async_clock_get(void);
+
+        /* Deferred MPI initialization (rank, UCX statistics server), returns 1 once initialized */
+        inline int
+        mpi_initialized_update(void);
+
+        /* Startup timing: print the phases once, at the first sample */
+        void
+        startup_timing_report(void);
+
+        int m_startup_timing_enable;
+        std::atomic_flag m_startup_timing_reported = ATOMIC_FLAG_INIT;
+        uint64_t m_startup_process_start_nsec;
+        uint64_t m_startup_metrics_defined_nsec;
+        uint64_t m_startup_phase_nsec[UCX_STARTUP_PHASE_LAST];
+
         /* Indicates whether or not MPI is initialized */
-        int m_mpi_t_initialized;
+        std::atomic<int> m_mpi_t_initialized;
+        std::mutex m_mpi_init_lock;
+
+        /* Rename the temporary metrics / write the names file (after MPI_Init) */
+        void
+        metric_names_finalize(void);
+
+        /* Write the metric names file (rank 0, no names file found) */
+        int m_metric_names_file_write;
+
+        /* Number of temporary metric names to rename (0: names were known) */
+        uint32_t m_temporary_names_num;
+
+        /*
+           UCX@N counter selection: activity (changes, total change) of the
+           aggregate counters in the previous run, read from the names file.
+        */
+        std::vector<std::pair<uint64_t, uint64_t> > m_counters_activity;
+
+        /* Select the UCX@N aggregate counters (the most active ones of the previous run) */
+        void
+        counters_select(uint32_t first, uint32_t count, std::vector<uint8_t> *selected);
+
+        /* Rank 0: rewrite the names file with the activity of this run */
+        void
+        counters_activity_write(void);
 
         /* Enable UCX counters collection. */
         int m_ucx_counters_collect_enable;
@@ -106,111 +269,364 @@ class scorep_plugin_ucx : public scorep::plugin::base<scorep_plugin_ucx,
         std::string m_ucx_metric_name;
         size_t m_n_ucx_counters;
 
-        /* UCX counters list + Score-P handles */
-        scorep_counters_list_t m_ucx_counters_list;
+        /* Score-P metric names, indexed by counter ID */
+        std::vector<std::string> m_scorep_metric_names;
 
-        /* Pointer to the Score-P framework metric rename function */
-        SCOREP_metric_name_update_t m_pSCOREP_metric_name_update_func;
+        /*
+           Profiling mode: monotonic counters are reported relative to
+           their first value (accumulated_start), so the Score-P profile
+           accumulates the per call path deltas.
+        */
+        int m_profiling_enable;
+
+        /* Profiling mode: start relative (monotonic) counter flags, indexed by counter ID */
+        std::vector<uint8_t> m_profile_start_relative;
+
+        /* Profiling mode: first value of each counter of this thread (location), and its state */
+        static thread_local std::vector<uint64_t> m_profile_start_values;
+        static thread_local std::vector<uint8_t> m_profile_start_recorded;
+
+        /* Delta mode: monotonic counters are recorded as per-sample differences */
+        int m_delta_mode_enable;
+
+        /* Delta mode: monotonic counter flags, indexed by counter ID */
+        std::vector<uint8_t> m_delta_counters;
+
+        /* Delta mode: previous value of each counter of this thread (location) */
+        static thread_local std::vector<uint64_t> m_delta_prev_values;
+
+        /* Async mode: threshold-triggered records of the watched counters */
+        int m_async_mode_enable;
+        std::unique_ptr<ucx_async_watcher> m_async_watcher;
+        uint64_t m_async_period_usec;
+
+        /* Async mode: the plugin instance (for the static Score-P callbacks) */
+        static scorep_plugin_ucx *m_async_instance;
+
+        /* Live shared-memory export of the latest snapshot */
+        int m_shm_export_enable;
+        uint64_t m_shm_export_period_msec;
+        ucx_shm_export m_shm_export;
+
+        /* Per UCP worker counters: aggregate counter IDs read from the thread's worker */
+        int m_per_worker_enable;
+        uint32_t m_worker_first;
+        uint32_t m_worker_count;
+        /* The first recorded worker counter: refreshes the thread's worker subtree */
+        uint32_t m_worker_refresh_id;
+        ucx_sampling_worker m_ucx_sampling_worker;
+
+        /* Columnar sidecar output (background sampler) */
+        int m_sidecar_enable;
+        uint64_t m_sidecar_period_usec;
+        ucx_sidecar_writer m_sidecar_writer;
+
+        /* Trace volume estimate and budget (tracing, sync mode) */
+        int m_trace_budget_enable;
+        uint64_t m_trace_budget_bytes;
+        uint64_t m_trace_event_rate;
+        uint32_t m_trace_decimation_max;
+        uint32_t m_trace_decimation;
+        ucx_trace_budget m_trace_budget;
+
+        /* Measurement clock calibration: clock ticks and monotonic time at the plugin load */
+        uint64_t m_trace_calib_ticks;
+        uint64_t m_trace_calib_nsec;
 
-#if defined(SCOREP_PLUGIN_MICROBENCHMARK_ENABLE)
-        double m_ticks_cnt_get_total;
-        double m_ticks_cnt_get_num_times;
-#endif
+        /*
+           Recorded counters (Score-P metrics), indexed by counter ID, and the first
+           one: UCX@N selected (after the trace budget), and watched in async mode.
+        */
+        std::vector<uint8_t> m_recorded;
+        uint32_t m_record_first_id;
 
+        /* Plan the trace volume of the recorded counters (may reduce UCX@N, to 1 at least) */
         void
-        metrics_names_serialize(void **names, size_t *size);
+        trace_budget_plan(size_t num_counters);
 
+        /* Print the recorded trace volume against the estimate */
         void
-        ucx_counters_scorep_update(void);
+        trace_budget_report(void);
+
+        /* Trace volume: is a sample of the current event recorded? (decimation) */
+        inline int
+        trace_sample_due(int32_t id);
+
+        /* Pointer to the Score-P framework metric rename function */
+        SCOREP_metric_name_update_t m_pSCOREP_metric_name_update_func;
+
+        /* Self-overhead: cycles per counter read histogram, plugin cycles metric (Score-P ID) */
+        int m_overhead_enable;
+        uint32_t m_overhead_id;
+        ucx_overhead m_overhead;
+
+        /* Overhead governor: CPU budget, governor state metric (Score-P ID) */
+        int m_governor_enable;
+        uint32_t m_governor_id;
+        ucx_governor m_governor;
+
+        /* Trace volume, self-overhead and governor state of the locations, and of this thread */
+        ucx_location_registry m_locations;
+        static thread_local ucx_location_t *m_location;
+
+        /* The state of this thread (location), registered at its first sample */
+        inline ucx_location_t *
+        location_get();
+
+        /* Self-overhead: read a counter (or the plugin cycles metric) and account its cycles */
+        inline uint64_t
+        overhead_value_get(int32_t id);
 
         /* Renames a Score-P metric (for dynamic allocation of metrics) */
         int
         scorep_metric_rename(uint32_t counter_id, const char *counter_new_name, size_t num_metrics_set);
 
-        /* UCX statistics - Legacy enumerator */
-        void
-        ucx_statistics_enumerate_legacy(uint64_t dummy);
-
         void
         metric_name_add_to_file(char *metric_name);
 
         int
-        metric_name_read_counters_list_from_file(std::vector<std::string> *counters_list);
+        metric_name_read_counters_list_from_file(std::vector<std::string> *counters_list,
+            std::vector<std::pair<uint64_t, uint64_t> > *counters_activity);
+
+        /* Profiling mode: convert a monotonic counter to a start relative value */
+        inline void
+        profile_value_update(int32_t id, uint64_t *value);
+
+        /* Delta mode: convert a monotonic counter to the difference to the previous sample */
+        inline void
+        delta_value_update(int32_t id, uint64_t *value);
 
 };
 
 
+inline void
+scorep_plugin_ucx::profile_value_update(int32_t id, uint64_t *value)
+{
+    if (m_profile_start_relative[id] == 0) {
+        /* Point value (e.g. NIC min/max/cv), reported as is */
+        return;
+    }
+
+    /* Per location start values: the locations sample concurrently */
+    if (unlikely(m_profile_start_recorded.size() <= (size_t)id)) {
+        m_profile_start_values.resize(m_profile_start_relative.size(), 0);
+        m_profile_start_recorded.resize(m_profile_start_relative.size(), 0);
+    }
+
+    if (unlikely(!m_profile_start_recorded[id])) {
+        m_profile_start_values[id] = *value;
+        m_profile_start_recorded[id] = 1;
+    }
+
+    *value = (*value >= m_profile_start_values[id]) ? (*value - m_profile_start_values[id]) : 0;
+}
+
+
 inline int
-scorep_plugin_ucx::current_value_get(int32_t id, uint64_t *value, uint64_t *prev_value)
+scorep_plugin_ucx::mpi_initialized_update(void)
 {
-    uint64_t prev_val;
-    int ret;
-    int flag;
-    int is_value_updated;
-    size_t num_ucx_aggrgt_sum_cnts;
     const ucs_stats_aggrgt_counter_name_t *counter_names;
     size_t size;
     uint32_t index;
     uint64_t counter_value;
+    int ret;
+    int flag;
+
+    if (likely(m_mpi_t_initialized)) {
+        return 1;
+    }
+
+    /* After the application's MPI_Init: the plugin never initializes MPI itself */
+    ret = MPI_Initialized(&flag);
+    if (!flag) {
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mpi_init_lock);
+    if (m_mpi_t_initialized) {
+        return 1;
+    }
+
+    uint64_t start_nsec = time_nsec_get();
+
+    if (m_startup_metrics_defined_nsec) {
+        m_startup_phase_nsec[UCX_STARTUP_PHASE_MPI_INIT_WAIT] = start_nsec - m_startup_metrics_defined_nsec;
+    }
+
+    /* get global rank */
+    PMPI_Comm_rank(MPI_COMM_WORLD, &m_mpi_rank);
+    m_shm_export.rank_set(m_mpi_rank);
+
+    /* UCX counter names are known now: rename the temporary metrics, write the names file */
+    metric_names_finalize();
+
+    /* UCX is up: start the sidecar sampler of this rank */
+    if ((m_sidecar_enable) && (m_ucx_sampling.counters_num_get() > 0)) {
+        m_sidecar_writer.start(&m_ucx_sampling, m_mpi_rank,
+            getenv(ENV_SCOREP_UCX_PLUGIN_SIDECAR_DIR), m_sidecar_period_usec);
+    }
+
+    /* ===> New mode: Use the UCX aggregate-sum API to reduce the amount of collected information */
+    /* For now, we need to enable the server to enable UCX counters collection */
+    if (m_mpi_rank == 0) {
+        /* Start UCX statistics server */
+        ret = m_ucx_sampling.ucx_statistics_server_start(UCS_STATS_DEFAULT_UDP_PORT);
+    }
+
+    index = 0;
+    ret = m_ucx_sampling.ucx_statistics_aggregate_counter_get(index, &counter_value);
+    if (!ret) {
+        printf("Warning! ucx_statistics_aggregate_counter_get() failed, ret=%d\n", ret);
+    }
+
+    /* Initialize the UCX aggregate-sum API */
+    ret = m_ucx_sampling.ucx_statistics_aggregate_counter_names_get(&counter_names, &size);
+    if (!ret) {
+        printf("Warning! ucx_statistics_aggregate_counter_get() failed, ret=%d\n", ret);
+    }
+
+    m_startup_phase_nsec[UCX_STARTUP_PHASE_MPI_INIT_UPDATE] = time_nsec_get() - start_nsec;
+    m_mpi_t_initialized = 1;
+
+    return 1;
+}
+
+
+inline int
+scorep_plugin_ucx::current_value_get(int32_t id, uint64_t *value, uint64_t *prev_value)
+{
+    int is_value_updated = 0;
+    int throttled = 0;
+    uint64_t ticks_start = 0;
 
     *value = 0;
     *prev_value = 0;
 
-    if (0 == m_mpi_t_initialized) {
-        is_value_updated = 1;
+    if (unlikely(!mpi_initialized_update())) {
+        /* Value (0) is updated until MPI is initialized */
+        return 1;
+    }
 
-        ret = MPI_Initialized(&flag);
-        if (flag) {
-            m_mpi_t_initialized = 1;
-            /* get global rank */
-            PMPI_Comm_rank(MPI_COMM_WORLD, &m_mpi_rank);
-
-            /* ===> New mode: Use the UCX aggregate-sum API to reduce the amount of collected information */
-            /* For now, we need to enable the server to enable UCX counters collection */
-            if (m_mpi_rank == 0) {
-                /* Start UCX statistics server */
-                ret = m_ucx_sampling.ucx_statistics_server_start(UCS_STATS_DEFAULT_UDP_PORT);
-            }
+    /* Overhead governor: the first recorded counter decides for the event */
+    if (unlikely(m_governor_enable)) {
+        ucx_governor::location_t *location = &location_get()->governor;
 
-            index = 0;
-            ret = m_ucx_sampling.ucx_statistics_aggregate_counter_get(index, &counter_value);
-            if (!ret) {
-                printf("Warning! ucx_statistics_aggregate_counter_get() failed, ret=%d\n", ret);
-            }
+        ticks_start = __rdtsc();
+        if ((uint32_t)id == m_record_first_id) {
+            m_governor.event_throttle(location, ticks_start);
+        }
+        throttled = location->throttled;
+    }
 
-            /* Initialize the UCX aggregate-sum API */
-            ret = m_ucx_sampling.ucx_statistics_aggregate_counter_names_get(&counter_names, &size);
-            if (!ret) {
-                printf("Warning! ucx_statistics_aggregate_counter_get() failed, ret=%d\n", ret);
+    /* Dispatch table lookup: aggregate / legacy / ethtool / sysfs backends */
+    if (likely((uint32_t)id < m_ucx_sampling.counters_num_get())) {
+        if ((m_per_worker_enable) && (((uint32_t)id - m_worker_first) < m_worker_count)) {
+            /* The worker subtree of this thread (location) */
+            if (((uint32_t)id == m_worker_refresh_id) && !throttled) {
+                m_ucx_sampling_worker.thread_refresh();
             }
+            *value = m_ucx_sampling_worker.thread_value_get(id - m_worker_first);
+        }
+        else if (unlikely(throttled)) {
+            /* Over the CPU budget: the last snapshot, no refresh */
+            *value = m_ucx_sampling.counter_snapshot_get(id);
         }
         else {
-            return is_value_updated;
+            *value = m_ucx_sampling.counter_value_get(id);
         }
-    }
-
-    /* Update counter via Aggregate-sum API */
-    num_ucx_aggrgt_sum_cnts = m_ucx_sampling.ucx_statistics_aggrgt_sum_total_counters_num_get();
-    if (id < num_ucx_aggrgt_sum_cnts) {
-        /* UCX SW counters */
-        ret = m_ucx_sampling.ucx_statistics_aggregate_counter_get(id, value);
         is_value_updated = 1;
+
+        /* Once per event, at the first recorded counter: export the snapshot (rate limited) */
+        if (unlikely((uint32_t)id == m_record_first_id) && m_shm_export_enable &&
+            m_shm_export.publish_due()) {
+            if (m_per_worker_enable) {
+                /* The process-wide snapshot is not refreshed by the worker counters */
+                m_ucx_sampling.backends_refresh();
+            }
+            m_shm_export.publish();
+        }
+
+        if (m_profiling_enable) {
+            profile_value_update(id, value);
+        }
+        else if (m_delta_mode_enable) {
+            delta_value_update(id, value);
+        }
+
+        if (unlikely(m_startup_timing_enable) && !m_startup_timing_reported.test_and_set()) {
+            startup_timing_report();
+        }
     }
-    else { /* NIC counters */
-#if defined(UCX_STATS_NIC_COUNTERS_ENABLE)
-        /*
-           Get counter value (the index of the NIC counter
-           is calculated by substracting the num_ucx_aggrgt_sum_cnts from the
-           Score-P counter index.
-        */
-        *value = m_ucx_sampling.nic_counter_value_get((id - num_ucx_aggrgt_sum_cnts));
+    else if ((uint32_t)id == m_governor_id) {
+        /* Governor state of the location: 1 - throttled, 0 - sampling */
+        *value = throttled;
         is_value_updated = 1;
-#endif
+    }
+
+    if (unlikely(m_governor_enable)) {
+        ucx_governor::charge(&m_location->governor, __rdtsc() - ticks_start);
     }
 
     return is_value_updated;
 }
 
+inline ucx_location_t *
+scorep_plugin_ucx::location_get()
+{
+    ucx_location_t *location = m_location;
+
+    if (unlikely(location == NULL)) {
+        location = m_location = m_locations.location_register();
+        m_governor.location_init(&location->governor);
+    }
+
+    return location;
+}
+
+inline void
+scorep_plugin_ucx::delta_value_update(int32_t id, uint64_t *value)
+{
+    uint64_t prev_value;
+
+    if (m_delta_counters[id] == 0) {
+        return;
+    }
+
+    if (unlikely(m_delta_prev_values.size() <= (size_t)id)) {
+        m_delta_prev_values.resize(m_delta_counters.size(), 0);
+    }
+
+    prev_value = m_delta_prev_values[id];
+    m_delta_prev_values[id] = *value;
+
+    *value = (*value >= prev_value) ? (*value - prev_value) : 0;
+}
+
+inline uint64_t
+scorep_plugin_ucx::overhead_value_get(int32_t id)
+{
+    ucx_overhead::location_t *location = &location_get()->overhead;
+    uint64_t ticks_start = __rdtsc();
+    uint64_t value;
+    uint64_t prev_value;
+
+    /* Plugin cycles of the location: since the start (profiling), or since the previous sample */
+    if ((uint32_t)id == m_overhead_id) {
+        if (m_profiling_enable) {
+            return location->cycles;
+        }
+
+        value = location->cycles - location->prev_cycles;
+        location->prev_cycles = location->cycles;
+        return value;
+    }
+
+    current_value_get(id, &value, &prev_value);
+    ucx_overhead::sample_add(location, __rdtsc() - ticks_start);
+
+    return value;
+}
+
 template <typename Proxy>
 void
 scorep_plugin_ucx::get_current_value(int32_t id, Proxy& proxy)
@@ -219,22 +635,37 @@ scorep_plugin_ucx::get_current_value(int32_t id, Proxy& proxy)
     uint64_t value;
     uint64_t prev_value;
 
-#if defined(SCOREP_PLUGIN_MICROBENCHMARK_ENABLE)
-    uint64_t ticks_start = __rdtsc();
-#endif
+    if (unlikely(m_overhead_enable)) {
+        proxy.write(overhead_value_get(id));
+        return;
+    }
 
     is_value_updated = current_value_get(id, &value, &prev_value);
 
     proxy.write(value);
+}
 
 
-#if defined(SCOREP_PLUGIN_MICROBENCHMARK_ENABLE)
-    /* Update micro benchmark */
-    m_ticks_cnt_get_total += (double)(__rdtsc() - ticks_start);
-    m_ticks_cnt_get_num_times++;
-#endif
-}
+inline int
+scorep_plugin_ucx::trace_sample_due(int32_t id)
+{
+    ucx_trace_budget::location_t *location = &location_get()->trace;
+
+    /* The first recorded counter decides for all the counters of the event */
+    if ((uint32_t)id == m_record_first_id) {
+        location->events++;
+        location->skip = (location->countdown != 0);
+        if (location->skip) {
+            location->countdown--;
+        }
+        else {
+            location->countdown = m_trace_decimation - 1;
+            location->records++;
+        }
+    }
 
+    return !location->skip;
+}
 
 template <typename Proxy>
 void
@@ -244,18 +675,18 @@ scorep_plugin_ucx::get_optional_value(int32_t id, Proxy& proxy)
     uint64_t value;
     uint64_t prev_value;
 
-#if defined(SCOREP_PLUGIN_MICROBENCHMARK_ENABLE)
-    uint64_t ticks_start = __rdtsc();
-#endif
+    /* Trace volume budget: no value, no sample recorded (nor read) */
+    if (unlikely(m_trace_budget_enable) && !trace_sample_due(id)) {
+        return;
+    }
+
+    if (unlikely(m_overhead_enable)) {
+        proxy.write(overhead_value_get(id));
+        return;
+    }
 
     is_value_updated = current_value_get(id, &value, &prev_value);
     proxy.write(value);
-
-#if defined(SCOREP_PLUGIN_MICROBENCHMARK_ENABLE)
-    /* Update micro benchmark */
-    m_ticks_cnt_get_total += (double)(__rdtsc() - ticks_start);
-    m_ticks_cnt_get_num_times++;
-#endif
 }
 
 #endif /* _SCOREP_PLUGIN_UCX_H_ */
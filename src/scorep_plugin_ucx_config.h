@@ -1,12 +1,6 @@
 #if !defined(_SCOREP_PLUGIN_UCX_CONFIG_H_)
 #define _SCOREP_PLUGIN_UCX_CONFIG_H_
 
-/*
-   Enable plugin microbenchmark: Measure mean CPU cycles
-   for getting a single counter value.
-*/
-//#define SCOREP_PLUGIN_MICROBENCHMARK_ENABLE
-
 /*
     NIC counters acquisition decimation value in order to reduce overhead.
     **** Note, that this definition must be a power of 2.
@@ -14,17 +8,203 @@
 #define NIC_COUNTERS_UPDATE_DECIMATION (128)
 
 /*
-   Enable plugin gathering of NIC counters.
-   Note, that this feature is only supporte over HUCX and not over OpenUCX.
+   An environment variable that selects the sampling backends, a comma separated
+   list (in counter ID order) of: aggregate, legacy, direct, udp, ethtool, sysfs.
+   When unset, the backends follow the UCX/NIC collection enable variables:
+   UCX counters ==> aggregate, NIC counters ==> ethtool.
 */
-//#define UCX_STATS_NIC_COUNTERS_ENABLE
+#define ENV_SCOREP_UCX_PLUGIN_BACKENDS "SCOREP_UCX_PLUGIN_BACKENDS"
 
 /*
-   An environment variable that Sets the NIC device name for the
-   NIC counters collection.
+   An environment variable that Sets the NIC device name(s) for the
+   NIC counters collection: a comma separated list of interfaces, or "auto"
+   (also when unset) for discovery from UCX_NET_DEVICES.
 */
 #define ENV_SCOREP_UCX_PLUGIN_NIC_DEVICE_NAME "SCOREP_UCX_PLUGIN_NIC_DEVICE_NAME"
 
+/*
+   An environment variable that selects the NIC aggregate-sum counters to collect:
+   a comma separated list of name patterns, e.g. "rx_bytes*,tx_packets_phy".
+   All aggregates are collected when unset.
+*/
+#define ENV_SCOREP_UCX_PLUGIN_NIC_COUNTERS_FILTER "SCOREP_UCX_PLUGIN_NIC_COUNTERS_FILTER"
+
+/*
+   An environment variable that enables the NIC per-queue imbalance counters:
+   min, max and coefficient of variation (parts per thousand) of the queue
+   increments since the previous NIC refresh, next to each aggregate-sum of
+   more than one queue. values: 1 / 0 (default)
+*/
+#define ENV_SCOREP_UCX_PLUGIN_NIC_IMBALANCE_ENABLE "SCOREP_UCX_PLUGIN_NIC_IMBALANCE_ENABLE"
+
+/*
+   An environment variable that sets how monotonic counters are recorded in traces:
+   "absolute" (default) - the cumulative value.
+   "delta" - the difference to the previous sample of the same location
+             (relative_last metrics, compress much better in OTF2).
+   "async" - threshold-triggered asynchronous events: a watcher thread records
+             a counter only when its change crosses the counter threshold.
+*/
+#define ENV_SCOREP_UCX_PLUGIN_METRIC_MODE "SCOREP_UCX_PLUGIN_METRIC_MODE"
+
+/*
+   An environment variable that enables the per call path profile mode (with Score-P profiling):
+   monotonic counters are start relative (accumulated_start metrics), sampled on every region
+   enter/exit (no delta_t). values: 1 / 0. default: 1 when SCOREP_ENABLE_PROFILING is explicitly
+   true, 0 otherwise (SCOREP_ENABLE_PROFILING unset, the Score-P default)
+*/
+#define ENV_SCOREP_UCX_PLUGIN_PROFILE_MODE_ENABLE "SCOREP_UCX_PLUGIN_PROFILE_MODE_ENABLE"
+
+/*
+   An environment variable that sets the async mode thresholds: a comma separated
+   list of <counter name pattern>=<threshold>, e.g. "*tx_am*bytes=1048576".
+   Only the matching counters are recorded. When unset, all counters are
+   recorded on any change ("*=1").
+*/
+#define ENV_SCOREP_UCX_PLUGIN_ASYNC_THRESHOLDS "SCOREP_UCX_PLUGIN_ASYNC_THRESHOLDS"
+
+/*
+   An environment variable that sets the async mode watcher period (micro seconds).
+*/
+#define ENV_SCOREP_UCX_PLUGIN_ASYNC_PERIOD_USEC "SCOREP_UCX_PLUGIN_ASYNC_PERIOD_USEC"
+
+/*
+   An environment variable that records the (process-wide) counters once per process,
+   on the main thread location (SCOREP_METRIC_PER_PROCESS), instead of on every thread.
+   Ignored with the per UCP worker counters. values: 1 / 0 (default)
+*/
+#define ENV_SCOREP_UCX_PLUGIN_PER_PROCESS_ENABLE "SCOREP_UCX_PLUGIN_PER_PROCESS_ENABLE"
+
+/*
+   An environment variable that enables the per UCP worker counters: each thread
+   (Score-P location) reports the aggregate-sum counters of its own UCP worker
+   subtree instead of the process-wide aggregate. values: 1 / 0 (default)
+*/
+#define ENV_SCOREP_UCX_PLUGIN_PER_WORKER_ENABLE "SCOREP_UCX_PLUGIN_PER_WORKER_ENABLE"
+
+/*
+   An environment variable that overrides the job ID (shared-memory export and
+   other per job names). Otherwise taken from SLURM / PBS / LSF / Open MPI.
+*/
+#define ENV_SCOREP_UCX_PLUGIN_JOB_ID "SCOREP_UCX_PLUGIN_JOB_ID"
+
+/*
+   An environment variable that enables the live shared-memory export of the
+   counters (/dev/shm/scorep_ucx.<job_id>, see the ucx_shm_top tool). values: 1 / 0 (default)
+*/
+#define ENV_SCOREP_UCX_PLUGIN_SHM_EXPORT_ENABLE "SCOREP_UCX_PLUGIN_SHM_EXPORT_ENABLE"
+
+/*
+   An environment variable that sets the shared-memory export period (milli seconds).
+*/
+#define ENV_SCOREP_UCX_PLUGIN_SHM_EXPORT_PERIOD_MSEC "SCOREP_UCX_PLUGIN_SHM_EXPORT_PERIOD_MSEC"
+
+/*
+   An environment variable that enables the columnar sidecar output: all the counters
+   are sampled by a background thread into <dir>/ucx_counters.<job_id>.<rank>.ucxc
+   values: 1 / 0 (default)
+*/
+#define ENV_SCOREP_UCX_PLUGIN_SIDECAR_ENABLE "SCOREP_UCX_PLUGIN_SIDECAR_ENABLE"
+
+/*
+   An environment variable that sets the sidecar sampling period (micro seconds).
+*/
+#define ENV_SCOREP_UCX_PLUGIN_SIDECAR_PERIOD_USEC "SCOREP_UCX_PLUGIN_SIDECAR_PERIOD_USEC"
+
+/*
+   An environment variable that sets the sidecar files directory (default: current directory).
+*/
+#define ENV_SCOREP_UCX_PLUGIN_SIDECAR_DIR "SCOREP_UCX_PLUGIN_SIDECAR_DIR"
+
+/*
+   An environment variable that selects the plugin-side aggregate-sum (aggregate backend):
+   a cached per-class node index summed linearly (AVX2 gather when available), rebuilt
+   when the UCX statistics tree changes, instead of ucs_stats_aggregate(). Requires the
+   UCX_STATS_TRIGGER "exit" (UCX default), which keeps the destroyed statistics nodes.
+   values: 1 / 0 (default)
+*/
+#define ENV_SCOREP_UCX_PLUGIN_AGGREGATE_INDEX_ENABLE "SCOREP_UCX_PLUGIN_AGGREGATE_INDEX_ENABLE"
+
+/*
+   An environment variable that sets the number of per-object counters (legacy and direct
+   backends) registered with temporary names before MPI_Init, renamed once the UCX objects
+   are discovered (after MPI_Init). default: UCX_SAMPLING_DEFERRED_COUNTERS_DEFAULT
+*/
+#define ENV_SCOREP_UCX_PLUGIN_OBJECT_COUNTERS_NUM "SCOREP_UCX_PLUGIN_OBJECT_COUNTERS_NUM"
+
+/*
+   An environment variable that overrides the UDP port of the per node UCX statistics
+   receiver (udp backend). Otherwise derived from the job ID (see the ucx_stats_port tool):
+   UCX_STATS_UDP_PORT_BASE + hash(job ID) % UCX_STATS_UDP_PORT_RANGE.
+*/
+#define ENV_SCOREP_UCX_PLUGIN_UDP_PORT "SCOREP_UCX_PLUGIN_UDP_PORT"
+
+/*
+   An environment variable that sets the number of receiver sockets / threads of the
+   per node UCX statistics receiver (udp backend).
+*/
+#define ENV_SCOREP_UCX_PLUGIN_UDP_RECEIVER_THREADS "SCOREP_UCX_PLUGIN_UDP_RECEIVER_THREADS"
+
+/*
+   An environment variable that sets the IPv4 address the per node UCX statistics
+   receiver (udp backend) binds, e.g. "0.0.0.0" to receive from other nodes.
+   default: UCX_STATS_UDP_ADDRESS_DEFAULT (the local UCX processes only)
+*/
+#define ENV_SCOREP_UCX_PLUGIN_UDP_ADDRESS "SCOREP_UCX_PLUGIN_UDP_ADDRESS"
+#define UCX_STATS_UDP_ADDRESS_DEFAULT "127.0.0.1"
+
+/* UCX statistics receiver: job ports range (above the UCX default statistics port) */
+#define UCX_STATS_UDP_PORT_BASE  37874
+#define UCX_STATS_UDP_PORT_RANGE 4096
+
+/*
+   An environment variable that enables the startup timing: each rank prints the time
+   from the process start to its first sample and the time of each startup phase
+   (see tools/ucx_startup_bench.sh). values: 1 / 0 (default)
+*/
+#define ENV_SCOREP_UCX_PLUGIN_STARTUP_TIMING_ENABLE "SCOREP_UCX_PLUGIN_STARTUP_TIMING_ENABLE"
+
+/*
+   An environment variable that sets the sampling period (micro seconds) of the standalone
+   LD_PRELOAD collector (libscorep_plugin_ucx_collector.so), default 10000.
+*/
+#define ENV_SCOREP_UCX_PLUGIN_COLLECTOR_PERIOD_USEC "SCOREP_UCX_PLUGIN_COLLECTOR_PERIOD_USEC"
+
+/*
+   An environment variable that sets the UCX metrics trace volume budget (bytes per second
+   per location, tracing only). The plugin decimates the samples (up to
+   SCOREP_UCX_PLUGIN_TRACE_DECIMATION_MAX), then records fewer UCX counters (the most active
+   ones, see UCX@N) to stay under the budget. Unset: the projected volume is logged only.
+*/
+#define ENV_SCOREP_UCX_PLUGIN_TRACE_BUDGET "SCOREP_UCX_PLUGIN_TRACE_BUDGET"
+
+/*
+   An environment variable that sets the expected sampled events per second per location
+   of the trace volume estimate (default: one per Score-P delta_t, the upper bound).
+*/
+#define ENV_SCOREP_UCX_PLUGIN_TRACE_EVENT_RATE "SCOREP_UCX_PLUGIN_TRACE_EVENT_RATE"
+
+/*
+   An environment variable that sets the largest sample decimation factor of the trace
+   volume budget, default 16.
+*/
+#define ENV_SCOREP_UCX_PLUGIN_TRACE_DECIMATION_MAX "SCOREP_UCX_PLUGIN_TRACE_DECIMATION_MAX"
+
+/*
+   An environment variable that enables the self-overhead measurement: a log2 histogram of
+   the cycles per counter read, printed at finalize, and the plugin cycles of each location
+   as a metric (UCX@N_plugin_cycles, per sample interval). values: 1 / 0 (default)
+*/
+#define ENV_SCOREP_UCX_PLUGIN_OVERHEAD_ENABLE "SCOREP_UCX_PLUGIN_OVERHEAD_ENABLE"
+
+/*
+   An environment variable that enables the overhead governor with a CPU budget: the plugin
+   cycles of each location as a percentage of its elapsed time, e.g. 0.5. Over the budget,
+   the counters are served from the last snapshot (no refresh) until the load drops. The
+   governor state is recorded as a metric (UCX@N_governor_throttled). Unset: disabled.
+*/
+#define ENV_SCOREP_UCX_PLUGIN_GOVERNOR_BUDGET "SCOREP_UCX_PLUGIN_GOVERNOR_BUDGET"
+
 /*
    An environment variable that enables UCX counters collection.
    values: "enable" / "disable"
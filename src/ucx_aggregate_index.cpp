@@ -0,0 +1,217 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <algorithm>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include <utils.h>
+
+#include "ucx_aggregate_index.h"
+#include "ucx_stats_tree.h"
+
+ucx_aggregate_index::ucx_aggregate_index()
+{
+    m_names = NULL;
+    m_names_size = 0;
+    m_signature.num_nodes = 0;
+    m_signature.nodes_xor = 0;
+    m_verify_nsec = 0;
+    m_rebuilds = 0;
+    m_range_sum = range_sum;
+
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("avx2")) {
+        m_range_sum = range_sum_avx2;
+    }
+#endif
+}
+
+int
+ucx_aggregate_index::is_supported()
+{
+    return ucx_stats_tree_nodes_persistent();
+}
+
+void
+ucx_aggregate_index::signature_get(const ucs_stats_node_t *node, tree_signature_t *signature)
+{
+    ucs_stats_node_t *child;
+
+    signature->num_nodes++;
+    signature->nodes_xor ^= ((uintptr_t)node * 31) ^ (uintptr_t)node->cls;
+
+    UCX_STATS_TREE_FOR_EACH_CHILD(child, node) {
+        signature_get(child, signature);
+    }
+}
+
+const ucx_aggregate_index::class_mapping_t&
+ucx_aggregate_index::class_mapping_get(const ucs_stats_class_t *cls)
+{
+    auto it = m_class_mappings.find(cls);
+    class_mapping_t mapping;
+    unsigned k;
+    size_t i;
+
+    if (likely(it != m_class_mappings.end())) {
+        return it->second;
+    }
+
+    for (k = 0; k < cls->num_counters; k++) {
+        int32_t index = -1;
+
+        for (i = 0; i < m_names_size; i++) {
+            if ((strcmp(m_names[i].class_name, cls->name) == 0) &&
+                (strcmp(m_names[i].counter_name, cls->counter_names[k]) == 0)) {
+                index = (int32_t)i;
+                break;
+            }
+        }
+
+        mapping.push_back(index);
+    }
+
+    return m_class_mappings.emplace(cls, mapping).first->second;
+}
+
+void
+ucx_aggregate_index::nodes_index(const ucs_stats_node_t *node,
+    std::vector<std::vector<const uint64_t *> > *addresses)
+{
+    const class_mapping_t& mapping = class_mapping_get(node->cls);
+    ucs_stats_node_t *child;
+    size_t k;
+
+    for (k = 0; k < mapping.size(); k++) {
+        if (mapping[k] >= 0) {
+            (*addresses)[mapping[k]].push_back(&node->counters[k]);
+        }
+    }
+
+    UCX_STATS_TREE_FOR_EACH_CHILD(child, node) {
+        nodes_index(child, addresses);
+    }
+}
+
+void
+ucx_aggregate_index::index_build(const ucs_stats_node_t *root)
+{
+    std::vector<std::vector<const uint64_t *> > addresses;
+    size_t i;
+
+    /* The aggregate-sum names are static (UCX library), fetched once */
+    if (m_names == NULL) {
+        ucs_stats_aggregate_get_counter_names(&m_names, &m_names_size);
+    }
+
+    addresses.resize(m_names_size);
+    nodes_index(root, &addresses);
+
+    /* Flatten: one contiguous address range per aggregate index */
+    m_addresses.clear();
+    m_first.assign(m_names_size, 0);
+    m_count.assign(m_names_size, 0);
+    for (i = 0; i < m_names_size; i++) {
+        m_first[i] = m_addresses.size();
+        m_count[i] = addresses[i].size();
+        m_addresses.insert(m_addresses.end(), addresses[i].begin(), addresses[i].end());
+    }
+
+    m_rebuilds++;
+    DEBUG_PRINT("UCX aggregate index rebuilt (%lu): %lu nodes, %zu counters\n",
+        m_rebuilds, m_signature.num_nodes, m_addresses.size());
+}
+
+uint64_t
+ucx_aggregate_index::range_sum(const uint64_t * const *addresses, uint32_t count)
+{
+    uint64_t sum = 0;
+    uint32_t i;
+
+    for (i = 0; i < count; i++) {
+        sum += *addresses[i];
+    }
+
+    return sum;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2"))) uint64_t
+ucx_aggregate_index::range_sum_avx2(const uint64_t * const *addresses, uint32_t count)
+{
+    __m256i sum_v = _mm256_setzero_si256();
+    uint64_t lanes[4];
+    uint64_t sum;
+    uint32_t i;
+
+    /* Gather 4 counters (absolute addresses as the indices) */
+    for (i = 0; (i + 4) <= count; i += 4) {
+        __m256i address_v = _mm256_loadu_si256((const __m256i *)&addresses[i]);
+
+        sum_v = _mm256_add_epi64(sum_v, _mm256_i64gather_epi64((const long long *)0, address_v, 1));
+    }
+
+    _mm256_storeu_si256((__m256i *)lanes, sum_v);
+    sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+
+    for (; i < count; i++) {
+        sum += *addresses[i];
+    }
+
+    return sum;
+}
+#endif
+
+size_t
+ucx_aggregate_index::refresh(uint64_t *counters, size_t size)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    ucs_stats_node_t *root = ucs_stats_get_root();
+    tree_signature_t signature = {0, 0};
+    uint64_t now_nsec;
+    size_t i;
+
+    if (unlikely(root == NULL)) {
+        return 0;
+    }
+
+    /* Objects created or destroyed: rebuild the index (verified periodically) */
+    now_nsec = time_nsec_get();
+    if (unlikely(now_nsec >= m_verify_nsec)) {
+        m_verify_nsec = now_nsec + UCX_AGGREGATE_INDEX_VERIFY_PERIOD_NSEC;
+
+        signature_get(root, &signature);
+        if (unlikely((signature.num_nodes != m_signature.num_nodes) ||
+                     (signature.nodes_xor != m_signature.nodes_xor))) {
+            m_signature = signature;
+            index_build(root);
+
+            /* The tree changed during the build: rebuild at the next refresh */
+            signature.num_nodes = 0;
+            signature.nodes_xor = 0;
+            signature_get(root, &signature);
+            if ((signature.num_nodes != m_signature.num_nodes) ||
+                (signature.nodes_xor != m_signature.nodes_xor)) {
+                m_signature.num_nodes = 0;
+                m_verify_nsec = 0;
+            }
+        }
+    }
+
+    size = std::min(size, m_names_size);
+    for (i = 0; i < size; i++) {
+        counters[i] = m_range_sum(&m_addresses[m_first[i]], m_count[i]);
+    }
+
+    return size;
+}
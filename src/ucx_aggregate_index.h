@@ -0,0 +1,121 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+#if !defined(_UCX_AGGREGATE_INDEX_H_)
+#define _UCX_AGGREGATE_INDEX_H_
+
+#include <stdint.h>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <ucs/stats/libstats.h>
+#include <ucs/stats/stats.h>
+#ifdef __cplusplus
+}
+#endif
+
+/* Period of the tree signature verification (nano seconds) */
+#define UCX_AGGREGATE_INDEX_VERIFY_PERIOD_NSEC   10000000
+
+/*
+   Plugin-side aggregate-sum over a cached node index.
+
+   The statistics tree is indexed once: the counter names of each stats class
+   are matched to the aggregate-sum names (cached per class), and the address
+   of every aggregated node counter is recorded, grouped by aggregate index.
+   A refresh is then a linear sum over the address lists (AVX2 gather when
+   available), instead of a tree walk with name matching.
+
+   The index is rebuilt when the tree signature (node count, node and class
+   addresses) changes. The signature is verified at most once per
+   UCX_AGGREGATE_INDEX_VERIFY_PERIOD_NSEC, so the per-sample cost is the
+   linear sum; an object created since the last verification is summed after
+   the next one.
+
+   The live UCX statistics tree is walked without the UCX stats lock, so the
+   index is only used when the destroyed nodes are kept until the UCX cleanup
+   (ucx_stats_tree_nodes_persistent()): a cached counter address of a
+   destroyed object stays readable until the next verification drops it.
+   The verification, the rebuild and the sums are serialized by the index lock.
+*/
+class ucx_aggregate_index {
+public:
+   ucx_aggregate_index();
+
+   /* Can the index be used with this UCX configuration? */
+   static int
+   is_supported();
+
+   /*
+      Refresh the aggregate-sum counters (ucs_stats_aggregate() layout).
+
+      returns: The number of aggregate-sum counters.
+   */
+   size_t
+   refresh(uint64_t *counters, size_t size);
+
+private:
+   /* Aggregate index of each counter of a stats class (-1: not aggregated) */
+   typedef std::vector<int32_t> class_mapping_t;
+
+   /* Tree signature: node count, XOR of the node and class addresses */
+   typedef struct tree_signature {
+       uint64_t num_nodes;
+       uint64_t nodes_xor;
+   } tree_signature_t;
+
+   void
+   signature_get(const ucs_stats_node_t *node, tree_signature_t *signature);
+
+   /* Match the counter names of a class to the aggregate-sum names (cached) */
+   const class_mapping_t&
+   class_mapping_get(const ucs_stats_class_t *cls);
+
+   /* Record the aggregated counter addresses of a subtree */
+   void
+   nodes_index(const ucs_stats_node_t *node, std::vector<std::vector<const uint64_t *> > *addresses);
+
+   void
+   index_build(const ucs_stats_node_t *root);
+
+   /* Sum of the counters of an address range */
+   static uint64_t
+   range_sum(const uint64_t * const *addresses, uint32_t count);
+
+#if defined(__x86_64__)
+   static uint64_t
+   range_sum_avx2(const uint64_t * const *addresses, uint32_t count);
+#endif
+
+   /* Aggregate-sum counter names ("<class>_<counter>" -> index) */
+   const ucs_stats_aggrgt_counter_name_t *m_names;
+   size_t m_names_size;
+
+   std::unordered_map<const ucs_stats_class_t *, class_mapping_t> m_class_mappings;
+
+   /* Index: counter addresses grouped by aggregate index, [first, first + count) */
+   std::vector<const uint64_t *> m_addresses;
+   std::vector<uint32_t> m_first;
+   std::vector<uint32_t> m_count;
+
+   /* Index lock: serializes the verification, the rebuild and the sums */
+   std::mutex m_lock;
+
+   tree_signature_t m_signature;
+   uint64_t m_verify_nsec;
+
+   /* Selected sum kernel */
+   uint64_t (*m_range_sum)(const uint64_t * const *addresses, uint32_t count);
+
+   /* Statistics */
+   uint64_t m_rebuilds;
+};
+
+#endif /* _UCX_AGGREGATE_INDEX_H_ */
@@ -0,0 +1,345 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <utils.h>
+
+#include "ucx_api.h"
+
+/* Phase table entry states */
+#define UCX_API_PHASE_FREE      0
+#define UCX_API_PHASE_INIT      1
+#define UCX_API_PHASE_READY     2
+
+typedef struct ucx_api_phase {
+    std::atomic<uint32_t> state;
+    char name[SCOREP_UCX_PHASE_NAME_MAX];
+    std::atomic<uint64_t> num_calls;
+} ucx_api_phase_t;
+
+/* Per thread phases stack: phase index and the begin snapshot of each level */
+typedef struct ucx_api_thread_state {
+    uint32_t depth;
+    int phases[SCOREP_UCX_PHASE_DEPTH_MAX];
+    std::vector<uint64_t> start_values;
+
+    /* Last looked up phase (names are usually string literals) */
+    const char *last_name;
+    int last_phase;
+} ucx_api_thread_state_t;
+
+static std::atomic<ucx_sampling *> ucx_api_sampling;
+static std::atomic<ucx_sampling_worker *> ucx_api_worker;
+static uint32_t ucx_api_num_counters;
+
+/* Phases table and the accumulated deltas [phase][counter] (fixed, allocated at attach) */
+static ucx_api_phase_t ucx_api_phases[SCOREP_UCX_PHASES_MAX];
+static std::unique_ptr<std::atomic<uint64_t>[]> ucx_api_deltas;
+
+static thread_local ucx_api_thread_state_t ucx_api_thread_state;
+
+void
+ucx_api_attach(ucx_sampling *sampling)
+{
+    size_t num_deltas;
+    size_t i;
+
+    ucx_api_num_counters = (uint32_t)sampling->counters_num_get();
+
+    num_deltas = (size_t)SCOREP_UCX_PHASES_MAX * ucx_api_num_counters;
+    ucx_api_deltas.reset(new std::atomic<uint64_t>[num_deltas]);
+    for (i = 0; i < num_deltas; i++) {
+        ucx_api_deltas[i] = 0;
+    }
+
+    for (i = 0; i < SCOREP_UCX_PHASES_MAX; i++) {
+        ucx_api_phases[i].state = UCX_API_PHASE_FREE;
+        ucx_api_phases[i].num_calls = 0;
+    }
+
+    ucx_api_sampling = sampling;
+}
+
+void
+ucx_api_worker_attach(ucx_sampling_worker *worker)
+{
+    ucx_api_worker = worker;
+}
+
+void
+ucx_api_detach(int rank)
+{
+    ucx_sampling *sampling = ucx_api_sampling.exchange(NULL);
+    char filename[256];
+    FILE *file = NULL;
+    uint32_t i;
+    uint32_t k;
+
+    ucx_api_worker = NULL;
+
+    if (sampling == NULL) {
+        return;
+    }
+
+    for (i = 0; i < SCOREP_UCX_PHASES_MAX; i++) {
+        if (ucx_api_phases[i].state != UCX_API_PHASE_READY) {
+            continue;
+        }
+
+        if (file == NULL) {
+            snprintf(filename, sizeof(filename), UCX_API_PHASES_FILENAME_FORMAT, rank);
+            file = fopen(filename, "w");
+            if (file == NULL) {
+                printf("Warning: could not write the phases report %s\n", filename);
+                return;
+            }
+        }
+
+        /* Phase line, then one line per counter that moved */
+        fprintf(file, "phase %s calls=%lu\n", ucx_api_phases[i].name, ucx_api_phases[i].num_calls.load());
+        for (k = 0; k < ucx_api_num_counters; k++) {
+            uint64_t delta = ucx_api_deltas[((size_t)i * ucx_api_num_counters) + k];
+            std::string counter_name;
+
+            if (delta != 0) {
+                sampling->counter_name_get(k, &counter_name);
+                fprintf(file, "  %s %lu\n", counter_name.c_str(), delta);
+            }
+        }
+    }
+
+    if (file != NULL) {
+        fclose(file);
+    }
+}
+
+/* Find (or add) a phase by name */
+static int
+ucx_api_phase_find(const char *name, int add)
+{
+    ucx_api_thread_state_t *state = &ucx_api_thread_state;
+    uint32_t expected;
+    int i;
+
+    if (likely(name == state->last_name) &&
+        likely(strncmp(ucx_api_phases[state->last_phase].name, name, SCOREP_UCX_PHASE_NAME_MAX - 1) == 0)) {
+        return state->last_phase;
+    }
+
+    for (i = 0; i < SCOREP_UCX_PHASES_MAX; i++) {
+        uint32_t phase_state = ucx_api_phases[i].state.load(std::memory_order_acquire);
+
+        if (phase_state == UCX_API_PHASE_FREE) {
+            if (!add) {
+                return -1;
+            }
+
+            /* Claim the entry, the name is published by the READY state */
+            expected = UCX_API_PHASE_FREE;
+            if (ucx_api_phases[i].state.compare_exchange_strong(expected, UCX_API_PHASE_INIT)) {
+                snprintf(ucx_api_phases[i].name, sizeof(ucx_api_phases[i].name), "%s", name);
+                ucx_api_phases[i].state.store(UCX_API_PHASE_READY, std::memory_order_release);
+                break;
+            }
+            phase_state = expected;
+        }
+
+        /* Another thread is adding this entry */
+        while (phase_state == UCX_API_PHASE_INIT) {
+            phase_state = ucx_api_phases[i].state.load(std::memory_order_acquire);
+        }
+
+        if (strncmp(ucx_api_phases[i].name, name, SCOREP_UCX_PHASE_NAME_MAX - 1) == 0) {
+            break;
+        }
+    }
+
+    if (i == SCOREP_UCX_PHASES_MAX) {
+        return -1;
+    }
+
+    state->last_name = name;
+    state->last_phase = i;
+
+    return i;
+}
+
+extern "C" int
+scorep_ucx_counters_num_get(void)
+{
+    return (ucx_api_sampling.load() != NULL) ? (int)ucx_api_num_counters : -1;
+}
+
+extern "C" int
+scorep_ucx_counter_id_get(const char *counter_name)
+{
+    ucx_sampling *sampling = ucx_api_sampling.load();
+    uint32_t i;
+
+    if (sampling == NULL) {
+        return -1;
+    }
+
+    for (i = 0; i < ucx_api_num_counters; i++) {
+        std::string name;
+
+        sampling->counter_name_get(i, &name);
+        if (name == counter_name) {
+            return (int)i;
+        }
+    }
+
+    return -1;
+}
+
+extern "C" int
+scorep_ucx_read(const uint32_t *counter_ids, uint64_t *values, size_t count)
+{
+    ucx_sampling *sampling = ucx_api_sampling.load(std::memory_order_acquire);
+    size_t i;
+
+    if (unlikely(sampling == NULL)) {
+        return -1;
+    }
+
+    for (i = 0; i < count; i++) {
+        values[i] = likely(counter_ids[i] < ucx_api_num_counters) ?
+                        sampling->counter_snapshot_get(counter_ids[i]) : 0;
+    }
+
+    return 0;
+}
+
+extern "C" int
+scorep_ucx_snapshot_refresh(void)
+{
+    ucx_sampling *sampling = ucx_api_sampling.load(std::memory_order_acquire);
+
+    if (sampling == NULL) {
+        return -1;
+    }
+
+    /*
+       Never wait: neither for the statistics of another process (legacy),
+       nor for a concurrent refresh (its snapshot is as recent).
+    */
+    sampling->backends_refresh_try();
+
+    return 0;
+}
+
+extern "C" int
+scorep_ucx_worker_bind(const void *ucp_worker)
+{
+    ucx_sampling_worker *worker = ucx_api_worker.load(std::memory_order_acquire);
+
+    if (worker == NULL) {
+        return -1;
+    }
+
+    worker->thread_bind(ucp_worker);
+
+    return 0;
+}
+
+extern "C" int
+scorep_ucx_phase_begin(const char *name)
+{
+    ucx_sampling *sampling = ucx_api_sampling.load(std::memory_order_acquire);
+    ucx_api_thread_state_t *state = &ucx_api_thread_state;
+    uint64_t *start_values;
+    int phase;
+
+    if (unlikely(sampling == NULL) || unlikely(state->depth == SCOREP_UCX_PHASE_DEPTH_MAX)) {
+        return -1;
+    }
+
+    phase = ucx_api_phase_find(name, 1);
+    if (unlikely(phase < 0)) {
+        return -1;
+    }
+
+    if (unlikely(state->start_values.empty())) {
+        state->start_values.resize((size_t)SCOREP_UCX_PHASE_DEPTH_MAX * ucx_api_num_counters);
+    }
+
+    start_values = &state->start_values[(size_t)state->depth * ucx_api_num_counters];
+    sampling->snapshot_copy(0, ucx_api_num_counters, start_values);
+
+    state->phases[state->depth++] = phase;
+
+    return 0;
+}
+
+extern "C" int
+scorep_ucx_phase_end(const char *name)
+{
+    ucx_sampling *sampling = ucx_api_sampling.load(std::memory_order_acquire);
+    ucx_api_thread_state_t *state = &ucx_api_thread_state;
+    std::atomic<uint64_t> *deltas;
+    uint64_t *start_values;
+    uint32_t k;
+    int phase;
+
+    if (unlikely(sampling == NULL) || unlikely(state->depth == 0)) {
+        return -1;
+    }
+
+    /* Phases end in the reverse order of their begin */
+    phase = ucx_api_phase_find(name, 0);
+    if (unlikely(phase != state->phases[state->depth - 1])) {
+        return -1;
+    }
+
+    state->depth--;
+    start_values = &state->start_values[(size_t)state->depth * ucx_api_num_counters];
+    deltas = &ucx_api_deltas[(size_t)phase * ucx_api_num_counters];
+    for (k = 0; k < ucx_api_num_counters; k++) {
+        uint64_t value = sampling->counter_snapshot_get(k);
+
+        if (value > start_values[k]) {
+            deltas[k].fetch_add(value - start_values[k], std::memory_order_relaxed);
+        }
+    }
+    ucx_api_phases[phase].num_calls.fetch_add(1, std::memory_order_relaxed);
+
+    return 0;
+}
+
+extern "C" int
+scorep_ucx_phase_get(const char *name, uint64_t *deltas, size_t count, uint64_t *num_calls)
+{
+    size_t i;
+    int phase;
+
+    if (ucx_api_sampling.load() == NULL) {
+        return -1;
+    }
+
+    phase = ucx_api_phase_find(name, 0);
+    if (phase < 0) {
+        return -1;
+    }
+
+    count = std::min(count, (size_t)ucx_api_num_counters);
+    for (i = 0; i < count; i++) {
+        deltas[i] = ucx_api_deltas[((size_t)phase * ucx_api_num_counters) + i];
+    }
+
+    if (num_calls != NULL) {
+        *num_calls = ucx_api_phases[phase].num_calls;
+    }
+
+    return 0;
+}
@@ -0,0 +1,32 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+#if !defined(_UCX_API_H_)
+#define _UCX_API_H_
+
+#include <scorep_ucx.h>
+
+#include <ucx_sampling.h>
+#include <ucx_sampling_worker.h>
+
+/* Phases report file, written at detach (per rank) */
+#define UCX_API_PHASES_FILENAME_FORMAT  "ucx_phases.%d.txt"
+
+/* Plugin side of the application API (include/scorep_ucx.h) */
+
+/* Attach the API to the plugin counters (after the metrics are defined) */
+void
+ucx_api_attach(ucx_sampling *sampling);
+
+/* Attach the worker binding to the per UCP worker counters */
+void
+ucx_api_worker_attach(ucx_sampling_worker *worker);
+
+/* Detach the API, write the phases report (if any phase was used) */
+void
+ucx_api_detach(int rank);
+
+#endif /* _UCX_API_H_ */
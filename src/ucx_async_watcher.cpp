@@ -0,0 +1,219 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fnmatch.h>
+#include <chrono>
+
+#include <utils.h>
+
+#include "ucx_async_watcher.h"
+
+ucx_async_watcher::ucx_async_watcher(ucx_sampling *sampling, ucx_async_watcher_clock_t clock)
+{
+    m_sampling = sampling;
+    m_clock = clock;
+    m_running = 0;
+}
+
+ucx_async_watcher::~ucx_async_watcher()
+{
+    stop();
+
+    for (auto& counter : m_counters) {
+        if (counter->dropped) {
+            printf("Warning: UCX async counter %u: %lu threshold crossings dropped (buffer full)\n",
+                counter->id, (unsigned long)counter->dropped);
+        }
+        free(counter->records);
+    }
+}
+
+size_t
+ucx_async_watcher::thresholds_parse(const char *thresholds)
+{
+    m_thresholds.clear();
+
+    if (thresholds == NULL) {
+        return 0;
+    }
+
+    for (auto& threshold : split(thresholds, ',')) {
+        size_t pos = threshold.rfind('=');
+
+        if ((pos == std::string::npos) || (pos == 0)) {
+            printf("Warning: invalid UCX async threshold: %s\n", threshold.c_str());
+            continue;
+        }
+
+        m_thresholds.push_back(std::make_pair(threshold.substr(0, pos),
+            strtoull(threshold.c_str() + pos + 1, NULL, 0)));
+    }
+
+    return m_thresholds.size();
+}
+
+int
+ucx_async_watcher::counter_watch(uint32_t id, const std::string& name, int is_monotonic)
+{
+    watched_counter_t *counter;
+
+    if (m_counter_index.size() <= id) {
+        m_counter_index.resize(id + 1, -1);
+    }
+
+    for (auto& threshold : m_thresholds) {
+        if (fnmatch(threshold.first.c_str(), name.c_str(), 0) != 0) {
+            continue;
+        }
+
+        counter = new watched_counter_t();
+        counter->id = id;
+        counter->threshold = std::max(threshold.second, (uint64_t)1);
+        counter->is_monotonic = is_monotonic;
+        counter->last_value = 0;
+        counter->head = 0;
+        counter->tail = 0;
+        counter->dropped = 0;
+        counter->records = (SCOREP_MetricTimeValuePair *)malloc(UCX_ASYNC_WATCHER_RECORDS_MAX *
+                               sizeof(SCOREP_MetricTimeValuePair));
+        if (counter->records == NULL) {
+            printf("Warning: could not allocate the UCX async records buffer of %s\n", name.c_str());
+            delete counter;
+            return 0;
+        }
+
+        m_counter_index[id] = (int32_t)m_counters.size();
+        m_counters.emplace_back(counter);
+
+        DEBUG_PRINT("UCX async counter %s: threshold=%lu\n", name.c_str(), counter->threshold);
+
+        return 1;
+    }
+
+    return 0;
+}
+
+void
+ucx_async_watcher::start(uint64_t period_usec)
+{
+    int expected = 0;
+
+    if (m_counters.empty() || !m_running.compare_exchange_strong(expected, 1)) {
+        return;
+    }
+
+    /* Baseline: the first records are relative to the start */
+    m_sampling->backends_refresh(0);
+    for (auto& counter : m_counters) {
+        counter->last_value = m_sampling->counter_snapshot_get(counter->id);
+    }
+
+    m_thread = std::thread(&ucx_async_watcher::run, this, period_usec);
+}
+
+void
+ucx_async_watcher::stop()
+{
+    if (!m_thread.joinable()) {
+        return;
+    }
+
+    m_running = 0;
+    m_thread.join();
+
+    /* Record the remaining changes */
+    counters_check(1);
+}
+
+void
+ucx_async_watcher::run(uint64_t period_usec)
+{
+    while (m_running.load(std::memory_order_relaxed)) {
+        counters_check(0);
+        std::this_thread::sleep_for(std::chrono::microseconds(period_usec));
+    }
+}
+
+void
+ucx_async_watcher::counters_check(int record_all)
+{
+    uint64_t timestamp = 0;
+
+    /* Not the legacy backend: the watcher period is shorter than a statistics dump round-trip */
+    m_sampling->backends_refresh(0);
+
+    for (auto& counter : m_counters) {
+        uint64_t value = m_sampling->counter_snapshot_get(counter->id);
+        uint64_t change;
+        uint64_t head;
+
+        change = (value >= counter->last_value) ? (value - counter->last_value) :
+                     (counter->last_value - value);
+        if ((change < counter->threshold) && !(record_all && change)) {
+            continue;
+        }
+
+        head = counter->head.load(std::memory_order_relaxed);
+        if (unlikely((head - counter->tail.load(std::memory_order_acquire)) >=
+                     UCX_ASYNC_WATCHER_RECORDS_MAX)) {
+            /* Keep the last value: the change is recorded by a later crossing */
+            counter->dropped++;
+            continue;
+        }
+
+        if (timestamp == 0) {
+            timestamp = m_clock();
+        }
+
+        counter->records[head & (UCX_ASYNC_WATCHER_RECORDS_MAX - 1)].timestamp = timestamp;
+        counter->records[head & (UCX_ASYNC_WATCHER_RECORDS_MAX - 1)].value =
+            !counter->is_monotonic ? value :
+            (value >= counter->last_value) ? (value - counter->last_value) : 0;
+        counter->head.store(head + 1, std::memory_order_release);
+
+        counter->last_value = value;
+    }
+}
+
+uint64_t
+ucx_async_watcher::records_get(uint32_t id, SCOREP_MetricTimeValuePair **records)
+{
+    watched_counter_t *counter;
+    uint64_t head;
+    uint64_t tail;
+    uint64_t num_records;
+    uint64_t i;
+
+    *records = NULL;
+
+    if ((id >= m_counter_index.size()) || (m_counter_index[id] < 0)) {
+        return 0;
+    }
+
+    counter = m_counters[m_counter_index[id]].get();
+    tail = counter->tail.load(std::memory_order_relaxed);
+    head = counter->head.load(std::memory_order_acquire);
+    num_records = head - tail;
+    if (num_records == 0) {
+        return 0;
+    }
+
+    *records = (SCOREP_MetricTimeValuePair *)malloc(num_records * sizeof(SCOREP_MetricTimeValuePair));
+    if (*records == NULL) {
+        return 0;
+    }
+
+    for (i = 0; i < num_records; i++) {
+        (*records)[i] = counter->records[(tail + i) & (UCX_ASYNC_WATCHER_RECORDS_MAX - 1)];
+    }
+
+    counter->tail.store(head, std::memory_order_release);
+
+    return num_records;
+}
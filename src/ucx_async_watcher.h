@@ -0,0 +1,120 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+#if !defined(_UCX_ASYNC_WATCHER_H_)
+#define _UCX_ASYNC_WATCHER_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <scorep/SCOREP_MetricTypes.h>
+
+#include <ucx_sampling.h>
+
+/* Default watcher sampling period (micro seconds) */
+#define UCX_ASYNC_WATCHER_PERIOD_USEC_DEFAULT   100
+
+/* Threshold-crossing records buffer size, per watched counter (must be a power of 2) */
+#define UCX_ASYNC_WATCHER_RECORDS_MAX           (64 * 1024)
+
+/* Watcher timestamp function (Score-P measurement clock) */
+typedef uint64_t (*ucx_async_watcher_clock_t)(void);
+
+/*
+   Threshold-triggered asynchronous event counters.
+
+   A watcher thread samples the selected counters periodically and records a
+   timestamped value only when the change since the last record crosses the
+   counter threshold. The records are written to a preallocated buffer per
+   counter (single producer: watcher, single consumer: Score-P get_all_values).
+*/
+class ucx_async_watcher {
+public:
+   ucx_async_watcher(ucx_sampling *sampling, ucx_async_watcher_clock_t clock);
+
+   ~ucx_async_watcher();
+
+   /*
+      Parse the thresholds: a comma separated list of <pattern>=<threshold>,
+      e.g. "*tx_am*bytes=1048576,*bytes=65536". The first matching pattern is used.
+
+      returns: The number of thresholds.
+   */
+   size_t
+   thresholds_parse(const char *thresholds);
+
+   /*
+      Watch a counter if its name matches a threshold pattern.
+
+      returns: 1 if the counter is watched, 0 otherwise.
+   */
+   int
+   counter_watch(uint32_t id, const std::string& name, int is_monotonic);
+
+   /* Start the watcher thread (idempotent) */
+   void
+   start(uint64_t period_usec);
+
+   /* Stop the watcher thread and record the last values */
+   void
+   stop();
+
+   /*
+      Drain the records of a counter.
+
+      records - allocated with malloc(), released by Score-P.
+
+      returns: The number of records.
+   */
+   uint64_t
+   records_get(uint32_t id, SCOREP_MetricTimeValuePair **records);
+
+private:
+   typedef struct watched_counter {
+       uint32_t id;
+       uint64_t threshold;
+       int is_monotonic;
+
+       /* Last recorded value */
+       uint64_t last_value;
+
+       /* Records buffer */
+       SCOREP_MetricTimeValuePair *records;
+       std::atomic<uint64_t> head;
+       std::atomic<uint64_t> tail;
+
+       /* Threshold crossings dropped (records buffer full) */
+       uint64_t dropped;
+   } watched_counter_t;
+
+   void
+   run(uint64_t period_usec);
+
+   /* Sample all watched counters, record the threshold crossings */
+   void
+   counters_check(int record_all);
+
+   ucx_sampling *m_sampling;
+   ucx_async_watcher_clock_t m_clock;
+
+   /* <pattern, threshold> */
+   std::vector<std::pair<std::string, uint64_t> > m_thresholds;
+
+   std::vector<std::unique_ptr<watched_counter_t> > m_counters;
+
+   /* Score-P counter ID -> watched counter index (-1: not watched) */
+   std::vector<int32_t> m_counter_index;
+
+   std::thread m_thread;
+   std::atomic<int> m_running;
+};
+
+#endif /* _UCX_ASYNC_WATCHER_H_ */
@@ -0,0 +1,128 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+/*
+   Standalone UCX counters collector (LD_PRELOAD), for UCX applications that do
+   not run under Score-P:
+
+   LD_PRELOAD=libscorep_plugin_ucx_collector.so <application>
+
+   A startup thread waits for UCX to come up (the aggregate-sum counter names),
+   then composes the same sampling backends as the plugin and starts the sidecar
+   writer: the counters are sampled at a fixed rate into the columnar sidecar file
+   (<dir>/ucx_counters.<job_id>.<rank or pid>.ucxc, see the ucx_merge tool).
+   Processes forked without exec are not collected.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <utils.h>
+#include <scorep_plugin_ucx_config.h>
+
+#include "ucx_sampling.h"
+#include "ucx_sidecar_writer.h"
+
+/* Default collector sampling period (micro seconds): well below 1% CPU */
+#define UCX_COLLECTOR_PERIOD_USEC_DEFAULT   10000
+
+/* UCX startup poll period (milli seconds) */
+#define UCX_COLLECTOR_START_POLL_MSEC       100
+
+static ucx_sampling *ucx_collector_sampling;
+static ucx_sidecar_writer *ucx_collector_writer;
+/* Heap allocated: the static destructors run before the library destructor */
+static std::thread *ucx_collector_start_thread;
+static std::atomic<int> ucx_collector_running;
+
+static int
+ucx_collector_env_get(const char *name, int default_value)
+{
+    const char *value = getenv(name);
+
+    return (value != NULL) ? atoi(value) : default_value;
+}
+
+static void
+ucx_collector_start()
+{
+    const ucs_stats_aggrgt_counter_name_t *counter_names;
+    uint64_t period_usec = UCX_COLLECTOR_PERIOD_USEC_DEFAULT;
+    const char *period = getenv(ENV_SCOREP_UCX_PLUGIN_COLLECTOR_PERIOD_USEC);
+    int rank = mpi_rank_env_get();
+    size_t size = 0;
+
+    if (period != NULL) {
+        period_usec = std::max(strtoull(period, NULL, 0), 1ULL);
+    }
+
+    /* UCX is up once the aggregate-sum counters are registered */
+    while (ucx_collector_running &&
+           (ucx_collector_sampling->backend_enabled(UCX_SAMPLING_BACKEND_AGGREGATE)) &&
+           !ucx_collector_sampling->ucx_statistics_aggregate_counter_names_get(&counter_names, &size)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(UCX_COLLECTOR_START_POLL_MSEC));
+    }
+
+    if (!ucx_collector_running || (ucx_collector_sampling->backends_init() == 0)) {
+        return;
+    }
+
+    /* Not an MPI process: the process ID */
+    ucx_collector_writer->start(ucx_collector_sampling, (rank >= 0) ? rank : (int)getpid(),
+        getenv(ENV_SCOREP_UCX_PLUGIN_SIDECAR_DIR), period_usec);
+}
+
+/* Forked child (without exec): the collector threads do not exist there, not collected */
+static void
+ucx_collector_atfork_child()
+{
+    ucx_collector_start_thread = NULL;
+    ucx_collector_writer = NULL;
+    ucx_collector_sampling = NULL;
+}
+
+__attribute__((constructor)) static void
+ucx_collector_init()
+{
+    pthread_atfork(NULL, NULL, ucx_collector_atfork_child);
+
+    ucx_collector_sampling = new ucx_sampling();
+    ucx_collector_sampling->verbose_set(0);
+    ucx_collector_writer = new ucx_sidecar_writer();
+
+    ucx_collector_sampling->configuration_set(
+        ucx_collector_env_get(ENV_SCOREP_UCX_PLUGIN_UCX_COUNTERS_COLLECTION_ENABLE, 1),
+        ucx_collector_env_get(ENV_SCOREP_UCX_PLUGIN_NIC_COUNTERS_COLLECTION_ENABLE, 0));
+
+    ucx_collector_running = 1;
+    ucx_collector_start_thread = new std::thread(ucx_collector_start);
+}
+
+__attribute__((destructor)) static void
+ucx_collector_fini()
+{
+    if (ucx_collector_sampling == NULL) {
+        return;
+    }
+
+    ucx_collector_running = 0;
+    ucx_collector_start_thread->join();
+    delete ucx_collector_start_thread;
+
+    ucx_collector_writer->stop();
+    fprintf(stderr, "UCX collector: %lu samples, %.3f%% CPU\n", ucx_collector_writer->samples_total_get(),
+        ucx_collector_writer->cpu_fraction_get() * 100.0);
+
+    delete ucx_collector_writer;
+    delete ucx_collector_sampling;
+    ucx_collector_writer = NULL;
+    ucx_collector_sampling = NULL;
+}
@@ -0,0 +1,51 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+#include <stdio.h>
+#include <x86intrin.h>
+
+#include "ucx_governor.h"
+
+ucx_governor::ucx_governor()
+{
+    m_fraction = 0;
+    m_credit_max = 0;
+}
+
+void
+ucx_governor::budget_set(double fraction)
+{
+    m_fraction = fraction;
+    m_credit_max = fraction * UCX_GOVERNOR_CREDIT_WINDOW_TSC;
+}
+
+void
+ucx_governor::location_init(location_t *location)
+{
+    /* Start with a full credit */
+    location->credit = m_credit_max;
+    location->last_tsc = __rdtsc();
+}
+
+void
+ucx_governor::report(int rank, const std::vector<const location_t *>& locations)
+{
+    uint64_t events = 0;
+    uint64_t throttled_events = 0;
+
+    for (auto location : locations) {
+        events += location->events;
+        throttled_events += location->throttled_events;
+    }
+
+    if (events == 0) {
+        return;
+    }
+
+    printf("UCX plugin governor: rank=%d budget=%.3f%% events=%lu throttled=%lu (%.2f%%)\n",
+        rank, 100.0 * m_fraction, (unsigned long)events, (unsigned long)throttled_events,
+        100.0 * throttled_events / events);
+}
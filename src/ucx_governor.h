@@ -0,0 +1,81 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+#if !defined(_UCX_GOVERNOR_H_)
+#define _UCX_GOVERNOR_H_
+
+#include <stdint.h>
+#include <vector>
+
+/* Largest credit (burst) of a location: the budget of this many TSC ticks */
+#define UCX_GOVERNOR_CREDIT_WINDOW_TSC      (1ULL << 24)
+
+/*
+   Overhead governor: keeps the plugin cycles of each location under a
+   fraction of its elapsed cycles (TSC ticks).
+
+   A location earns credit at the budget fraction of the elapsed cycles
+   (up to a window), and is charged the cycles of its counter reads. An event
+   without credit is throttled: the counters are served from the last
+   snapshot, without refreshing the backends, until the credit recovers.
+*/
+class ucx_governor {
+public:
+   /* Per location credit (see ucx_location_t) */
+   typedef struct location {
+       double credit;
+       uint64_t last_tsc;
+       uint64_t events;
+       uint64_t throttled_events;
+       int throttled;
+   } location_t;
+
+   ucx_governor();
+
+   /* Set the budget: plugin cycles / elapsed cycles (e.g. 0.005) */
+   void
+   budget_set(double fraction);
+
+   /* Initialize the credit of a new location */
+   void
+   location_init(location_t *location);
+
+   /* Start of an event of a location: throttle it? */
+   inline int
+   event_throttle(location_t *location, uint64_t now_tsc);
+
+   /* Charge the cycles of a counter read */
+   static inline void
+   charge(location_t *location, uint64_t cycles) {
+       location->credit -= (double)cycles;
+   }
+
+   /* Print the throttled events of the locations of this process */
+   void
+   report(int rank, const std::vector<const location_t *>& locations);
+
+private:
+   double m_fraction;
+   double m_credit_max;
+};
+
+inline int
+ucx_governor::event_throttle(location_t *location, uint64_t now_tsc)
+{
+    location->credit += (double)(now_tsc - location->last_tsc) * m_fraction;
+    if (location->credit > m_credit_max) {
+        location->credit = m_credit_max;
+    }
+    location->last_tsc = now_tsc;
+
+    location->throttled = (location->credit < 0);
+    location->events++;
+    location->throttled_events += location->throttled;
+
+    return location->throttled;
+}
+
+#endif /* _UCX_GOVERNOR_H_ */
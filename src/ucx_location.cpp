@@ -0,0 +1,17 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+#include "ucx_location.h"
+
+ucx_location_t *
+ucx_location_registry::location_register()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    ucx_location_t *location = new ucx_location_t();
+
+    m_locations.emplace_back(location);
+    return location;
+}
@@ -0,0 +1,52 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+#if !defined(_UCX_LOCATION_H_)
+#define _UCX_LOCATION_H_
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "ucx_trace_budget.h"
+#include "ucx_overhead.h"
+#include "ucx_governor.h"
+
+/* Per location (thread) state: trace volume counts, overhead histogram, governor credit */
+typedef struct ucx_location {
+    ucx_trace_budget::location_t trace;
+    ucx_overhead::location_t overhead;
+    ucx_governor::location_t governor;
+} ucx_location_t;
+
+/*
+   Locations registry. A thread registers its location once, the state is
+   owned by the registry and outlives the thread, for the reports at finalize.
+*/
+class ucx_location_registry {
+public:
+   /* Register the calling thread (location) */
+   ucx_location_t *
+   location_register();
+
+   /* The member state (e.g. &ucx_location_t::overhead) of all the registered locations */
+   template <typename T>
+   void
+   locations_get(T ucx_location_t::*member, std::vector<const T *> *locations) {
+       std::lock_guard<std::mutex> lock(m_lock);
+
+       locations->clear();
+       for (auto& location : m_locations) {
+           locations->push_back(&((*location).*member));
+       }
+   }
+
+private:
+   std::mutex m_lock;
+   std::vector<std::unique_ptr<ucx_location_t> > m_locations;
+};
+
+#endif /* _UCX_LOCATION_H_ */
@@ -0,0 +1,381 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+/*
+   Per MPI call site UCX traffic attribution.
+
+   PMPI wrappers of the point-to-point and collective MPI calls, to be loaded
+   with LD_PRELOAD. Each wrapper snapshots the UCX aggregate-sum counters on
+   exit (one ucs_stats_aggregate() walk per call), and adds the difference to
+   the previous exit snapshot of the calling thread to a fixed call site table
+   keyed by the return address. The UCX traffic between two MPI calls of a
+   thread (other threads, UCX asynchronous progress) is attributed to its
+   next call. The next MPI implementation (e.g. the Score-P MPI adapter, or
+   the MPI library itself) is resolved with RTLD_NEXT, so the wrappers may be
+   combined with other PMPI tools.
+
+   Note, that a preloaded library does not interpose the symbols of the
+   executable itself: the wrappers are bypassed when the Score-P MPI adapter
+   is linked statically into the application (link it as a shared library,
+   scorep --dynamic).
+
+   The table is written at MPI_Finalize to ucx_mpi_callsites.<rank>.txt
+*/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dlfcn.h>
+#include <atomic>
+#include <algorithm>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <mpi.h>
+#ifdef __cplusplus
+}
+#endif
+
+#include <utils.h>
+
+#include "ucx_sampling_backend.h"
+
+/* Number of call sites (must be a power of 2) */
+#define UCX_MPI_ATTR_SITES_NUM        1024
+
+#define UCX_MPI_ATTR_FILENAME_FORMAT  "ucx_mpi_callsites.%d.txt"
+
+/* UCX aggregate-sum counters snapshot */
+typedef struct ucx_mpi_attr_snapshot {
+    size_t size;
+    ucs_stats_counter_t counters[UCX_AGGREGATE_SUM_NUM_COUNTERS_MAX];
+} ucx_mpi_attr_snapshot_t;
+
+/* Call site entry */
+typedef struct ucx_mpi_attr_site {
+    /* Return address of the MPI call, 0 - free entry */
+    std::atomic<uintptr_t> site;
+
+    /* MPI function name */
+    const char *func_name;
+
+    /* Number of calls */
+    std::atomic<uint64_t> calls;
+
+    /* UCX aggregate-sum counters deltas */
+    std::atomic<uint64_t> counters[UCX_AGGREGATE_SUM_NUM_COUNTERS_MAX];
+} ucx_mpi_attr_site_t;
+
+/* Call sites table (statically allocated, nothing is allocated by the wrappers) */
+static ucx_mpi_attr_site_t ucx_mpi_attr_sites[UCX_MPI_ATTR_SITES_NUM];
+
+/* Calls not attributed since the call sites table is full */
+static std::atomic<uint64_t> ucx_mpi_attr_sites_overflow;
+
+/* Last exit snapshot of the calling thread (the entry snapshot of its next call) */
+static thread_local ucx_mpi_attr_snapshot_t ucx_mpi_attr_last_snapshot;
+
+static void *
+ucx_mpi_attr_next_resolve(const char *func_name, void *pmpi_func)
+{
+    void *next_func = dlsym(RTLD_NEXT, func_name);
+
+    return (next_func != NULL) ? next_func : pmpi_func;
+}
+
+static inline void
+ucx_mpi_attr_snapshot(ucx_mpi_attr_snapshot_t *snapshot)
+{
+    snapshot->size = ucs_stats_aggregate(snapshot->counters, ARRAY_SIZE(snapshot->counters));
+}
+
+static inline ucx_mpi_attr_site_t *
+ucx_mpi_attr_site_get(uintptr_t site, const char *func_name)
+{
+    uint32_t hash = (uint32_t)((site >> 2) * 0x9E3779B1u);
+    uint32_t i;
+
+    for (i = 0; i < UCX_MPI_ATTR_SITES_NUM; i++) {
+        ucx_mpi_attr_site_t *entry = &ucx_mpi_attr_sites[(hash + i) & (UCX_MPI_ATTR_SITES_NUM - 1)];
+        uintptr_t entry_site = entry->site.load(std::memory_order_acquire);
+
+        if (likely(entry_site == site)) {
+            return entry;
+        }
+
+        if (entry_site == 0) {
+            /* Claim a free entry */
+            if (entry->site.compare_exchange_strong(entry_site, site)) {
+                entry->func_name = func_name;
+                return entry;
+            }
+
+            if (entry_site == site) {
+                return entry;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static inline void
+ucx_mpi_attr_update(ucx_mpi_attr_snapshot_t *enter, const char *func_name, void *site)
+{
+    ucx_mpi_attr_snapshot_t exit;
+    ucx_mpi_attr_site_t *entry;
+    size_t size;
+    size_t i;
+
+    ucx_mpi_attr_snapshot(&exit);
+
+    entry = ucx_mpi_attr_site_get((uintptr_t)site, func_name);
+    if (unlikely(entry == NULL)) {
+        ucx_mpi_attr_sites_overflow.fetch_add(1, std::memory_order_relaxed);
+        *enter = exit;
+        return;
+    }
+
+    entry->calls.fetch_add(1, std::memory_order_relaxed);
+
+    size = std::min(enter->size, exit.size);
+    for (i = 0; i < size; i++) {
+        /* Counters of destroyed UCX objects may decrease the aggregate */
+        if (exit.counters[i] > enter->counters[i]) {
+            entry->counters[i].fetch_add(exit.counters[i] - enter->counters[i],
+                std::memory_order_relaxed);
+        }
+    }
+
+    /* The entry snapshot of the next call of this thread */
+    *enter = exit;
+}
+
+static void
+ucx_mpi_attr_dump(void)
+{
+    const ucs_stats_aggrgt_counter_name_t *counter_names = NULL;
+    size_t counter_names_size = 0;
+    char filename[64];
+    FILE *file;
+    int rank = 0;
+    uint32_t i;
+    size_t j;
+
+    PMPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    snprintf(filename, sizeof(filename), UCX_MPI_ATTR_FILENAME_FORMAT, rank);
+
+    file = fopen(filename, "w");
+    if (file == NULL) {
+        printf("Warning: could not open %s\n", filename);
+        return;
+    }
+
+    ucs_stats_aggregate_get_counter_names(&counter_names, &counter_names_size);
+    counter_names_size = std::min(counter_names_size, (size_t)UCX_AGGREGATE_SUM_NUM_COUNTERS_MAX);
+
+    fprintf(file, "# function\tsite\tsymbol\tcalls");
+    for (j = 0; j < counter_names_size; j++) {
+        fprintf(file, "\t%s_%s", counter_names[j].class_name, counter_names[j].counter_name);
+    }
+    fprintf(file, "\n");
+
+    for (i = 0; i < UCX_MPI_ATTR_SITES_NUM; i++) {
+        ucx_mpi_attr_site_t *entry = &ucx_mpi_attr_sites[i];
+        uintptr_t site = entry->site.load();
+        Dl_info info;
+
+        if (site == 0) {
+            continue;
+        }
+
+        fprintf(file, "%s\t%#lx\t", entry->func_name, (unsigned long)site);
+        if ((dladdr((void *)site, &info) != 0) && (info.dli_fname != NULL)) {
+            fprintf(file, "%s(%s+%#lx)", info.dli_fname,
+                (info.dli_sname != NULL) ? info.dli_sname : "",
+                (unsigned long)(site - (uintptr_t)((info.dli_sname != NULL) ?
+                                    info.dli_saddr : info.dli_fbase)));
+        }
+        else {
+            fprintf(file, "?");
+        }
+
+        fprintf(file, "\t%lu", (unsigned long)entry->calls.load());
+        for (j = 0; j < counter_names_size; j++) {
+            fprintf(file, "\t%lu", (unsigned long)entry->counters[j].load());
+        }
+        fprintf(file, "\n");
+    }
+
+    if (ucx_mpi_attr_sites_overflow.load() != 0) {
+        fprintf(file, "# calls not attributed (call sites table full): %lu\n",
+            (unsigned long)ucx_mpi_attr_sites_overflow.load());
+    }
+
+    fclose(file);
+}
+
+/* MPI wrapper: snapshot on exit (on entry too, for the first call of a thread), attribute to the caller return address */
+#define UCX_MPI_ATTR_WRAPPER(_func, _params, _args) \
+    extern "C" int \
+    MPI_##_func _params \
+    { \
+        static decltype(&PMPI_##_func) next_func = NULL; \
+        ucx_mpi_attr_snapshot_t *enter = &ucx_mpi_attr_last_snapshot; \
+        int ret; \
+        \
+        if (unlikely(next_func == NULL)) { \
+            next_func = (decltype(&PMPI_##_func)) \
+                ucx_mpi_attr_next_resolve("MPI_" #_func, (void *)&PMPI_##_func); \
+        } \
+        \
+        if (unlikely(enter->size == 0)) { \
+            ucx_mpi_attr_snapshot(enter); \
+        } \
+        ret = next_func _args; \
+        ucx_mpi_attr_update(enter, "MPI_" #_func, __builtin_return_address(0)); \
+        \
+        return ret; \
+    }
+
+/* Point-to-point */
+UCX_MPI_ATTR_WRAPPER(Send,
+    (const void *buf, int count, MPI_Datatype datatype, int dest, int tag, MPI_Comm comm),
+    (buf, count, datatype, dest, tag, comm))
+
+UCX_MPI_ATTR_WRAPPER(Ssend,
+    (const void *buf, int count, MPI_Datatype datatype, int dest, int tag, MPI_Comm comm),
+    (buf, count, datatype, dest, tag, comm))
+
+UCX_MPI_ATTR_WRAPPER(Isend,
+    (const void *buf, int count, MPI_Datatype datatype, int dest, int tag, MPI_Comm comm,
+     MPI_Request *request),
+    (buf, count, datatype, dest, tag, comm, request))
+
+UCX_MPI_ATTR_WRAPPER(Recv,
+    (void *buf, int count, MPI_Datatype datatype, int source, int tag, MPI_Comm comm,
+     MPI_Status *status),
+    (buf, count, datatype, source, tag, comm, status))
+
+UCX_MPI_ATTR_WRAPPER(Irecv,
+    (void *buf, int count, MPI_Datatype datatype, int source, int tag, MPI_Comm comm,
+     MPI_Request *request),
+    (buf, count, datatype, source, tag, comm, request))
+
+UCX_MPI_ATTR_WRAPPER(Sendrecv,
+    (const void *sendbuf, int sendcount, MPI_Datatype sendtype, int dest, int sendtag,
+     void *recvbuf, int recvcount, MPI_Datatype recvtype, int source, int recvtag,
+     MPI_Comm comm, MPI_Status *status),
+    (sendbuf, sendcount, sendtype, dest, sendtag, recvbuf, recvcount, recvtype, source,
+     recvtag, comm, status))
+
+UCX_MPI_ATTR_WRAPPER(Wait,
+    (MPI_Request *request, MPI_Status *status),
+    (request, status))
+
+UCX_MPI_ATTR_WRAPPER(Waitall,
+    (int count, MPI_Request array_of_requests[], MPI_Status *array_of_statuses),
+    (count, array_of_requests, array_of_statuses))
+
+UCX_MPI_ATTR_WRAPPER(Waitany,
+    (int count, MPI_Request array_of_requests[], int *index, MPI_Status *status),
+    (count, array_of_requests, index, status))
+
+UCX_MPI_ATTR_WRAPPER(Test,
+    (MPI_Request *request, int *flag, MPI_Status *status),
+    (request, flag, status))
+
+/* Collectives */
+UCX_MPI_ATTR_WRAPPER(Barrier,
+    (MPI_Comm comm),
+    (comm))
+
+UCX_MPI_ATTR_WRAPPER(Bcast,
+    (void *buffer, int count, MPI_Datatype datatype, int root, MPI_Comm comm),
+    (buffer, count, datatype, root, comm))
+
+UCX_MPI_ATTR_WRAPPER(Reduce,
+    (const void *sendbuf, void *recvbuf, int count, MPI_Datatype datatype, MPI_Op op,
+     int root, MPI_Comm comm),
+    (sendbuf, recvbuf, count, datatype, op, root, comm))
+
+UCX_MPI_ATTR_WRAPPER(Allreduce,
+    (const void *sendbuf, void *recvbuf, int count, MPI_Datatype datatype, MPI_Op op,
+     MPI_Comm comm),
+    (sendbuf, recvbuf, count, datatype, op, comm))
+
+UCX_MPI_ATTR_WRAPPER(Gather,
+    (const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, int recvcount,
+     MPI_Datatype recvtype, int root, MPI_Comm comm),
+    (sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, root, comm))
+
+UCX_MPI_ATTR_WRAPPER(Gatherv,
+    (const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf,
+     const int recvcounts[], const int displs[], MPI_Datatype recvtype, int root, MPI_Comm comm),
+    (sendbuf, sendcount, sendtype, recvbuf, recvcounts, displs, recvtype, root, comm))
+
+UCX_MPI_ATTR_WRAPPER(Scatter,
+    (const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, int recvcount,
+     MPI_Datatype recvtype, int root, MPI_Comm comm),
+    (sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, root, comm))
+
+UCX_MPI_ATTR_WRAPPER(Scatterv,
+    (const void *sendbuf, const int sendcounts[], const int displs[], MPI_Datatype sendtype,
+     void *recvbuf, int recvcount, MPI_Datatype recvtype, int root, MPI_Comm comm),
+    (sendbuf, sendcounts, displs, sendtype, recvbuf, recvcount, recvtype, root, comm))
+
+UCX_MPI_ATTR_WRAPPER(Allgather,
+    (const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, int recvcount,
+     MPI_Datatype recvtype, MPI_Comm comm),
+    (sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, comm))
+
+UCX_MPI_ATTR_WRAPPER(Allgatherv,
+    (const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf,
+     const int recvcounts[], const int displs[], MPI_Datatype recvtype, MPI_Comm comm),
+    (sendbuf, sendcount, sendtype, recvbuf, recvcounts, displs, recvtype, comm))
+
+UCX_MPI_ATTR_WRAPPER(Alltoall,
+    (const void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf, int recvcount,
+     MPI_Datatype recvtype, MPI_Comm comm),
+    (sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, comm))
+
+UCX_MPI_ATTR_WRAPPER(Alltoallv,
+    (const void *sendbuf, const int sendcounts[], const int sdispls[], MPI_Datatype sendtype,
+     void *recvbuf, const int recvcounts[], const int rdispls[], MPI_Datatype recvtype,
+     MPI_Comm comm),
+    (sendbuf, sendcounts, sdispls, sendtype, recvbuf, recvcounts, rdispls, recvtype, comm))
+
+UCX_MPI_ATTR_WRAPPER(Reduce_scatter,
+    (const void *sendbuf, void *recvbuf, const int recvcounts[], MPI_Datatype datatype,
+     MPI_Op op, MPI_Comm comm),
+    (sendbuf, recvbuf, recvcounts, datatype, op, comm))
+
+UCX_MPI_ATTR_WRAPPER(Scan,
+    (const void *sendbuf, void *recvbuf, int count, MPI_Datatype datatype, MPI_Op op,
+     MPI_Comm comm),
+    (sendbuf, recvbuf, count, datatype, op, comm))
+
+/* Write the call sites table while MPI is still up */
+extern "C" int
+MPI_Finalize(void)
+{
+    static decltype(&PMPI_Finalize) next_func = NULL;
+
+    if (next_func == NULL) {
+        next_func = (decltype(&PMPI_Finalize))
+            ucx_mpi_attr_next_resolve("MPI_Finalize", (void *)&PMPI_Finalize);
+    }
+
+    ucx_mpi_attr_dump();
+
+    return next_func();
+}
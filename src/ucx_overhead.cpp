@@ -0,0 +1,80 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <x86intrin.h>
+
+#include <utils.h>
+
+#include "ucx_overhead.h"
+
+ucx_overhead::ucx_overhead()
+{
+    m_start_tsc = __rdtsc();
+    m_start_nsec = time_nsec_get();
+}
+
+void
+ucx_overhead::report(int rank, int histogram, const std::vector<const location_t *>& locations)
+{
+    uint64_t buckets[UCX_OVERHEAD_HISTOGRAM_BUCKETS];
+    uint64_t elapsed_tsc = __rdtsc() - m_start_tsc;
+    uint64_t elapsed_nsec = time_nsec_get() - m_start_nsec;
+    uint64_t calls = 0;
+    uint64_t cycles = 0;
+    uint64_t count = 0;
+    uint32_t p50 = 0;
+    uint32_t p99 = 0;
+    uint32_t max = 0;
+    uint32_t i;
+
+    memset(buckets, 0, sizeof(buckets));
+    for (auto location : locations) {
+        for (i = 0; i < UCX_OVERHEAD_HISTOGRAM_BUCKETS; i++) {
+            buckets[i] += location->buckets[i];
+        }
+        calls += location->calls;
+        cycles += location->cycles;
+    }
+
+    if ((calls == 0) || (elapsed_tsc == 0)) {
+        return;
+    }
+
+    /* Percentiles: bucket upper bounds */
+    for (i = 0; i < UCX_OVERHEAD_HISTOGRAM_BUCKETS; i++) {
+        if (buckets[i] == 0) {
+            continue;
+        }
+        if ((count < (calls + 1) / 2) && (count + buckets[i] >= (calls + 1) / 2)) {
+            p50 = i;
+        }
+        if ((count < calls - calls / 100) && (count + buckets[i] >= calls - calls / 100)) {
+            p99 = i;
+        }
+        count += buckets[i];
+        max = i;
+    }
+
+    /* Plugin cycles of all the locations over the elapsed cycles of one location */
+    printf("UCX plugin overhead: rank=%d locations=%zu calls=%lu cycles_mean=%lu p50<%llu p99<%llu max<%llu "
+           "nsec_per_cycle=%.3f fraction=%.4f%%\n",
+           rank, locations.size(), (unsigned long)calls, (unsigned long)(cycles / calls),
+           2ULL << p50, 2ULL << p99, 2ULL << max, (double)elapsed_nsec / elapsed_tsc,
+           100.0 * cycles / elapsed_tsc / locations.size());
+
+    if (!histogram) {
+        return;
+    }
+
+    for (i = 0; i < UCX_OVERHEAD_HISTOGRAM_BUCKETS; i++) {
+        if (buckets[i] != 0) {
+            printf("  [%12llu, %12llu) cycles: %12lu %6.2f%%\n", 1ULL << i, 2ULL << i,
+                (unsigned long)buckets[i], 100.0 * buckets[i] / calls);
+        }
+    }
+}
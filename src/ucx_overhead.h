@@ -0,0 +1,58 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+#if !defined(_UCX_OVERHEAD_H_)
+#define _UCX_OVERHEAD_H_
+
+#include <stdint.h>
+#include <vector>
+
+/* Histogram buckets: [2^i, 2^(i+1)) cycles */
+#define UCX_OVERHEAD_HISTOGRAM_BUCKETS      64
+
+/*
+   Self-overhead of the sampling path.
+
+   Each location (thread) keeps a log2 histogram of the cycles (TSC ticks)
+   spent per counter read, and its total plugin cycles. The TSC frequency is
+   calibrated over the run, to report the overhead as a fraction of the
+   elapsed time at finalize.
+*/
+class ucx_overhead {
+public:
+   /* Per location histogram (see ucx_location_t) */
+   typedef struct location {
+       uint64_t buckets[UCX_OVERHEAD_HISTOGRAM_BUCKETS];
+       uint64_t calls;
+       uint64_t cycles;
+       /* Plugin cycles at the previous plugin cycles metric sample */
+       uint64_t prev_cycles;
+   } location_t;
+
+   ucx_overhead();
+
+   /* Account a counter read of a location */
+   static inline void
+   sample_add(location_t *location, uint64_t cycles) {
+       location->buckets[63 - __builtin_clzll(cycles | 1)]++;
+       location->calls++;
+       location->cycles += cycles;
+   }
+
+   /*
+      Print the overhead summary of the locations of this process, and the histogram.
+
+      histogram: print the histogram buckets too.
+   */
+   void
+   report(int rank, int histogram, const std::vector<const location_t *>& locations);
+
+private:
+   uint64_t m_start_tsc;
+   uint64_t m_start_nsec;
+};
+
+#endif /* _UCX_OVERHEAD_H_ */
@@ -7,484 +7,291 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <string.h>
-#include <assert.h>
-#include <unistd.h>
 #include <iostream>
-#include <sstream>
 #include <algorithm>
-#include <sys/types.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <netinet/ip.h> /* superset of previous */
-#include <stdint.h>
-#include <inttypes.h>
-#include <getopt.h>
-#include <math.h>
-
-#include <getopt.h>
 
 #include <utils.h>
 
-#if defined(UCX_STATS_NIC_COUNTERS_ENABLE)
-#include <ucs/counters/ethtool_ctrs.h>
-#endif
-
 #include "ucx_sampling.h"
 
-#define THRESHOLD_FOR_STARTING_UCX_MEASUREMENTS (UCX_NUM_TEMPORARY_COUNTERS*25)
-
-/* Enable verbose mode */
-//#define UCX_SAMPLING_VERBOSE_MODE_ENABLE
-
 /* Constructor */
 ucx_sampling::ucx_sampling()
 {
-    m_counters_initialized_on_scorep = 0;
-    m_statistics_server_process_enable = 0;
-
-    /* Initialize  */
-    m_aggrgt_sum_size = 0;
-    memset(m_aggrgt_sum_counters, 0x00, sizeof(m_aggrgt_sum_counters));
-
-    m_aggrgt_sum_counter_names = NULL;
-    m_aggrgt_sum_counter_names_size = 0;
-
-    /* Set NIC counters to not initialized */
-    m_nic_counters_initialized = 0;
-
-#if defined(UCX_STATS_NIC_COUNTERS_ENABLE)
-    /* allocate memory for stats_handle of the device  */
-    m_nic_ndev_name = getenv(ENV_SCOREP_UCX_PLUGIN_NIC_DEVICE_NAME);
-    if (m_nic_ndev_name != NULL) {
-        ucs_status_t status = stats_alloc_handle(m_nic_ndev_name, &m_eth_stats_handle);
-        if (status != UCS_OK) {
-            printf("Warning: stats_alloc_handle() failed! status=%d\n", status);
-        }
-        else {
-            m_nic_counters_initialized = 1;
-        }
-    }
-
-    DEBUG_PRINT("m_nic_ndev_name = %s\n", m_nic_ndev_name);
-
-    /* Initiaize NIC counters database */
-    m_nic_cnts_agrgt_num = 0;
-    m_num_nic_counters_total = 0;
-    memset(m_nic_cnts_agrgt_mapping, 0x00, sizeof(m_nic_cnts_agrgt_mapping));
-    memset(m_nic_cnts_agrgt, 0x00, sizeof(m_nic_cnts_agrgt));
-    m_nic_rounds_cnt = 0;
-#endif
+    m_ucx_counters_collect_enable = 1;
+    m_nic_counters_collect_enable = 0;
+    m_verbose = 1;
+    m_snapshot_seq = 0;
+    m_legacy = NULL;
+    m_stats_server_started = 0;
 }
 
 /* Destructor */
 ucx_sampling::~ucx_sampling()
 {
-#if defined(UCX_STATS_NIC_COUNTERS_ENABLE)
-    /* release the memory of stats_handle of the device  */
-    if ((m_nic_counters_initialized) && (m_nic_ndev_name != NULL)) {
-        ucs_status_t status = stats_release_handle(&m_eth_stats_handle);
-        if (status != UCS_OK) {
-            printf("Warning: stats_release_handle() failed! status=%d\n", status);
-        }
+    for (auto backend : m_owned_backends) {
+        delete backend;
     }
-#endif
+    m_owned_backends.clear();
 }
 
+/*
+   Selects the backends:
+   SCOREP_UCX_PLUGIN_BACKENDS - comma separated list of backends (dispatch order).
+   Otherwise, UCX counters ==> aggregate, NIC counters ==> ethtool.
+*/
 void
 ucx_sampling::configuration_set(int ucx_counters_enable, int nic_counters_enable)
 {
+    const char *backends = getenv(ENV_SCOREP_UCX_PLUGIN_BACKENDS);
+
     m_ucx_counters_collect_enable = ucx_counters_enable;
     m_nic_counters_collect_enable = nic_counters_enable;
-}
-
-
-int ucx_sampling::ucx_statistics_server_start(int port)
-{
-    ucs_stats_node_t *root;
-    ucs_list_link_t *stats;
-    ucs_status_t status;
-    int ret = 0;
-
-    DEBUG_PRINT("ucx_statistics_server_start()\n");
-    DEBUG_PRINT("UCX Port used = %d\n", port);
-
-    m_statistics_server_process_enable = 0;
-    status = ucs_stats_server_start(port, &m_ucx_stats_server);
-    if (status != UCS_OK) {
-        printf("ucs_stats_server_start() Failed! status=%u\n", status);
-        ret = -1;
-        goto exit_and_return_metric_properties;
-    }
-
-    DEBUG_PRINT("ucs_stats_server_start() Succes! status=%u\n", status);
-    m_statistics_server_process_enable = 1;
-
-exit_and_return_metric_properties:
-    return ret;
-}
-
-uint64_t
-ucx_sampling::recursive_scan_counters_list(ucs_stats_node_t *root,
-        ucs_list_link_t *stats,
-        const char *counters_root_name,
-        scorep_counters_list_t *ucx_counters_list,
-        uint64_t num_objects,
-        uint64_t& num_counters,
-        int initialize_counters_enable)
-{
-    ucs_status_t status;
-    ucs_stats_node_t *data_node;
-    size_t statistics_len;
-    char counter_name_prefix[UCX_SAMPLING_COUNTER_NAME_PREFIX_MAX_SIZE];
-    char counter_name_temp[UCX_SAMPLING_COUNTER_NAME_PREFIX_MAX_SIZE];
-    uint64_t n_local_objects = 0;
-    scorep_counter_data_t *ucx_performance_counter = NULL;
-
-    ucs_list_for_each(data_node, &root->children[UCS_STATS_ACTIVE_CHILDREN], list) {
-#if defined(UCX_SAMPLING_VERBOSE_MODE_ENABLE)
-        std::cout << "name = " << std::string(data_node->cls->name) <<
-                     " num_counters=" << data_node->cls->num_counters <<
-                     std::endl;
-#endif
-
-        if (initialize_counters_enable) {
-            snprintf(counter_name_prefix, sizeof(counter_name_prefix),
-                     "%s-%s", counters_root_name, data_node->cls->name);
-            snprintf(counter_name_temp, sizeof(counter_name_temp),
-                     "ucx-object-%lu-%s", num_objects, counter_name_prefix);
-        }
 
-        for (int k = 0; k < data_node->cls->num_counters; k++) {
-            if (initialize_counters_enable) {
-                ucx_performance_counter = new scorep_counter_data_t();
-                ucx_performance_counter->scorep_counter_id = num_counters;
-                ucx_performance_counter->metric_handle = 0;
-                ucx_performance_counter->scorep_metric_already_renamed = 0;
-                snprintf(ucx_performance_counter->name,
-                         sizeof(ucx_performance_counter->name),
-                         "%s-%s",
-                         counter_name_temp,
-                         data_node->cls->counter_names[k]);
-                ucx_performance_counter->value = data_node->counters[k];
-                ucx_performance_counter->prev_value = (uint64_t)-1;
-
-                ucx_counters_list->push_back(ucx_performance_counter);
-            }
-            else {
-                if (num_counters >= ucx_counters_list->size()) {
-                    /* We are not updating the counters list in runtime */
-                    goto ucx_scan_counters_complete_exit;
-                }
-                (*ucx_counters_list)[num_counters]->value = data_node->counters[k];
+    m_backend_names.clear();
+    if (backends != NULL) {
+        for (auto& backend_name : split(backends, ',')) {
+            if (!backend_name.empty()) {
+                m_backend_names.push_back(backend_name);
             }
-
-#if defined(UCX_SAMPLING_VERBOSE_MODE_ENABLE)
-            std::cout << ucx_performance_counter->name <<
-                         " " << data_node->counters[k] << std::endl;
-#endif
-
-            num_counters++;
         }
+        return;
+    }
 
-        /* Number of UCX objects counted */
-        num_objects++;
-        n_local_objects++;
-
-        /* Recursively iterate through counters */
-        num_objects += recursive_scan_counters_list(data_node,
-              stats, counter_name_prefix, ucx_counters_list,
-              num_objects, num_counters, initialize_counters_enable);
+    if (m_ucx_counters_collect_enable) {
+        m_backend_names.push_back(UCX_SAMPLING_BACKEND_AGGREGATE);
     }
 
-ucx_scan_counters_complete_exit:
-    return n_local_objects;
+    if (m_nic_counters_collect_enable) {
+        m_backend_names.push_back(UCX_SAMPLING_BACKEND_ETHTOOL);
+    }
 }
 
-void
-ucx_sampling::scan_counters_list(ucs_list_link_t *stats,
-     const char *counters_root_name,
-     scorep_counters_list_t *ucx_counters_list,
-     int initialize_counters_enable)
+int
+ucx_sampling::backend_enabled(const char *backend_name)
 {
-    ucs_status_t status;
-    ucs_stats_node_t *data_node;
-    ucs_stats_node_t *root;
-    size_t statistics_len;
-    uint64_t num_objects;
-    uint64_t num_counters;
-
-    statistics_len = ucs_list_length(stats);
-#if defined(UCX_SAMPLING_VERBOSE_MODE_ENABLE)
-    std::cout<< "stats len: " << statistics_len << std::endl;
-#endif
-    /* Recursively iterate through counters */
-    root = ucs_list_head(stats, ucs_stats_node_t, list);
-    num_objects = 0;
-    num_counters = 0;
-    recursive_scan_counters_list(root, stats, "cnt", ucx_counters_list,
-            num_objects, num_counters, initialize_counters_enable);
+    return (std::find(m_backend_names.begin(), m_backend_names.end(), backend_name) !=
+                m_backend_names.end());
 }
 
-
-void
-ucx_sampling::ucx_statistics_all_counters_update(
-    scorep_counters_list_t *new_counters_list,
-    int initialize_counters_enable)
+size_t
+ucx_sampling::backends_init()
 {
-    ucs_list_link_t *stats;
-
-    /* Trigger dumping UCX statistics */
-    ucs_stats_dump();
+    ucx_sampling_backend *backend;
+    size_t num_counters;
+    uint32_t i;
 
-    /* Wait for statistics to be sent to Server by UCX */
-    do {
-    } while (ucs_stats_server_rcvd_packets(m_ucx_stats_server) == 0);
-
-#if defined(UCX_SAMPLING_VERBOSE_MODE_ENABLE)
-    std::cout << "UCS statistics server started, getting statistics...";
-#endif
-    /* Get stats */
-    stats = ucs_stats_server_get_stats(m_ucx_stats_server);
-
-    /* Scan counters list */
-    scan_counters_list(stats, "", new_counters_list,
-       initialize_counters_enable);
-
-#if defined(UCX_SAMPLING_VERBOSE_MODE_ENABLE)
-    std::cout << "Done: statistics ptr returned=" << stats << "\n";
-#endif
-    /* Release stats */
-    ucs_stats_server_purge_stats(m_ucx_stats_server);
-}
+    if (!m_dispatch.empty()) {
+        return m_dispatch.size();
+    }
 
-int
-ucx_sampling::ucx_statistics_current_value_get(int mpi_rank, uint32_t index,
-        scorep_counters_list_t *ucx_counters_list,
-        uint64_t *value, uint64_t *prev_value)
-{
-    ucs_status_t status;
-    ucs_stats_node_t *data_node;
-    ucs_stats_node_t *root;
-    size_t rx_packets;
-    size_t statistics_len;
-    int initialize_counters_enable = 0;
-    static uint64_t counter = 0;
-
-    /* UCX Statistics server already up and running and counters were updated */
-    if (m_counters_initialized_on_scorep) {
-        if (index == 0) {
-            ucx_statistics_all_counters_update(ucx_counters_list,
-                initialize_counters_enable);
+    for (auto& backend_name : m_backend_names) {
+        if (backend_name == UCX_SAMPLING_BACKEND_AGGREGATE) {
+            backend = &m_aggregate;
         }
-
-        if (index < ucx_counters_list->size()) {
-            *value = (*ucx_counters_list)[index]->value;
-            *prev_value = (*ucx_counters_list)[index]->prev_value;
-            (*ucx_counters_list)[index]->prev_value = *value;
+        else if (backend_name == UCX_SAMPLING_BACKEND_LEGACY) {
+            m_legacy = new ucx_sampling_legacy();
+            m_owned_backends.push_back(m_legacy);
+            backend = m_legacy;
+        }
+        else if (backend_name == UCX_SAMPLING_BACKEND_DIRECT) {
+            backend = new ucx_sampling_direct();
+            m_owned_backends.push_back(backend);
+        }
+        else if (backend_name == UCX_SAMPLING_BACKEND_UDP) {
+            backend = new ucx_sampling_udp();
+            m_owned_backends.push_back(backend);
+        }
+        else if (backend_name == UCX_SAMPLING_BACKEND_ETHTOOL) {
+            backend = new ucx_sampling_ethtool();
+            m_owned_backends.push_back(backend);
+        }
+        else if (backend_name == UCX_SAMPLING_BACKEND_SYSFS) {
+            backend = new ucx_sampling_sysfs();
+            m_owned_backends.push_back(backend);
         }
         else {
-            *value = 0;
-            *prev_value = 0;
+            printf("Warning: unknown UCX sampling backend: %s\n", backend_name.c_str());
+            continue;
         }
 
-        return 0;
-    }
-
-    if (ucx_counters_list->size() == 0) {
-        if ((counter & 0xFF) == 0) {
-           /* Initialize counters list */
-           initialize_counters_enable = 1;
-           ucx_statistics_all_counters_update(ucx_counters_list,
-              initialize_counters_enable);
-
-           printf("Detected UCX counters after scan, size = %u\n",
-                ucx_counters_list->size());
-
-           if (ucx_counters_list->size() != 0) {
-              m_counters_initialized_on_scorep = 1;
-              printf("Added UCX counters after scan, size = %u\n",
-                   ucx_counters_list->size());
-              /* Indicates initialized counters list */
-              return 1;
-           }
+        num_counters = backend->counters_init();
+        if (m_verbose) {
+            printf("UCX sampling backend %s: %zu counters\n", backend->name(), num_counters);
+        }
+        if (num_counters == 0) {
+            continue;
         }
-    }
-    counter++;
 
-    return 0;
-}
+        m_backends.push_back(backend);
 
-int
-ucx_sampling::ucx_statistics_aggregate_counter_get(uint32_t index, uint64_t *value)
-{
-    int ret = 1;
-
-    if (unlikely(index == 0)) {
-        m_aggrgt_sum_size = ucs_stats_aggregate(m_aggrgt_sum_counters, ARRAY_SIZE(m_aggrgt_sum_counters));
-        if (m_aggrgt_sum_size == 0) {
-            printf("Warning: ucs_stats_aggregate() aggrgt_sum_size == 0");
-            ret = 0;
-            *value = 0;
-        }
+        /* Flatten the backend counters into the dispatch table */
+        for (i = 0; i < num_counters; i++) {
+            ucx_sampling_dispatch_entry_t entry;
+
+            entry.value = NULL;
+            entry.refresh_backend = (i == 0) ? backend : NULL;
+            entry.refresh_first = (uint32_t)m_dispatch.size();
+            entry.refresh_count = (i == 0) ? num_counters : 0;
 
-        *value = m_aggrgt_sum_counters[0];
+            m_dispatch.push_back(entry);
+            m_dispatch_names.push_back(std::make_pair(backend, i));
+            m_raw_values.push_back(backend->counter_value_ptr_get(i));
+            m_monotonic.push_back(backend->counter_is_monotonic(i) ? 1 : 0);
+        }
     }
-    else {
-        *value = m_aggrgt_sum_counters[index];
+
+    /* The dispatch table reads the corrected values (table is complete: stable addresses) */
+    m_values.assign(m_dispatch.size(), 0);
+    m_prev_raw_values.assign(m_dispatch.size(), 0);
+    m_retired_values.assign(m_dispatch.size(), 0);
+    m_refreshed.assign(m_dispatch.size(), 0);
+    m_change_counts.assign(m_dispatch.size(), 0);
+    m_total_deltas.assign(m_dispatch.size(), 0);
+    for (i = 0; i < m_dispatch.size(); i++) {
+        m_dispatch[i].value = &m_values[i];
     }
 
-    return ret;
+    return m_dispatch.size();
 }
 
 int
-ucx_sampling::ucx_statistics_aggregate_counter_names_get(const ucs_stats_aggrgt_counter_name_t **names_p,
-    size_t *size_p)
+ucx_sampling::ucx_statistics_server_start(int port)
 {
-    /* Get counters names */
-    ucs_stats_aggregate_get_counter_names(&m_aggrgt_sum_counter_names, &m_aggrgt_sum_counter_names_size);
+    ucs_status_t status;
 
-    *names_p = m_aggrgt_sum_counter_names;
-    *size_p = m_aggrgt_sum_counter_names_size;
+    if (m_legacy != NULL) {
+        return m_legacy->server_start(port);
+    }
 
-    return (m_aggrgt_sum_counter_names_size > 0);
-}
+    if (m_stats_server_started) {
+        return 0;
+    }
 
-void
-ucx_sampling::ucx_statistics_aggregate_counter_size_assign(size_t size)
-{
-    m_aggrgt_sum_counter_names_size = size;
-}
+    status = ucs_stats_server_start(port, &m_stats_server);
+    if (status != UCS_OK) {
+        printf("ucs_stats_server_start() Failed! status=%u\n", status);
+        return -1;
+    }
 
-/* NIC counters implementation */
-#if defined(UCX_STATS_NIC_COUNTERS_ENABLE)
+    m_stats_server_started = 1;
+    return 0;
+}
 
 void
-ucx_sampling::nic_counters_update(size_t *num_counters)
+ucx_sampling::backends_enumerate(int mpi_rank, std::vector<uint32_t> *ids)
 {
-    *num_counters = 0;
-
-    if (m_nic_counters_initialized) {
-        /* query device counters and store them in stats_handle  */
-        void *filter = NULL;
-        ucs_status_t status = stats_query_device(&m_eth_stats_handle, filter);
-        if (status != UCS_OK) {
-            printf("Warning: stats_query_device() failed! status=%d\n", status);
-        }
+    std::lock_guard<std::mutex> lock(m_refresh_lock);
+    size_t num_counters;
+    uint32_t id;
 
-        *num_counters = m_eth_stats_handle.super.n_stats;
-    }
-}
+    for (auto backend : m_backends) {
+        if (!backend->counters_deferred()) {
+            continue;
+        }
 
-uint64_t
-ucx_sampling::nic_counter_value_get(uint32_t index)
-{
-    uint64_t value = 0;
-    size_t num_counters;
+        num_counters = backend->counters_enumerate(mpi_rank);
+        if (m_verbose) {
+            printf("UCX sampling backend %s: %zu counters discovered\n", backend->name(), num_counters);
+        }
 
-    if (m_nic_counters_initialized) {
-        /* Update NIC counters? */
-        if (index == 0) {
-            if ((m_nic_rounds_cnt & (NIC_COUNTERS_UPDATE_DECIMATION-1)) == 0) {
-                nic_counters_update(&num_counters);
+        for (id = 0; id < m_dispatch_names.size(); id++) {
+            if ((m_dispatch_names[id].first == backend) && (m_dispatch_names[id].second < num_counters)) {
+                ids->push_back(id);
             }
-            m_nic_rounds_cnt++;
         }
-
-        value = m_eth_stats_handle.super.stats->data[index];
     }
-
-    return value;
 }
 
 void
-ucx_sampling::nic_counter_name_get(uint32_t index, string *name)
+ucx_sampling::counter_name_get(uint32_t id, string *name)
 {
-    if (m_nic_counters_initialized) {
-        *name =
-            (const char *)&m_eth_stats_handle.super.strings->data[index * ETH_GSTRING_LEN];
+    if (id < m_dispatch_names.size()) {
+        m_dispatch_names[id].first->counter_name_get(m_dispatch_names[id].second, name);
     }
 }
 
-void
-ucx_sampling::nic_counter_name_filter(string *name)
-{
-    std::string filter_chars = "0123456789:";
-
-    name->erase(
-              remove_if(name->begin(), name->end(),
-                        [&filter_chars](const char &c) {
-                            return filter_chars.find(c) != std::string::npos;
-                        }),
-                        name->end());
-}
-
 int
-ucx_sampling::aggt_sum_counter_name_index_find(string *cnt_name, string *aggt_cnts_names, uint32_t aggt_cnt_num,
-                   uint32_t *agrgt_counter_index)
+ucx_sampling::backend_counters_range_get(const char *backend_name, uint32_t *first, uint32_t *count)
 {
-    uint32_t i;
+    uint32_t id;
 
-    for (i = 0; i < aggt_cnt_num; i++) {
-        if (*cnt_name == aggt_cnts_names[i]) {
-            *agrgt_counter_index = i;
+    for (id = 0; id < m_dispatch.size(); id++) {
+        if ((m_dispatch[id].refresh_backend != NULL) &&
+            (strcmp(m_dispatch[id].refresh_backend->name(), backend_name) == 0)) {
+            *first = m_dispatch[id].refresh_first;
+            *count = m_dispatch[id].refresh_count;
             return 1;
         }
     }
 
-    /* Not found */
-    *agrgt_counter_index = -1;
-
+    *first = 0;
+    *count = 0;
     return 0;
 }
 
-/*
-   Updates and aggregate sums counters.
-
-   returns: The number of counters in the aggregate list.
-*/
-uint32_t
-ucx_sampling::nic_counters_aggregate()
+void
+ucx_sampling::refresh_counter_set(uint32_t first, uint32_t id)
 {
-    string cnt_name;
-    uint32_t index = 0;
-    uint32_t filtered_index = 0;
-    uint32_t agrgt_counter_index;
-    int ret;
-
-    /* Update NIC counters */
-    nic_counters_update(&m_num_nic_counters_total);
-
-    while (index < m_num_nic_counters_total) {
+    ucx_sampling_dispatch_entry_t *entry = &m_dispatch[first];
 
-        /* Get the next counter name */
-        nic_counter_name_get(index, &cnt_name);
+    if ((entry->refresh_backend == NULL) || (id == first) ||
+        (id < entry->refresh_first) || (id >= (entry->refresh_first + entry->refresh_count))) {
+        return;
+    }
 
-        /* Filter out characters (to get aggregate_sum name) */
-        nic_counter_name_filter(&cnt_name);
+    m_dispatch[id].refresh_backend = entry->refresh_backend;
+    m_dispatch[id].refresh_first = entry->refresh_first;
+    m_dispatch[id].refresh_count = entry->refresh_count;
+    entry->refresh_backend = NULL;
+    entry->refresh_count = 0;
+}
 
-        /* Is counter already in list? */
-        ret = aggt_sum_counter_name_index_find(&cnt_name, m_nic_cnts_agrgt_names,
-                  filtered_index, &agrgt_counter_index);
-        if ( (ret == 0) && (filtered_index < NUM_NIC_AGGREGATE_CNTS_MAX) ) {
-            DEBUG_PRINT("Adding new counter: cnt_name = %s\n", cnt_name.c_str());
+void
+ucx_sampling::backends_refresh(int blocking_enable)
+{
+    std::lock_guard<std::mutex> lock(m_refresh_lock);
 
-            agrgt_counter_index = filtered_index;
-            m_nic_cnts_agrgt_names[agrgt_counter_index] = cnt_name;
-            filtered_index++;
+    for (auto& entry : m_dispatch) {
+        if ((entry.refresh_backend != NULL) &&
+            (blocking_enable || !entry.refresh_backend->refresh_is_blocking())) {
+            backend_refresh_locked(&entry);
         }
+    }
+}
 
-        /* Add index of counter to database */
-        m_nic_cnts_agrgt_mapping[index] = agrgt_counter_index;
+int
+ucx_sampling::backends_refresh_try()
+{
+    std::unique_lock<std::mutex> lock(m_refresh_lock, std::try_to_lock);
 
-        index++;
+    if (!lock.owns_lock()) {
+        return 0;
     }
 
-    m_nic_cnts_agrgt_num = filtered_index;
+    for (auto& entry : m_dispatch) {
+        if ((entry.refresh_backend != NULL) && !entry.refresh_backend->refresh_is_blocking()) {
+            backend_refresh_locked(&entry);
+        }
+    }
 
-    return m_nic_cnts_agrgt_num;
+    return 1;
 }
 
-#endif /* UCX_STATS_NIC_COUNTERS_ENABLE */
+void
+ucx_sampling::snapshot_copy(uint32_t first, uint32_t count, uint64_t *values)
+{
+    uint32_t seq;
+    uint32_t i;
 
+    do {
+        /* Wait for the refresh in progress */
+        while ((seq = m_snapshot_seq.load(std::memory_order_acquire)) & 1) {
+        }
 
+        for (i = 0; i < count; i++) {
+            values[i] = __atomic_load_n(m_dispatch[first + i].value, __ATOMIC_RELAXED);
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while (seq != m_snapshot_seq.load(std::memory_order_relaxed));
+}
@@ -9,23 +9,15 @@
 
 #include <stdint.h>
 #include <string.h>
-
-#ifdef __cplusplus
-extern "C" {
-#endif
-#include <ucs/stats/libstats.h>
-#include <ucs/stats/stats.h>
-#ifdef __cplusplus
-}
-#endif
+#include <atomic>
+#include <mutex>
 
 #include <plugin_types.h>
 
 #include <scorep_plugin_ucx_config.h>
 
-#if defined(UCX_STATS_NIC_COUNTERS_ENABLE)
-#include <ucs/counters/ethtool_ctrs.h>
-#endif
+#include <utils.h>
+#include <ucx_sampling_backend.h>
 
 using namespace std;
 
@@ -39,15 +31,6 @@ using namespace std;
 #define NEG_INF							-10000000
 #define POS_INF							10000000
 
-/* Maximum number of aggregate-sum counters */
-#define UCX_AGGREGATE_SUM_NUM_COUNTERS_MAX 64
-
-/* Number of aggregate sum counters */
-#define NUM_NIC_AGGREGATE_CNTS_MAX         1024
-
-/* Total number of NIC counters */
-#define NUM_NIC_CNTS_MAX                   (10*1024)
-
 /*********************************/
 /* Main class for ucx Sampling */
 /*********************************/
@@ -63,151 +46,248 @@ public:
    void
    configuration_set(int ucx_counters_enable, int nic_counters_enable);
 
-   /* Read current value of a PVAR */
-   int
-   ucx_statistics_current_value_get(int mpi_rank, uint32_t index,
-       scorep_counters_list_t *ucx_counters_list, uint64_t *value, uint64_t *prev_value);
+   /* Print the composed backends (disabled by the LD_PRELOAD collector: application stdout) */
+   void
+   verbose_set(int verbose) {
+       m_verbose = verbose;
+   }
+
+   /*
+      Compose the selected backends into the dispatch table.
+
+      returns: The total number of counters.
+   */
+   size_t
+   backends_init();
+
+   /* Get the total number of counters (all backends) */
+   size_t
+   counters_num_get() {
+       return m_dispatch.size();
+   }
+
+   /* Get counter name (without the Score-P metric prefix) */
+   void
+   counter_name_get(uint32_t id, string *name);
+
+   /* Get counter value by Score-P counter ID */
+   inline uint64_t
+   counter_value_get(uint32_t id);
 
+   /*
+      Refresh the snapshots of all backends (waits for a concurrent refresh).
+
+      blocking_enable: Also refresh the backends that wait for another process (legacy).
+   */
+   void
+   backends_refresh(int blocking_enable = 1);
+
+   /*
+      Refresh the snapshots of the non-blocking backends, unless a refresh is
+      in progress (never waits). returns: 1 if refreshed, 0 otherwise.
+   */
    int
-   ucx_statistics_server_start(int port);
+   backends_refresh_try();
+
+   /* Get counter value from the last backend snapshot (no refresh) */
+   uint64_t
+   counter_snapshot_get(uint32_t id) {
+       return __atomic_load_n(m_dispatch[id].value, __ATOMIC_RELAXED);
+   }
 
-   /* Update & initialize counters from UCX statistics */
+   /* Copy the counters [first, first + count) of the same snapshot (no refresh) */
    void
-   ucx_statistics_all_counters_update(scorep_counters_list_t *new_counters_list,
-       int initialize_counters_enable);
+   snapshot_copy(uint32_t first, uint32_t count, uint64_t *values);
+
+   /* Counter activity since the first refresh: number of changes and total (absolute) change */
+   void
+   counter_activity_get(uint32_t id, uint64_t *num_changes, uint64_t *total_delta) {
+       *num_changes = m_change_counts[id];
+       *total_delta = m_total_deltas[id];
+   }
 
+   /* Is the counter monotonic (cumulative)? */
+   int
+   counter_is_monotonic(uint32_t id) {
+       return m_dispatch_names[id].first->counter_is_monotonic(m_dispatch_names[id].second);
+   }
+
+   /* Start the UCX statistics server (the legacy backend one, when selected) */
+   int
+   ucx_statistics_server_start(int port);
 
    /* Get current aggregate-sum value of a certain index */
    int
-   ucx_statistics_aggregate_counter_get(uint32_t index, uint64_t *value);
+   ucx_statistics_aggregate_counter_get(uint32_t index, uint64_t *value) {
+       std::lock_guard<std::mutex> lock(m_refresh_lock);
+       return m_aggregate.counter_get(index, value);
+   }
 
    /* Get current aggregate-sum counter names of all indices */
    int
    ucx_statistics_aggregate_counter_names_get(const ucs_stats_aggrgt_counter_name_t **names_p,
-       size_t *size_p);
+       size_t *size_p) {
+       return m_aggregate.counter_names_get(names_p, size_p);
+   }
 
+   /* Assign the aggregate-sum counter names known in advance */
    void
-   ucx_statistics_aggregate_counter_size_assign(size_t size);
+   ucx_statistics_aggregate_counter_names_assign(const std::vector<string>& names) {
+       m_aggregate.counter_names_assign(names);
+   }
 
    size_t
    ucx_statistics_aggrgt_sum_total_counters_num_get() {
-       return m_aggrgt_sum_size;
+       return m_aggregate.total_counters_num_get();
    }
 
-#if defined(UCX_STATS_NIC_COUNTERS_ENABLE)
-
-   /* Read NIC counters into stats handle ==> Update statistics */
+   /*
+      Refresh a backend snapshot when reading counter ID 'id' instead of the
+      backend's first counter 'first' (the first counter is not read).
+   */
    void
-   nic_counters_update(size_t *num_counters);
+   refresh_counter_set(uint32_t first, uint32_t id);
 
-   /* Get NIC counter value - Returns the value of the counter */
-   uint64_t
-   nic_counter_value_get(uint32_t index);
+   /* Is a backend selected? */
+   int
+   backend_enabled(const char *backend_name);
 
-   /* Get NIC counter name - Returns the counter name */
-   void
-   nic_counter_name_get(uint32_t index, string *name);
+   /*
+      Discover the counters of the deferred backends (after MPI_Init).
 
+      ids: The Score-P counter IDs of the discovered counters (named now).
+   */
    void
-   nic_counter_name_filter(string *name);
+   backends_enumerate(int mpi_rank, std::vector<uint32_t> *ids);
 
-   /* Get the total number of aggregate-sum NIC counters */
-   size_t
-   nic_counter_total_aggrgt_num_counters() {
-       return m_nic_cnts_agrgt_num;
-   }
+   /*
+      Get the Score-P counter ID range of a backend.
 
+      returns: 1 if the backend is in the dispatch table, 0 otherwise.
+   */
    int
-   aggt_sum_counter_name_index_find(string *cnt_name, string *aggt_cnts_names, uint32_t aggt_cnt_num,
-        uint32_t *agrgt_counter_index);
+   backend_counters_range_get(const char *backend_name, uint32_t *first, uint32_t *count);
 
-   /*
-      Updates and aggregate sums counters (required to be executed only once).
+private:
+   /* Refresh a backend and correct its counters (the refresh lock is held) */
+   inline void
+   backend_refresh_locked(const ucx_sampling_dispatch_entry_t *entry);
 
-      returns: The number of counters in the aggregate list.
+   /*
+      Monotonic correction of the refreshed backend counters: an aggregate that
+      decreases (e.g. UCX objects destroyed) adds the drop to a retired-value
+      accumulator, so the reported totals never decrease.
    */
-   uint32_t
-   nic_counters_aggregate();
+   inline void
+   values_correct(uint32_t first, uint32_t count);
 
-#endif /* UCX_STATS_NIC_COUNTERS_ENABLE */
+   /*
+      Aggregate-sum backend: also serves the aggregate-sum names discovery
+      (names file, temporary names), selected or not.
+   */
+   ucx_sampling_aggregate m_aggregate;
 
-private:
+   /* Legacy backend (selected), or NULL */
+   ucx_sampling_legacy *m_legacy;
 
-   uint64_t
-   recursive_scan_counters_list(ucs_stats_node_t *root,
-       ucs_list_link_t *stats,
-       const char *counters_root_name,
-       scorep_counters_list_t *ucx_counters_list,
-       uint64_t num_objects,
-       uint64_t& num_counters,
-       int initialize_counters_enable);
-
-   /* Scan the counters list to see if there are any new counters */
-   void
-   scan_counters_list(ucs_list_link_t *stats,
-       const char *counters_root_name,
-       scorep_counters_list_t *ucx_counters_list,
-       int initialize_counters_enable);
+   /* UCX statistics server without the legacy backend */
+   ucs_stats_server_h m_stats_server;
+   int m_stats_server_started;
 
-private:
+   /* Selected backends, in dispatch order */
+   std::vector<ucx_sampling_backend *> m_backends;
 
-   /* Handle for UCX statistics server */
-   ucs_stats_server_h m_ucx_stats_server;
+   /* Backends created on demand (owned) */
+   std::vector<ucx_sampling_backend *> m_owned_backends;
 
-   /*
-      Enable statistics server on process,
-      if port bound successfully
-   */
-   int m_statistics_server_process_enable;
+   /* Names of the selected backends */
+   std::vector<string> m_backend_names;
 
-   /* Score-P counters initialized (updated dynamically) */
-   int m_counters_initialized_on_scorep;
+   /* Dispatch table: Score-P counter ID -> backend snapshot */
+   std::vector<ucx_sampling_dispatch_entry_t> m_dispatch;
 
-   /* size of aggregate-sum counters list */
-   size_t m_aggrgt_sum_size;
+   /* Dispatch table: Score-P counter ID -> backend, backend index */
+   std::vector<std::pair<ucx_sampling_backend *, uint32_t> > m_dispatch_names;
 
-   /* Aggregate-sum counters list */
-   ucs_stats_counter_t m_aggrgt_sum_counters[UCX_AGGREGATE_SUM_NUM_COUNTERS_MAX];
+   /* Monotonic correction, indexed by Score-P counter ID */
+   std::vector<const uint64_t *> m_raw_values;
+   std::vector<uint64_t> m_values;
+   std::vector<uint64_t> m_prev_raw_values;
+   std::vector<uint64_t> m_retired_values;
+   std::vector<uint8_t> m_monotonic;
 
-   /* The counters names */
-   const ucs_stats_aggrgt_counter_name_t *m_aggrgt_sum_counter_names;
+   /* Counter activity (profile-guided counter selection), indexed by Score-P counter ID */
+   std::vector<uint8_t> m_refreshed;
+   std::vector<uint64_t> m_change_counts;
+   std::vector<uint64_t> m_total_deltas;
 
-   /* The size of the counters names */
-   size_t m_aggrgt_sum_counter_names_size;
+   /*
+      All the Score-P locations and the background threads (sidecar, async
+      watcher, shm export, application API) share the backends: one thread
+      refreshes a backend and corrects its counters at a time. A location that
+      finds a refresh in progress reads the current snapshot instead of waiting.
+      The snapshot sequence is odd while the corrected values are written.
+   */
+   std::mutex m_refresh_lock;
+   std::atomic<uint32_t> m_snapshot_seq;
 
    /* Enable functionality (UCX / NIC counters) */
    int m_ucx_counters_collect_enable;
    int m_nic_counters_collect_enable;
 
-#if defined(UCX_STATS_NIC_COUNTERS_ENABLE)
-   /* NIC counters handle */
-   ethtool_stats_handle_t m_eth_stats_handle;
-
-   /* NIC device name */
-   const char *m_nic_ndev_name;
-
-   /* NIC counters database: Number of aggregate-sum counters */
-   uint32_t m_nic_cnts_agrgt_num;
-
-   /* NIC counters index mapping: counter_index->aggregate_sum_index */
-   uint32_t m_nic_cnts_agrgt_mapping[NUM_NIC_CNTS_MAX];
+   int m_verbose;
+};
 
-   /* NIC counters aggregate counters value */
-   uint64_t m_nic_cnts_agrgt[NUM_NIC_AGGREGATE_CNTS_MAX];
+inline void
+ucx_sampling::values_correct(uint32_t first, uint32_t count)
+{
+    uint32_t id;
+
+    for (id = first; id < (first + count); id++) {
+        uint64_t raw_value = *m_raw_values[id];
+
+        if (m_monotonic[id]) {
+            if (unlikely(raw_value < m_prev_raw_values[id])) {
+                m_retired_values[id] += (m_prev_raw_values[id] - raw_value);
+            }
+            m_prev_raw_values[id] = raw_value;
+            raw_value += m_retired_values[id];
+        }
+
+        if (likely(m_refreshed[id]) && (raw_value != m_values[id])) {
+            m_change_counts[id]++;
+            m_total_deltas[id] += (raw_value > m_values[id]) ? (raw_value - m_values[id]) :
+                                                               (m_values[id] - raw_value);
+        }
+        m_refreshed[id] = 1;
+
+        __atomic_store_n(&m_values[id], raw_value, __ATOMIC_RELAXED);
+    }
+}
 
-   /* NIC counters aggregate counters names */
-   string m_nic_cnts_agrgt_names[NUM_NIC_AGGREGATE_CNTS_MAX];
+inline void
+ucx_sampling::backend_refresh_locked(const ucx_sampling_dispatch_entry_t *entry)
+{
+    entry->refresh_backend->refresh();
 
-   /* Total number of NIC counters */
-   uint64_t m_num_nic_counters_total;
+    m_snapshot_seq.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    values_correct(entry->refresh_first, entry->refresh_count);
+    m_snapshot_seq.fetch_add(1, std::memory_order_release);
+}
 
-   /* Decimation count (number of rounds) */
-   uint32_t m_nic_rounds_cnt;
-#endif
+inline uint64_t
+ucx_sampling::counter_value_get(uint32_t id)
+{
+    const ucx_sampling_dispatch_entry_t *entry = &m_dispatch[id];
 
-   /* NIC counters initialized status */
-   int m_nic_counters_initialized;
-};
+    /* First read counter of a backend: refresh its snapshot (unless being refreshed) */
+    if (unlikely(entry->refresh_backend != NULL) && m_refresh_lock.try_lock()) {
+        backend_refresh_locked(entry);
+        m_refresh_lock.unlock();
+    }
 
+    return __atomic_load_n(entry->value, __ATOMIC_RELAXED);
+}
 
 #endif /* _UCX_SAMPLING_H_ */
@@ -0,0 +1,107 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+
+#include <utils.h>
+
+#include "ucx_sampling_backend.h"
+
+ucx_sampling_aggregate::ucx_sampling_aggregate()
+{
+    m_aggrgt_sum_size = 0;
+    memset(m_aggrgt_sum_counters, 0x00, sizeof(m_aggrgt_sum_counters));
+
+    m_aggrgt_sum_counter_names = NULL;
+    m_aggrgt_sum_counter_names_size = 0;
+
+    m_index_enable = 0;
+    const char *index_enable = getenv(ENV_SCOREP_UCX_PLUGIN_AGGREGATE_INDEX_ENABLE);
+    if (index_enable != NULL) {
+        m_index_enable = atoi(index_enable);
+    }
+
+    if (m_index_enable && !ucx_aggregate_index::is_supported()) {
+        printf("Warning: %s requires the UCX destroyed statistics nodes to be kept"
+               " (UCX_STATS_TRIGGER=exit), using ucs_stats_aggregate()\n",
+            ENV_SCOREP_UCX_PLUGIN_AGGREGATE_INDEX_ENABLE);
+        m_index_enable = 0;
+    }
+}
+
+size_t
+ucx_sampling_aggregate::counters_init()
+{
+    return std::min(m_aggrgt_sum_counter_names_size, (size_t)UCX_AGGREGATE_SUM_NUM_COUNTERS_MAX);
+}
+
+void
+ucx_sampling_aggregate::counter_name_get(uint32_t index, string *name)
+{
+    if (index < m_assigned_counter_names.size()) {
+        *name = m_assigned_counter_names[index];
+    }
+    else if ((m_aggrgt_sum_counter_names != NULL) && (index < m_aggrgt_sum_counter_names_size)) {
+        *name = string(m_aggrgt_sum_counter_names[index].class_name) + "_" +
+                    m_aggrgt_sum_counter_names[index].counter_name;
+    }
+}
+
+void
+ucx_sampling_aggregate::refresh()
+{
+    if (m_index_enable) {
+        m_aggrgt_sum_size = m_index.refresh(m_aggrgt_sum_counters, ARRAY_SIZE(m_aggrgt_sum_counters));
+        return;
+    }
+
+    m_aggrgt_sum_size = ucs_stats_aggregate(m_aggrgt_sum_counters, ARRAY_SIZE(m_aggrgt_sum_counters));
+}
+
+int
+ucx_sampling_aggregate::counter_get(uint32_t index, uint64_t *value)
+{
+    int ret = 1;
+
+    if (unlikely(index == 0)) {
+        refresh();
+        if (m_aggrgt_sum_size == 0) {
+            printf("Warning: ucs_stats_aggregate() aggrgt_sum_size == 0");
+            ret = 0;
+            *value = 0;
+        }
+
+        *value = m_aggrgt_sum_counters[0];
+    }
+    else {
+        *value = m_aggrgt_sum_counters[index];
+    }
+
+    return ret;
+}
+
+int
+ucx_sampling_aggregate::counter_names_get(const ucs_stats_aggrgt_counter_name_t **names_p,
+    size_t *size_p)
+{
+    /* Get counters names */
+    ucs_stats_aggregate_get_counter_names(&m_aggrgt_sum_counter_names, &m_aggrgt_sum_counter_names_size);
+
+    *names_p = m_aggrgt_sum_counter_names;
+    *size_p = m_aggrgt_sum_counter_names_size;
+
+    return (m_aggrgt_sum_counter_names_size > 0);
+}
+
+void
+ucx_sampling_aggregate::counter_names_assign(const std::vector<string>& names)
+{
+    m_assigned_counter_names = names;
+    m_aggrgt_sum_counter_names_size = names.size();
+}
@@ -0,0 +1,628 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+#if !defined(_UCX_SAMPLING_BACKEND_H_)
+#define _UCX_SAMPLING_BACKEND_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <unordered_map>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <ucs/stats/libstats.h>
+#include <ucs/stats/stats.h>
+#ifdef __cplusplus
+}
+#endif
+
+#include <plugin_types.h>
+
+#include <scorep_plugin_ucx_config.h>
+#include <ucx_aggregate_index.h>
+#include <ucx_stats_receiver.h>
+
+using namespace std;
+
+/* Maximum number of aggregate-sum counters */
+#define UCX_AGGREGATE_SUM_NUM_COUNTERS_MAX 64
+
+/* Number of aggregate sum counters (per NIC device) */
+#define NUM_NIC_AGGREGATE_CNTS_MAX         1024
+
+/* Maximum number of NIC devices (rails) sampled concurrently */
+#define NUM_NIC_DEVICES_MAX                8
+
+/* Legacy backend: the rank that runs the UCX statistics server */
+#define UCX_SAMPLING_LEGACY_SERVER_RANK    0
+
+/* Legacy backend: largest wait for the dumped statistics (nano seconds) */
+#define UCX_SAMPLING_LEGACY_WAIT_NSEC      100000000
+
+/* Deferred backends: default number of counters registered with temporary names */
+#define UCX_SAMPLING_DEFERRED_COUNTERS_DEFAULT 256
+
+/* Backend names, as used in SCOREP_UCX_PLUGIN_BACKENDS */
+#define UCX_SAMPLING_BACKEND_AGGREGATE     "aggregate"
+#define UCX_SAMPLING_BACKEND_LEGACY        "legacy"
+#define UCX_SAMPLING_BACKEND_DIRECT        "direct"
+#define UCX_SAMPLING_BACKEND_UDP           "udp"
+#define UCX_SAMPLING_BACKEND_ETHTOOL       "ethtool"
+#define UCX_SAMPLING_BACKEND_SYSFS         "sysfs"
+
+/*
+   Sampling backend interface.
+   A backend owns a snapshot of its counters. The snapshot location of every
+   counter is fixed once the counters are initialized, so reading a counter
+   is a plain load from the dispatch table; only the first counter of each
+   backend triggers a (virtual) refresh.
+*/
+class ucx_sampling_backend {
+public:
+   virtual
+   ~ucx_sampling_backend() {}
+
+   /* Backend name */
+   virtual const char *
+   name() const = 0;
+
+   /* Discover the backend counters - returns the number of counters */
+   virtual size_t
+   counters_init() = 0;
+
+   /* Get counter name (without the Score-P metric prefix) */
+   virtual void
+   counter_name_get(uint32_t index, string *name) = 0;
+
+   /* Get the snapshot location of a counter */
+   virtual const uint64_t *
+   counter_value_ptr_get(uint32_t index) = 0;
+
+   /* Refresh the snapshot of all counters */
+   virtual void
+   refresh() = 0;
+
+   /* Is the counter monotonic (cumulative), or a point value? */
+   virtual int
+   counter_is_monotonic(uint32_t index) {
+       return 1;
+   }
+
+   /* Does the refresh wait for another process (e.g. a statistics dump round-trip)? */
+   virtual int
+   refresh_is_blocking() const {
+       return 0;
+   }
+
+   /*
+      Is the counters discovery deferred to after the application's MPI_Init
+      (UCX objects are created by MPI_Init)? counters_init() then returns a
+      fixed number of counters with temporary names, and counters_enumerate()
+      discovers the counters.
+   */
+   virtual int
+   counters_deferred() const {
+       return 0;
+   }
+
+   /* Discover the counters of a deferred backend - returns the number of counters */
+   virtual size_t
+   counters_enumerate(int mpi_rank) {
+       return 0;
+   }
+
+protected:
+   /* Number of counters of a deferred backend (SCOREP_UCX_PLUGIN_OBJECT_COUNTERS_NUM) */
+   static size_t
+   deferred_counters_num_get() {
+       const char *num_counters = getenv(ENV_SCOREP_UCX_PLUGIN_OBJECT_COUNTERS_NUM);
+
+       return (num_counters != NULL) ? strtoul(num_counters, NULL, 0) :
+                  UCX_SAMPLING_DEFERRED_COUNTERS_DEFAULT;
+   }
+
+   /* Temporary name of a counter of a deferred backend: <backend>_<template><index> */
+   void
+   deferred_counter_name_get(uint32_t index, string *name) {
+       TEMPORARY_UCX_COUNTER_NAME_GEN(*name, string(this->name()), *name, index);
+   }
+};
+
+/* Dispatch table entry: Score-P counter ID -> backend snapshot */
+typedef struct ucx_sampling_dispatch_entry {
+   /* Counter value location (monotonic corrected snapshot) */
+   const uint64_t *value;
+
+   /* Backend to refresh before reading (first read counter of a backend), or NULL */
+   ucx_sampling_backend *refresh_backend;
+
+   /* Refreshing counter: the first counter ID and the number of the backend counters */
+   uint32_t refresh_first;
+   uint32_t refresh_count;
+} ucx_sampling_dispatch_entry_t;
+
+/*********************************/
+/* UCX aggregate-sum backend     */
+/*********************************/
+class ucx_sampling_aggregate : public ucx_sampling_backend {
+public:
+   ucx_sampling_aggregate();
+
+   const char *
+   name() const { return UCX_SAMPLING_BACKEND_AGGREGATE; }
+
+   size_t
+   counters_init();
+
+   void
+   counter_name_get(uint32_t index, string *name);
+
+   const uint64_t *
+   counter_value_ptr_get(uint32_t index) {
+       return &m_aggrgt_sum_counters[index];
+   }
+
+   void
+   refresh();
+
+   /* Get current aggregate-sum value of a certain index */
+   int
+   counter_get(uint32_t index, uint64_t *value);
+
+   /* Get current aggregate-sum counter names of all indices */
+   int
+   counter_names_get(const ucs_stats_aggrgt_counter_name_t **names_p, size_t *size_p);
+
+   /* Assign the counter names known in advance (e.g. from a previous run) */
+   void
+   counter_names_assign(const std::vector<string>& names);
+
+   size_t
+   total_counters_num_get() {
+       return m_aggrgt_sum_size;
+   }
+
+private:
+   /* size of aggregate-sum counters list */
+   size_t m_aggrgt_sum_size;
+
+   /* Aggregate-sum counters list */
+   ucs_stats_counter_t m_aggrgt_sum_counters[UCX_AGGREGATE_SUM_NUM_COUNTERS_MAX];
+
+   /* The counters names */
+   const ucs_stats_aggrgt_counter_name_t *m_aggrgt_sum_counter_names;
+
+   /* The size of the counters names */
+   size_t m_aggrgt_sum_counter_names_size;
+
+   /* Counter names assigned in advance */
+   std::vector<string> m_assigned_counter_names;
+
+   /* Plugin-side aggregate-sum (cached node index) instead of ucs_stats_aggregate() */
+   int m_index_enable;
+   ucx_aggregate_index m_index;
+};
+
+/*********************************/
+/* UCX legacy statistics tree    */
+/* backend (via the UDP server)  */
+/*********************************/
+class ucx_sampling_legacy : public ucx_sampling_backend {
+public:
+   ucx_sampling_legacy();
+
+   ~ucx_sampling_legacy();
+
+   const char *
+   name() const { return UCX_SAMPLING_BACKEND_LEGACY; }
+
+   size_t
+   counters_init();
+
+   void
+   counter_name_get(uint32_t index, string *name);
+
+   const uint64_t *
+   counter_value_ptr_get(uint32_t index) {
+       return &m_values[index];
+   }
+
+   void
+   refresh();
+
+   int
+   counters_deferred() const {
+       return 1;
+   }
+
+   size_t
+   counters_enumerate(int mpi_rank);
+
+   /* Waits for the statistics dump of UCX (UDP) */
+   int
+   refresh_is_blocking() const {
+       return 1;
+   }
+
+   int
+   server_start(int port);
+
+   /*
+      Update & initialize counters from UCX statistics.
+
+      returns: 1 if the statistics were received, 0 on timeout (the counters are not updated).
+   */
+   int
+   all_counters_update(scorep_counters_list_t *new_counters_list,
+       int initialize_counters_enable);
+
+private:
+
+   uint64_t
+   recursive_scan_counters_list(ucs_stats_node_t *root,
+       ucs_list_link_t *stats,
+       const char *counters_root_name,
+       scorep_counters_list_t *ucx_counters_list,
+       uint64_t num_objects,
+       uint64_t& num_counters,
+       int initialize_counters_enable);
+
+   /* Scan the counters list to see if there are any new counters */
+   void
+   scan_counters_list(ucs_list_link_t *stats,
+       const char *counters_root_name,
+       scorep_counters_list_t *ucx_counters_list,
+       int initialize_counters_enable);
+
+private:
+   /* Handle for UCX statistics server */
+   ucs_stats_server_h m_ucx_stats_server;
+
+   /*
+      Enable statistics server on process,
+      if port bound successfully
+   */
+   int m_statistics_server_process_enable;
+
+   /* Statistics not received in time (reported once) */
+   int m_wait_timeout_reported;
+
+   /* Counters list (statistics server) */
+   scorep_counters_list_t m_counters_list;
+
+   /* Backend snapshot (temporary counters until enumerated) and the enumerated counters */
+   std::vector<uint64_t> m_values;
+   size_t m_num_enumerated;
+};
+
+/* Direct backend: counter array copy retries (until two consecutive copies match) */
+#define UCX_SAMPLING_DIRECT_COPY_RETRIES   4
+
+/*********************************/
+/* UCX statistics tree backend   */
+/* (in-process, direct walk)     */
+/*********************************/
+/*
+   Per UCX object counters, as the legacy backend, read in place from the live
+   statistics tree (ucs_stats_get_root()) instead of the ucs_stats_dump() ->
+   UDP -> statistics server round-trip. Each node counter array is copied until
+   two consecutive copies match (consistent at the counter array granularity).
+
+   The objects are discovered after MPI_Init (deferred backend). A refresh
+   matches the nodes of the tree to the discovered objects by identity (node
+   and class addresses), so a destroyed object keeps its last values, and an
+   object created later is not recorded.
+   Note, that the live UCX statistics tree is walked without the UCX stats lock.
+*/
+class ucx_sampling_direct : public ucx_sampling_backend {
+public:
+   ucx_sampling_direct();
+
+   /*
+      Can the live tree be walked with this UCX configuration? The walk does
+      not take the UCX stats lock: the destroyed nodes must not be freed.
+   */
+   static int
+   is_supported();
+
+   const char *
+   name() const { return UCX_SAMPLING_BACKEND_DIRECT; }
+
+   size_t
+   counters_init();
+
+   void
+   counter_name_get(uint32_t index, string *name);
+
+   const uint64_t *
+   counter_value_ptr_get(uint32_t index) {
+       return &m_values[index];
+   }
+
+   void
+   refresh();
+
+   int
+   counters_deferred() const {
+       return 1;
+   }
+
+   size_t
+   counters_enumerate(int mpi_rank);
+
+private:
+   /* Discovered object: stats class and first counter index */
+   typedef struct direct_object {
+       const ucs_stats_class_t *cls;
+       uint32_t first;
+   } direct_object_t;
+
+   /* Record the objects (pre-order) and their counter names, up to the backend counters */
+   void
+   objects_scan(const ucs_stats_node_t *node, const string& counters_root_name);
+
+   /* Copy the counters of the discovered objects of a subtree */
+   void
+   objects_refresh(const ucs_stats_node_t *node);
+
+   /* Copy a node counter array (consistent at the array granularity) */
+   static void
+   counters_copy(const ucs_stats_node_t *node, uint64_t *values);
+
+private:
+   /* Discovered objects, by node address */
+   std::unordered_map<const ucs_stats_node_t *, direct_object_t> m_objects;
+   uint32_t m_num_objects;
+
+   /* Counters names of the discovered objects and values (backend snapshot) */
+   std::vector<string> m_names;
+   std::vector<uint64_t> m_values;
+
+   /* Objects not discovered (over the backend counters, or created later), reported once */
+   int m_objects_dropped;
+};
+
+/*********************************/
+/* UCX statistics per node       */
+/* receiver backend (UDP)        */
+/*********************************/
+/*
+   Aggregate-sum counters of all the UCX processes of the node that send their
+   statistics to the job port (UCX_STATS_DEST=udp:<node>:<port>, see the
+   ucx_stats_port tool). Available on the node receiver process only.
+*/
+class ucx_sampling_udp : public ucx_sampling_backend {
+public:
+   const char *
+   name() const { return UCX_SAMPLING_BACKEND_UDP; }
+
+   size_t
+   counters_init();
+
+   /* Get counter name: node_<class>_<counter> */
+   void
+   counter_name_get(uint32_t index, string *name);
+
+   const uint64_t *
+   counter_value_ptr_get(uint32_t index) {
+       return &m_values[index];
+   }
+
+   void
+   refresh() {
+       m_receiver.counters_sum(m_values, m_num_counters);
+   }
+
+private:
+   ucx_stats_receiver m_receiver;
+
+   const ucs_stats_aggrgt_counter_name_t *m_names;
+   size_t m_num_counters;
+   uint64_t m_values[UCX_AGGREGATE_SUM_NUM_COUNTERS_MAX];
+};
+
+/* NIC aggregate counter statistics (across the member queues of an aggregate) */
+typedef enum nic_counter_kind {
+   NIC_COUNTER_KIND_SUM = 0,
+   NIC_COUNTER_KIND_MIN,
+   NIC_COUNTER_KIND_MAX,
+   /* Coefficient of variation, in parts per thousand */
+   NIC_COUNTER_KIND_CV,
+   NIC_COUNTER_KIND_LAST
+} nic_counter_kind_t;
+
+/*
+   Per NIC device (rail) counters database. The tables are sized from the
+   device statistics count (ETHTOOL_GSSET_INFO) and the number of aggregates,
+   when the counters are initialized (the refresh buffers do not move after).
+*/
+typedef struct nic_device {
+   /* NIC device (netdev) name */
+   string name;
+
+   /* ethtool statistics strings and values */
+   struct ethtool_gstrings *strings;
+   struct ethtool_stats *stats;
+
+   /* Number of aggregate-sum counters */
+   uint32_t cnts_agrgt_num;
+
+   /* Counter index mapping: counter_index->aggregate_sum_index */
+   std::vector<uint32_t> cnts_agrgt_mapping;
+
+   /* Number of counters that are members of a selected aggregate */
+   uint32_t cnts_members_num;
+
+   /* Compiled filter: indices of the counters read on every refresh */
+   std::vector<uint32_t> cnts_members;
+
+   /* Member counters values at the previous refresh (imbalance intervals) */
+   std::vector<uint64_t> cnts_members_prev;
+   int cnts_members_prev_valid;
+
+   /* Aggregate counters value (refresh buffer) */
+   std::vector<uint64_t> cnts_agrgt;
+
+   /*
+      Aggregate counters imbalance across member queues (refresh buffer): of
+      the queue increments since the previous refresh, and their sum.
+   */
+   std::vector<uint64_t> cnts_agrgt_min;
+   std::vector<uint64_t> cnts_agrgt_max;
+   std::vector<uint64_t> cnts_agrgt_cv;
+   std::vector<uint64_t> cnts_agrgt_interval;
+   std::vector<double> cnts_agrgt_sum_sqr;
+
+   /* Number of member counters (queues) of each aggregate */
+   std::vector<uint32_t> cnts_agrgt_members_num;
+
+   /* Aggregate counters names */
+   std::vector<string> cnts_agrgt_names;
+
+   /* Total number of NIC counters */
+   size_t num_counters_total;
+} nic_device_t;
+
+/*
+   Build the NIC devices list:
+   1. SCOREP_UCX_PLUGIN_NIC_DEVICE_NAME - comma separated list of interfaces.
+   2. Otherwise, auto-discover the interfaces from UCX_NET_DEVICES.
+*/
+void
+nic_devices_discover(std::vector<string> *ndev_names);
+
+/*********************************/
+/* NIC ethtool counters backend  */
+/*********************************/
+class ucx_sampling_ethtool : public ucx_sampling_backend {
+public:
+   ucx_sampling_ethtool();
+
+   ~ucx_sampling_ethtool();
+
+   const char *
+   name() const { return UCX_SAMPLING_BACKEND_ETHTOOL; }
+
+   size_t
+   counters_init();
+
+   /* Get NIC counter name: nic_<device>_cnt_<aggregate counter name> */
+   void
+   counter_name_get(uint32_t index, string *name);
+
+   const uint64_t *
+   counter_value_ptr_get(uint32_t index);
+
+   void
+   refresh();
+
+   /* Only the aggregate-sum counters are monotonic (not min/max/cv) */
+   int
+   counter_is_monotonic(uint32_t index) {
+       return (m_nic_cnts_kind[index] == NIC_COUNTER_KIND_SUM);
+   }
+
+   void
+   nic_counter_name_filter(string *name);
+
+   int
+   aggt_sum_counter_name_index_find(string *cnt_name, string *aggt_cnts_names, uint32_t aggt_cnt_num,
+        uint32_t *agrgt_counter_index);
+
+private:
+   /* Allocate the counters database of a NIC device */
+   void
+   nic_device_add(const string& ndev_name);
+
+   /* Read NIC counters into the device stats buffer ==> Update statistics */
+   int
+   nic_counters_update(nic_device_t *nic_device, size_t *num_counters);
+
+   /* Is a NIC aggregate-sum counter requested by the user filter? */
+   int
+   nic_counter_filter_match(const string& agrgt_name);
+
+   /* Build the counters aggregate list of a single NIC device */
+   uint32_t
+   nic_device_counters_aggregate(nic_device_t *nic_device);
+
+   /* Refresh a NIC device and re-calculate its aggregate-sum counters */
+   void
+   nic_device_counters_refresh(nic_device_t *nic_device);
+
+private:
+   /* Socket used for the SIOCETHTOOL requests */
+   int m_ethtool_fd;
+
+   /* NIC devices (rails), each with its own counters database */
+   std::vector<nic_device_t *> m_nic_devices;
+
+   /* NIC counters database: Number of aggregate-sum counters (all devices) */
+   uint32_t m_nic_cnts_agrgt_num;
+
+   /* NIC counters index mapping: nic_counter_index->device */
+   std::vector<nic_device_t *> m_nic_cnts_device;
+
+   /* NIC counters index mapping: nic_counter_index->device aggregate index */
+   std::vector<uint32_t> m_nic_cnts_device_index;
+
+   /* NIC counters index mapping: nic_counter_index->aggregate statistic */
+   std::vector<uint8_t> m_nic_cnts_kind;
+
+   /* Report per-queue imbalance (min, max, CV) next to each aggregate-sum */
+   int m_nic_imbalance_enable;
+
+   /* Requested NIC aggregate-sum counters (name patterns), empty for all */
+   std::vector<string> m_nic_cnts_filter;
+
+   /* Decimation count (number of rounds) */
+   uint32_t m_nic_rounds_cnt;
+};
+
+/*********************************/
+/* NIC sysfs counters backend    */
+/*********************************/
+class ucx_sampling_sysfs : public ucx_sampling_backend {
+public:
+   ucx_sampling_sysfs();
+
+   ~ucx_sampling_sysfs();
+
+   const char *
+   name() const { return UCX_SAMPLING_BACKEND_SYSFS; }
+
+   size_t
+   counters_init();
+
+   /* Get counter name: sysfs_<device>_<counter file> */
+   void
+   counter_name_get(uint32_t index, string *name);
+
+   const uint64_t *
+   counter_value_ptr_get(uint32_t index) {
+       return &m_values[index];
+   }
+
+   void
+   refresh();
+
+private:
+   /* Add all the counter files of a sysfs directory */
+   void
+   counters_dir_add(const string& dir_path, const string& name_prefix);
+
+private:
+   /* Counter files (kept open), names and values */
+   std::vector<int> m_fds;
+   std::vector<string> m_names;
+   std::vector<uint64_t> m_values;
+
+   /* Decimation count (number of rounds) */
+   uint32_t m_rounds_cnt;
+};
+
+#endif /* _UCX_SAMPLING_BACKEND_H_ */
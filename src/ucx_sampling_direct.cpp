@@ -0,0 +1,159 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+
+#include <utils.h>
+
+#include "ucx_sampling_backend.h"
+#include "ucx_stats_tree.h"
+
+ucx_sampling_direct::ucx_sampling_direct()
+{
+    m_num_objects = 0;
+    m_objects_dropped = 0;
+}
+
+int
+ucx_sampling_direct::is_supported()
+{
+    return ucx_stats_tree_nodes_persistent();
+}
+
+/*
+   The UCX objects are created by the application's MPI_Init: the counters are
+   registered with temporary names, and discovered by counters_enumerate().
+*/
+size_t
+ucx_sampling_direct::counters_init()
+{
+    if (!is_supported()) {
+        printf("Warning: UCX direct backend requires the UCX destroyed statistics nodes to be"
+               " kept (UCX_STATS_TRIGGER=exit), disabled\n");
+        return 0;
+    }
+
+    m_values.assign(deferred_counters_num_get(), 0);
+
+    return m_values.size();
+}
+
+/*
+   The direct backend is available when the UCX statistics are enabled
+   (UCX_STATS_DEST), on every process: no statistics server is required.
+*/
+size_t
+ucx_sampling_direct::counters_enumerate(int mpi_rank)
+{
+    ucs_stats_node_t *root = ucs_stats_get_root();
+
+    if ((root == NULL) || m_values.empty()) {
+        return 0;
+    }
+
+    if (m_objects.empty()) {
+        objects_scan(root, "cnt");
+        if (m_objects_dropped) {
+            printf("Warning: UCX direct backend: %u objects recorded, the next ones are not (%s)\n",
+                m_num_objects, ENV_SCOREP_UCX_PLUGIN_OBJECT_COUNTERS_NUM);
+        }
+        objects_refresh(root);
+    }
+
+    return m_names.size();
+}
+
+void
+ucx_sampling_direct::counter_name_get(uint32_t index, string *name)
+{
+    if (index < m_names.size()) {
+        *name = m_names[index];
+    }
+    else {
+        /* Not enumerated (yet): temporary name */
+        deferred_counter_name_get(index, name);
+    }
+}
+
+void
+ucx_sampling_direct::objects_scan(const ucs_stats_node_t *node, const string& counters_root_name)
+{
+    ucs_stats_node_t *child;
+    direct_object_t object;
+    unsigned k;
+
+    UCX_STATS_TREE_FOR_EACH_CHILD(child, node) {
+        string counter_name_prefix = counters_root_name + "-" + child->cls->name;
+        string object_name = "ucx-object-" + std::to_string(m_num_objects) + "-" +
+                                 counter_name_prefix;
+
+        /* Pre-order: the first objects that fit in the backend counters */
+        if (m_objects_dropped || ((m_names.size() + child->cls->num_counters) > m_values.size())) {
+            m_objects_dropped = 1;
+            return;
+        }
+
+        object.cls = child->cls;
+        object.first = m_names.size();
+        m_objects[child] = object;
+        m_num_objects++;
+
+        for (k = 0; k < child->cls->num_counters; k++) {
+            m_names.push_back(object_name + "-" + child->cls->counter_names[k]);
+        }
+
+        objects_scan(child, counter_name_prefix);
+    }
+}
+
+void
+ucx_sampling_direct::counters_copy(const ucs_stats_node_t *node, uint64_t *values)
+{
+    size_t size = node->cls->num_counters * sizeof(node->counters[0]);
+    uint32_t retry;
+
+    for (retry = 0; retry < UCX_SAMPLING_DIRECT_COPY_RETRIES; retry++) {
+        memcpy(values, (const void *)node->counters, size);
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        /* Not updated during the copy */
+        if (memcmp(values, (const void *)node->counters, size) == 0) {
+            return;
+        }
+    }
+}
+
+void
+ucx_sampling_direct::objects_refresh(const ucs_stats_node_t *node)
+{
+    ucs_stats_node_t *child;
+
+    UCX_STATS_TREE_FOR_EACH_CHILD(child, node) {
+        auto it = m_objects.find(child);
+
+        /* Same object: node and class (a reused node address of another class is not) */
+        if ((it != m_objects.end()) && (it->second.cls == child->cls)) {
+            counters_copy(child, &m_values[it->second.first]);
+        }
+
+        objects_refresh(child);
+    }
+}
+
+void
+ucx_sampling_direct::refresh()
+{
+    ucs_stats_node_t *root = ucs_stats_get_root();
+
+    if (unlikely(root == NULL) || m_objects.empty()) {
+        return;
+    }
+
+    objects_refresh(root);
+}
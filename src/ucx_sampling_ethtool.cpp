@@ -0,0 +1,560 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <algorithm>
+#include <math.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <linux/ethtool.h>
+#include <linux/sockios.h>
+
+#include <utils.h>
+
+#include "ucx_sampling_backend.h"
+
+/*
+   Resolve an IB device (as used in UCX_NET_DEVICES, e.g. "mlx5_0:1") to its
+   network interface name. Returns an empty string if not found.
+*/
+static string
+nic_ib_device_to_netdev(const string& ib_dev, int port)
+{
+    string net_path = "/sys/class/infiniband/" + ib_dev + "/device/net";
+    string netdev;
+    DIR *dir;
+    struct dirent *entry;
+
+    dir = opendir(net_path.c_str());
+    if (dir == NULL) {
+        return netdev;
+    }
+
+    while ((entry = readdir(dir)) != NULL) {
+        string dev_port_path;
+        FILE *file;
+        int dev_port = 0;
+
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+
+        /* A PCI function may expose several ports, match the requested one */
+        dev_port_path = net_path + "/" + entry->d_name + "/dev_port";
+        file = fopen(dev_port_path.c_str(), "r");
+        if (file) {
+            if (fscanf(file, "%d", &dev_port) != 1) {
+                dev_port = 0;
+            }
+            fclose(file);
+        }
+
+        if ((netdev.empty()) || (dev_port == (port - 1))) {
+            netdev = entry->d_name;
+        }
+    }
+
+    closedir(dir);
+    return netdev;
+}
+
+void
+nic_devices_discover(std::vector<string> *ndev_names)
+{
+    const char *ndev_names_env = getenv(ENV_SCOREP_UCX_PLUGIN_NIC_DEVICE_NAME);
+    const char *ucx_net_devices = getenv("UCX_NET_DEVICES");
+
+    if ((ndev_names_env != NULL) && (strcmp(ndev_names_env, "auto") != 0)) {
+        for (auto& ndev_name : split(ndev_names_env, ',')) {
+            if (!ndev_name.empty()) {
+                ndev_names->push_back(ndev_name);
+            }
+        }
+        return;
+    }
+
+    /* Auto-discovery requires explicit UCX devices (not "all") */
+    if ((ucx_net_devices == NULL) || (strcmp(ucx_net_devices, "all") == 0)) {
+        printf("Warning: NIC devices auto-discovery requires UCX_NET_DEVICES to be set\n");
+        return;
+    }
+
+    for (auto& ucx_dev : split(ucx_net_devices, ',')) {
+        std::vector<string> dev_port = split(ucx_dev, ':');
+        string netdev;
+        int port = 1;
+
+        if (dev_port.empty()) {
+            continue;
+        }
+
+        if (dev_port.size() > 1) {
+            port = atoi(dev_port[1].c_str());
+        }
+
+        /* UCX device may be an IB device (mlx5_0:1) or a netdev (eth0) */
+        netdev = nic_ib_device_to_netdev(dev_port[0], port);
+        if (netdev.empty()) {
+            netdev = dev_port[0];
+        }
+
+        if (std::find(ndev_names->begin(), ndev_names->end(), netdev) == ndev_names->end()) {
+            ndev_names->push_back(netdev);
+        }
+    }
+}
+
+ucx_sampling_ethtool::ucx_sampling_ethtool()
+{
+    std::vector<string> ndev_names;
+
+    /* Initiaize NIC counters database */
+    m_nic_cnts_agrgt_num = 0;
+    m_nic_rounds_cnt = 0;
+
+    /* Per-queue imbalance metrics? (disabled by default) */
+    m_nic_imbalance_enable = 0;
+    const char *nic_imbalance_enable = getenv(ENV_SCOREP_UCX_PLUGIN_NIC_IMBALANCE_ENABLE);
+    if (nic_imbalance_enable != NULL) {
+        m_nic_imbalance_enable = atoi(nic_imbalance_enable);
+    }
+
+    /* Requested NIC aggregate-sum counters */
+    const char *nic_cnts_filter = getenv(ENV_SCOREP_UCX_PLUGIN_NIC_COUNTERS_FILTER);
+    if (nic_cnts_filter != NULL) {
+        for (auto& pattern : split(nic_cnts_filter, ',')) {
+            if (!pattern.empty()) {
+                m_nic_cnts_filter.push_back(pattern);
+            }
+        }
+    }
+
+    m_ethtool_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (m_ethtool_fd < 0) {
+        printf("Warning: ethtool socket() failed! errno=%d\n", errno);
+        return;
+    }
+
+    /* allocate the statistics buffers of each device */
+    nic_devices_discover(&ndev_names);
+    for (auto& ndev_name : ndev_names) {
+        nic_device_add(ndev_name);
+    }
+}
+
+ucx_sampling_ethtool::~ucx_sampling_ethtool()
+{
+    for (auto nic_device : m_nic_devices) {
+        free(nic_device->strings);
+        free(nic_device->stats);
+        delete nic_device;
+    }
+    m_nic_devices.clear();
+
+    if (m_ethtool_fd >= 0) {
+        close(m_ethtool_fd);
+    }
+}
+
+/* Issue a SIOCETHTOOL request on a NIC device */
+static int
+nic_ethtool_ioctl(int fd, const string& ndev_name, void *cmd)
+{
+    struct ifreq ifr;
+
+    memset(&ifr, 0x00, sizeof(ifr));
+    strncpy(ifr.ifr_name, ndev_name.c_str(), IFNAMSIZ - 1);
+    ifr.ifr_data = (char *)cmd;
+
+    return ioctl(fd, SIOCETHTOOL, &ifr);
+}
+
+void
+ucx_sampling_ethtool::nic_device_add(const string& ndev_name)
+{
+    nic_device_t *nic_device;
+    /* ethtool_sset_info followed by the size of the single requested set */
+    uint64_t sset_info_buf[(sizeof(struct ethtool_sset_info) / sizeof(uint64_t)) + 1];
+    struct ethtool_sset_info *sset_info = (struct ethtool_sset_info *)sset_info_buf;
+    uint32_t n_stats_dev;
+
+    if (m_nic_devices.size() >= NUM_NIC_DEVICES_MAX) {
+        printf("Warning: NIC device %s ignored, maximum of %d devices supported\n",
+            ndev_name.c_str(), NUM_NIC_DEVICES_MAX);
+        return;
+    }
+
+    /* Get the number of statistics of the device */
+    memset(sset_info_buf, 0x00, sizeof(sset_info_buf));
+    sset_info->cmd = ETHTOOL_GSSET_INFO;
+    sset_info->sset_mask = 1ULL << ETH_SS_STATS;
+    if ((nic_ethtool_ioctl(m_ethtool_fd, ndev_name, sset_info) != 0) ||
+        (sset_info->sset_mask == 0)) {
+        printf("Warning: ETHTOOL_GSSET_INFO(%s) failed! errno=%d\n", ndev_name.c_str(), errno);
+        return;
+    }
+
+    n_stats_dev = sset_info->data[0];
+
+    nic_device = new nic_device_t();
+    nic_device->name = ndev_name;
+    nic_device->strings = (struct ethtool_gstrings *)calloc(1,
+        sizeof(struct ethtool_gstrings) + (n_stats_dev * ETH_GSTRING_LEN));
+    nic_device->stats = (struct ethtool_stats *)calloc(1,
+        sizeof(struct ethtool_stats) + (n_stats_dev * sizeof(uint64_t)));
+    if ((nic_device->strings == NULL) || (nic_device->stats == NULL)) {
+        printf("Warning: NIC device %s: could not allocate statistics buffers\n",
+            ndev_name.c_str());
+        goto err_free;
+    }
+
+    /* Get the statistics names */
+    nic_device->strings->cmd = ETHTOOL_GSTRINGS;
+    nic_device->strings->string_set = ETH_SS_STATS;
+    nic_device->strings->len = n_stats_dev;
+    if (nic_ethtool_ioctl(m_ethtool_fd, ndev_name, nic_device->strings) != 0) {
+        printf("Warning: ETHTOOL_GSTRINGS(%s) failed! errno=%d\n", ndev_name.c_str(), errno);
+        goto err_free;
+    }
+
+    nic_device->stats->n_stats = n_stats_dev;
+    nic_device->num_counters_total = n_stats_dev;
+    nic_device->cnts_agrgt_mapping.resize(n_stats_dev);
+
+    DEBUG_PRINT("NIC device added: %s, n_stats=%u\n", ndev_name.c_str(), n_stats_dev);
+
+    m_nic_devices.push_back(nic_device);
+    return;
+
+err_free:
+    free(nic_device->strings);
+    free(nic_device->stats);
+    delete nic_device;
+}
+
+/*
+   Query device counters and store them in the device stats buffer.
+   Note, that ETHTOOL_GSTATS always returns the complete statistics block,
+   the requested counters are selected by the compiled members list.
+*/
+int
+ucx_sampling_ethtool::nic_counters_update(nic_device_t *nic_device, size_t *num_counters)
+{
+    nic_device->stats->cmd = ETHTOOL_GSTATS;
+    if (nic_ethtool_ioctl(m_ethtool_fd, nic_device->name, nic_device->stats) != 0) {
+        printf("Warning: ETHTOOL_GSTATS(%s) failed! errno=%d\n", nic_device->name.c_str(), errno);
+        *num_counters = 0;
+        return -1;
+    }
+
+    *num_counters = std::min((size_t)nic_device->stats->n_stats,
+                             nic_device->cnts_agrgt_mapping.size());
+    return 0;
+}
+
+void
+ucx_sampling_ethtool::nic_device_counters_refresh(nic_device_t *nic_device)
+{
+    const uint64_t *data;
+    size_t num_counters;
+    uint32_t counter_index;
+    uint32_t i;
+
+    if ((nic_counters_update(nic_device, &num_counters) != 0) ||
+        (unlikely(num_counters < nic_device->num_counters_total))) {
+        /* Query failed or device statistics shrunk (e.g. channels reconfigured) */
+        return;
+    }
+
+    /* Re-calculate the aggregate-sum of the requested counters only */
+    std::fill(nic_device->cnts_agrgt.begin(), nic_device->cnts_agrgt.end(), 0);
+
+    data = (const uint64_t *)nic_device->stats->data;
+    if (!m_nic_imbalance_enable) {
+        for (i = 0; i < nic_device->cnts_members_num; i++) {
+            counter_index = nic_device->cnts_members[i];
+            nic_device->cnts_agrgt[nic_device->cnts_agrgt_mapping[counter_index]] += data[counter_index];
+        }
+        return;
+    }
+
+    /*
+       Sum, then min, max and sum of squares of the queue increments since the
+       previous refresh in the same pass (the cumulative totals would hide the
+       imbalance of the current interval behind the history).
+    */
+    for (i = 0; i < nic_device->cnts_agrgt_num; i++) {
+        nic_device->cnts_agrgt_min[i] = UINT64_MAX;
+        nic_device->cnts_agrgt_max[i] = 0;
+        nic_device->cnts_agrgt_interval[i] = 0;
+        nic_device->cnts_agrgt_sum_sqr[i] = 0;
+    }
+
+    for (i = 0; i < nic_device->cnts_members_num; i++) {
+        uint64_t value;
+        uint64_t delta;
+        uint32_t agrgt_counter_index;
+
+        counter_index = nic_device->cnts_members[i];
+        agrgt_counter_index = nic_device->cnts_agrgt_mapping[counter_index];
+        value = data[counter_index];
+
+        /* A queue counter reset (e.g. channels reconfigured) restarts from 0 */
+        delta = (value >= nic_device->cnts_members_prev[i]) ?
+                (value - nic_device->cnts_members_prev[i]) : value;
+        nic_device->cnts_members_prev[i] = value;
+
+        nic_device->cnts_agrgt[agrgt_counter_index] += value;
+        nic_device->cnts_agrgt_interval[agrgt_counter_index] += delta;
+        nic_device->cnts_agrgt_min[agrgt_counter_index] =
+            std::min(nic_device->cnts_agrgt_min[agrgt_counter_index], delta);
+        nic_device->cnts_agrgt_max[agrgt_counter_index] =
+            std::max(nic_device->cnts_agrgt_max[agrgt_counter_index], delta);
+        nic_device->cnts_agrgt_sum_sqr[agrgt_counter_index] += (double)delta * (double)delta;
+    }
+
+    /* The first refresh only sets the baseline of the intervals */
+    if (!nic_device->cnts_members_prev_valid) {
+        nic_device->cnts_members_prev_valid = 1;
+        std::fill(nic_device->cnts_agrgt_min.begin(), nic_device->cnts_agrgt_min.end(), 0);
+        std::fill(nic_device->cnts_agrgt_max.begin(), nic_device->cnts_agrgt_max.end(), 0);
+        std::fill(nic_device->cnts_agrgt_cv.begin(), nic_device->cnts_agrgt_cv.end(), 0);
+        return;
+    }
+
+    /* Coefficient of variation = stddev / mean, in parts per thousand */
+    for (i = 0; i < nic_device->cnts_agrgt_num; i++) {
+        double n = (double)nic_device->cnts_agrgt_members_num[i];
+        double mean = (double)nic_device->cnts_agrgt_interval[i] / n;
+        double variance = (nic_device->cnts_agrgt_sum_sqr[i] / n) - (mean * mean);
+
+        nic_device->cnts_agrgt_cv[i] = 0;
+        if ((mean > 0) && (variance > 0)) {
+            nic_device->cnts_agrgt_cv[i] = (uint64_t)((sqrt(variance) / mean) * 1000.0);
+        }
+    }
+}
+
+void
+ucx_sampling_ethtool::refresh()
+{
+    /* NIC counters acquisition is decimated in order to reduce overhead */
+    if ((m_nic_rounds_cnt & (NIC_COUNTERS_UPDATE_DECIMATION-1)) == 0) {
+        for (auto nic_device : m_nic_devices) {
+            nic_device_counters_refresh(nic_device);
+        }
+    }
+    m_nic_rounds_cnt++;
+}
+
+const uint64_t *
+ucx_sampling_ethtool::counter_value_ptr_get(uint32_t index)
+{
+    nic_device_t *nic_device = m_nic_cnts_device[index];
+    uint32_t device_index = m_nic_cnts_device_index[index];
+
+    switch (m_nic_cnts_kind[index]) {
+    case NIC_COUNTER_KIND_MIN:
+        return &nic_device->cnts_agrgt_min[device_index];
+    case NIC_COUNTER_KIND_MAX:
+        return &nic_device->cnts_agrgt_max[device_index];
+    case NIC_COUNTER_KIND_CV:
+        return &nic_device->cnts_agrgt_cv[device_index];
+    default:
+        return &nic_device->cnts_agrgt[device_index];
+    }
+}
+
+void
+ucx_sampling_ethtool::counter_name_get(uint32_t index, string *name)
+{
+    static const char *kind_suffix[NIC_COUNTER_KIND_LAST] = {"", "_min", "_max", "_cv_permille"};
+
+    if (index < m_nic_cnts_agrgt_num) {
+        *name = "nic_" + m_nic_cnts_device[index]->name + "_cnt_" +
+                    m_nic_cnts_device[index]->cnts_agrgt_names[m_nic_cnts_device_index[index]] +
+                    kind_suffix[m_nic_cnts_kind[index]];
+    }
+}
+
+void
+ucx_sampling_ethtool::nic_counter_name_filter(string *name)
+{
+    std::string filter_chars = "0123456789:";
+
+    name->erase(
+              remove_if(name->begin(), name->end(),
+                        [&filter_chars](const char &c) {
+                            return filter_chars.find(c) != std::string::npos;
+                        }),
+                        name->end());
+}
+
+int
+ucx_sampling_ethtool::aggt_sum_counter_name_index_find(string *cnt_name, string *aggt_cnts_names, uint32_t aggt_cnt_num,
+                   uint32_t *agrgt_counter_index)
+{
+    uint32_t i;
+
+    for (i = 0; i < aggt_cnt_num; i++) {
+        if (*cnt_name == aggt_cnts_names[i]) {
+            *agrgt_counter_index = i;
+            return 1;
+        }
+    }
+
+    /* Not found */
+    *agrgt_counter_index = -1;
+
+    return 0;
+}
+
+int
+ucx_sampling_ethtool::nic_counter_filter_match(const string& agrgt_name)
+{
+    if (m_nic_cnts_filter.empty()) {
+        return 1;
+    }
+
+    for (auto& pattern : m_nic_cnts_filter) {
+        if (fnmatch(pattern.c_str(), agrgt_name.c_str(), 0) == 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+   Builds the aggregate-sum counters list of a single NIC device.
+
+   returns: The number of counters in the device aggregate list.
+*/
+uint32_t
+ucx_sampling_ethtool::nic_device_counters_aggregate(nic_device_t *nic_device)
+{
+    string cnt_name;
+    uint32_t index = 0;
+    uint32_t filtered_index = 0;
+    uint32_t agrgt_counter_index;
+    int ret;
+
+    /* Update NIC counters */
+    if (nic_counters_update(nic_device, &nic_device->num_counters_total) != 0) {
+        nic_device->num_counters_total = 0;
+    }
+    nic_device->cnts_members_num = 0;
+    nic_device->cnts_members.clear();
+    nic_device->cnts_agrgt_names.clear();
+    nic_device->cnts_agrgt_members_num.clear();
+
+    while (index < nic_device->num_counters_total) {
+
+        /* Get the next counter name */
+        cnt_name = string((const char *)&nic_device->strings->data[index * ETH_GSTRING_LEN],
+                       strnlen((const char *)&nic_device->strings->data[index * ETH_GSTRING_LEN], ETH_GSTRING_LEN));
+
+        /* Filter out characters (to get aggregate_sum name) */
+        nic_counter_name_filter(&cnt_name);
+
+        /* Is counter already in list? */
+        ret = aggt_sum_counter_name_index_find(&cnt_name, nic_device->cnts_agrgt_names.data(),
+                  filtered_index, &agrgt_counter_index);
+        if ( (ret == 0) && (filtered_index < NUM_NIC_AGGREGATE_CNTS_MAX) &&
+             (nic_counter_filter_match(cnt_name)) ) {
+            DEBUG_PRINT("Adding new counter: %s cnt_name = %s\n", nic_device->name.c_str(),
+                cnt_name.c_str());
+
+            agrgt_counter_index = filtered_index;
+            nic_device->cnts_agrgt_names.push_back(cnt_name);
+            nic_device->cnts_agrgt_members_num.push_back(0);
+            filtered_index++;
+        }
+
+        /* Add index of counter to database */
+        nic_device->cnts_agrgt_mapping[index] = agrgt_counter_index;
+
+        /* Compile the filter: only members of a listed aggregate are read */
+        if (agrgt_counter_index < NUM_NIC_AGGREGATE_CNTS_MAX) {
+            nic_device->cnts_members.push_back(index);
+            nic_device->cnts_members_num++;
+            nic_device->cnts_agrgt_members_num[agrgt_counter_index]++;
+        }
+
+        index++;
+    }
+
+    nic_device->cnts_agrgt_num = filtered_index;
+
+    /* Refresh buffers, sized once (their values are referenced by pointers) */
+    nic_device->cnts_agrgt.assign(filtered_index, 0);
+    nic_device->cnts_agrgt_min.assign(filtered_index, 0);
+    nic_device->cnts_agrgt_max.assign(filtered_index, 0);
+    nic_device->cnts_agrgt_cv.assign(filtered_index, 0);
+    nic_device->cnts_agrgt_interval.assign(filtered_index, 0);
+    nic_device->cnts_agrgt_sum_sqr.assign(filtered_index, 0);
+    nic_device->cnts_members_prev.assign(nic_device->cnts_members_num, 0);
+    nic_device->cnts_members_prev_valid = 0;
+
+    DEBUG_PRINT("NIC device %s: %u aggregate counters, %u of %zu counters read per refresh\n",
+        nic_device->name.c_str(), nic_device->cnts_agrgt_num, nic_device->cnts_members_num,
+        nic_device->num_counters_total);
+
+    return nic_device->cnts_agrgt_num;
+}
+
+/*
+   Updates and aggregate sums counters of all NIC devices.
+   The NIC counters of all devices are indexed consecutively, device by device.
+   When imbalance is enabled, the min/max/cv counters of each device follow
+   its aggregate-sum counters (aggregates of a single queue have none).
+
+   returns: The number of counters in the aggregate list.
+*/
+size_t
+ucx_sampling_ethtool::counters_init()
+{
+    uint32_t kind;
+    uint32_t i;
+
+    m_nic_cnts_device.clear();
+    m_nic_cnts_device_index.clear();
+    m_nic_cnts_kind.clear();
+
+    for (auto nic_device : m_nic_devices) {
+        nic_device_counters_aggregate(nic_device);
+
+        for (kind = NIC_COUNTER_KIND_SUM; kind < NIC_COUNTER_KIND_LAST; kind++) {
+            if ((kind != NIC_COUNTER_KIND_SUM) && (!m_nic_imbalance_enable)) {
+                break;
+            }
+
+            for (i = 0; i < nic_device->cnts_agrgt_num; i++) {
+                if ((kind != NIC_COUNTER_KIND_SUM) && (nic_device->cnts_agrgt_members_num[i] < 2)) {
+                    continue;
+                }
+
+                m_nic_cnts_device.push_back(nic_device);
+                m_nic_cnts_device_index.push_back(i);
+                m_nic_cnts_kind.push_back(kind);
+            }
+        }
+
+        /* Initialize the device refresh buffer */
+        nic_device_counters_refresh(nic_device);
+    }
+
+    m_nic_cnts_agrgt_num = m_nic_cnts_device.size();
+
+    return m_nic_cnts_agrgt_num;
+}
@@ -0,0 +1,286 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <algorithm>
+
+#include <utils.h>
+
+#include "ucx_sampling_backend.h"
+
+/* Enable verbose mode */
+//#define UCX_SAMPLING_VERBOSE_MODE_ENABLE
+
+ucx_sampling_legacy::ucx_sampling_legacy()
+{
+    m_statistics_server_process_enable = 0;
+    m_num_enumerated = 0;
+    m_wait_timeout_reported = 0;
+}
+
+ucx_sampling_legacy::~ucx_sampling_legacy()
+{
+    for (auto counter : m_counters_list) {
+        delete counter;
+    }
+    m_counters_list.clear();
+}
+
+/*
+   The UCX objects are created by the application's MPI_Init: the counters are
+   registered with temporary names, and discovered by counters_enumerate().
+*/
+size_t
+ucx_sampling_legacy::counters_init()
+{
+    m_values.assign(deferred_counters_num_get(), 0);
+
+    return m_values.size();
+}
+
+/*
+   The legacy backend is available on a single rank, which binds the UCX
+   statistics server port (UCX_STATS_DEST should point to it). On the other
+   ranks the counters keep their temporary names and read 0.
+*/
+size_t
+ucx_sampling_legacy::counters_enumerate(int mpi_rank)
+{
+    if (mpi_rank != UCX_SAMPLING_LEGACY_SERVER_RANK) {
+        return 0;
+    }
+
+    if (server_start(UCS_STATS_DEFAULT_UDP_PORT) != 0) {
+        return 0;
+    }
+
+    if (m_counters_list.empty()) {
+        all_counters_update(&m_counters_list, 1);
+    }
+
+    m_num_enumerated = std::min(m_counters_list.size(), m_values.size());
+    if (m_num_enumerated < m_counters_list.size()) {
+        printf("Warning: UCX legacy backend: %zu of %zu counters recorded (%s)\n", m_num_enumerated,
+            m_counters_list.size(), ENV_SCOREP_UCX_PLUGIN_OBJECT_COUNTERS_NUM);
+    }
+
+    return m_num_enumerated;
+}
+
+void
+ucx_sampling_legacy::counter_name_get(uint32_t index, string *name)
+{
+    if (index < m_num_enumerated) {
+        *name = m_counters_list[index]->name;
+    }
+    else {
+        /* Not enumerated (yet): temporary name */
+        deferred_counter_name_get(index, name);
+    }
+}
+
+void
+ucx_sampling_legacy::refresh()
+{
+    size_t i;
+
+    if (m_num_enumerated == 0) {
+        return;
+    }
+
+    if (!all_counters_update(&m_counters_list, 0)) {
+        return;
+    }
+
+    for (i = 0; i < m_num_enumerated; i++) {
+        m_values[i] = m_counters_list[i]->value;
+    }
+}
+
+int
+ucx_sampling_legacy::server_start(int port)
+{
+    ucs_stats_node_t *root;
+    ucs_list_link_t *stats;
+    ucs_status_t status;
+    int ret = 0;
+
+    DEBUG_PRINT("ucx_sampling_legacy::server_start()\n");
+    DEBUG_PRINT("UCX Port used = %d\n", port);
+
+    /* Already bound by this process */
+    if (m_statistics_server_process_enable) {
+        return 0;
+    }
+
+    m_statistics_server_process_enable = 0;
+    status = ucs_stats_server_start(port, &m_ucx_stats_server);
+    if (status != UCS_OK) {
+        printf("ucs_stats_server_start() Failed! status=%u\n", status);
+        ret = -1;
+        goto exit_and_return_metric_properties;
+    }
+
+    DEBUG_PRINT("ucs_stats_server_start() Succes! status=%u\n", status);
+    m_statistics_server_process_enable = 1;
+
+exit_and_return_metric_properties:
+    return ret;
+}
+
+uint64_t
+ucx_sampling_legacy::recursive_scan_counters_list(ucs_stats_node_t *root,
+        ucs_list_link_t *stats,
+        const char *counters_root_name,
+        scorep_counters_list_t *ucx_counters_list,
+        uint64_t num_objects,
+        uint64_t& num_counters,
+        int initialize_counters_enable)
+{
+    ucs_status_t status;
+    ucs_stats_node_t *data_node;
+    size_t statistics_len;
+    char counter_name_prefix[UCX_SAMPLING_COUNTER_NAME_PREFIX_MAX_SIZE];
+    char counter_name_temp[UCX_SAMPLING_COUNTER_NAME_PREFIX_MAX_SIZE];
+    uint64_t n_local_objects = 0;
+    scorep_counter_data_t *ucx_performance_counter = NULL;
+
+    ucs_list_for_each(data_node, &root->children[UCS_STATS_ACTIVE_CHILDREN], list) {
+#if defined(UCX_SAMPLING_VERBOSE_MODE_ENABLE)
+        std::cout << "name = " << std::string(data_node->cls->name) <<
+                     " num_counters=" << data_node->cls->num_counters <<
+                     std::endl;
+#endif
+
+        if (initialize_counters_enable) {
+            snprintf(counter_name_prefix, sizeof(counter_name_prefix),
+                     "%s-%s", counters_root_name, data_node->cls->name);
+            snprintf(counter_name_temp, sizeof(counter_name_temp),
+                     "ucx-object-%lu-%s", num_objects, counter_name_prefix);
+        }
+
+        for (int k = 0; k < data_node->cls->num_counters; k++) {
+            if (initialize_counters_enable) {
+                ucx_performance_counter = new scorep_counter_data_t();
+                ucx_performance_counter->scorep_counter_id = num_counters;
+                ucx_performance_counter->metric_handle = 0;
+                ucx_performance_counter->scorep_metric_already_renamed = 0;
+                snprintf(ucx_performance_counter->name,
+                         sizeof(ucx_performance_counter->name),
+                         "%s-%s",
+                         counter_name_temp,
+                         data_node->cls->counter_names[k]);
+                ucx_performance_counter->value = data_node->counters[k];
+                ucx_performance_counter->prev_value = (uint64_t)-1;
+
+                ucx_counters_list->push_back(ucx_performance_counter);
+            }
+            else {
+                if (num_counters >= ucx_counters_list->size()) {
+                    /* We are not updating the counters list in runtime */
+                    goto ucx_scan_counters_complete_exit;
+                }
+                (*ucx_counters_list)[num_counters]->value = data_node->counters[k];
+            }
+
+#if defined(UCX_SAMPLING_VERBOSE_MODE_ENABLE)
+            std::cout << ucx_performance_counter->name <<
+                         " " << data_node->counters[k] << std::endl;
+#endif
+
+            num_counters++;
+        }
+
+        /* Number of UCX objects counted */
+        num_objects++;
+        n_local_objects++;
+
+        /* Recursively iterate through counters */
+        num_objects += recursive_scan_counters_list(data_node,
+              stats, counter_name_prefix, ucx_counters_list,
+              num_objects, num_counters, initialize_counters_enable);
+    }
+
+ucx_scan_counters_complete_exit:
+    return n_local_objects;
+}
+
+void
+ucx_sampling_legacy::scan_counters_list(ucs_list_link_t *stats,
+     const char *counters_root_name,
+     scorep_counters_list_t *ucx_counters_list,
+     int initialize_counters_enable)
+{
+    ucs_status_t status;
+    ucs_stats_node_t *data_node;
+    ucs_stats_node_t *root;
+    size_t statistics_len;
+    uint64_t num_objects;
+    uint64_t num_counters;
+
+    statistics_len = ucs_list_length(stats);
+#if defined(UCX_SAMPLING_VERBOSE_MODE_ENABLE)
+    std::cout<< "stats len: " << statistics_len << std::endl;
+#endif
+    /* Recursively iterate through counters */
+    root = ucs_list_head(stats, ucs_stats_node_t, list);
+    num_objects = 0;
+    num_counters = 0;
+    recursive_scan_counters_list(root, stats, "cnt", ucx_counters_list,
+            num_objects, num_counters, initialize_counters_enable);
+}
+
+
+int
+ucx_sampling_legacy::all_counters_update(
+    scorep_counters_list_t *new_counters_list,
+    int initialize_counters_enable)
+{
+    ucs_list_link_t *stats;
+    uint64_t deadline_nsec;
+
+    if (!m_statistics_server_process_enable) {
+        return 0;
+    }
+
+    /* Trigger dumping UCX statistics */
+    ucs_stats_dump();
+
+    /* Wait for statistics to be sent to Server by UCX (bounded) */
+    deadline_nsec = time_nsec_get() + UCX_SAMPLING_LEGACY_WAIT_NSEC;
+    while (ucs_stats_server_rcvd_packets(m_ucx_stats_server) == 0) {
+        if (time_nsec_get() > deadline_nsec) {
+            if (!m_wait_timeout_reported) {
+                printf("Warning: no UCX statistics received by the statistics server (port %d),"
+                       " check UCX_STATS_DEST=udp:localhost:%d\n", UCS_STATS_DEFAULT_UDP_PORT,
+                       UCS_STATS_DEFAULT_UDP_PORT);
+                m_wait_timeout_reported = 1;
+            }
+            return 0;
+        }
+    }
+
+#if defined(UCX_SAMPLING_VERBOSE_MODE_ENABLE)
+    std::cout << "UCS statistics server started, getting statistics...";
+#endif
+    /* Get stats */
+    stats = ucs_stats_server_get_stats(m_ucx_stats_server);
+
+    /* Scan counters list */
+    scan_counters_list(stats, "", new_counters_list,
+       initialize_counters_enable);
+
+#if defined(UCX_SAMPLING_VERBOSE_MODE_ENABLE)
+    std::cout << "Done: statistics ptr returned=" << stats << "\n";
+#endif
+    /* Release stats */
+    ucs_stats_server_purge_stats(m_ucx_stats_server);
+
+    return 1;
+}
@@ -0,0 +1,157 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+
+#include <utils.h>
+
+#include "ucx_sampling_backend.h"
+
+ucx_sampling_sysfs::ucx_sampling_sysfs()
+{
+    m_rounds_cnt = 0;
+}
+
+ucx_sampling_sysfs::~ucx_sampling_sysfs()
+{
+    for (auto fd : m_fds) {
+        close(fd);
+    }
+}
+
+void
+ucx_sampling_sysfs::counters_dir_add(const string& dir_path, const string& name_prefix)
+{
+    DIR *dir;
+    struct dirent *entry;
+
+    dir = opendir(dir_path.c_str());
+    if (dir == NULL) {
+        return;
+    }
+
+    while ((entry = readdir(dir)) != NULL) {
+        string counter_path;
+        int fd;
+
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+
+        counter_path = dir_path + "/" + entry->d_name;
+        fd = open(counter_path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            continue;
+        }
+
+        m_fds.push_back(fd);
+        m_names.push_back(name_prefix + "_" + entry->d_name);
+    }
+
+    closedir(dir);
+}
+
+/*
+   Counters of each NIC device:
+   - /sys/class/net/<netdev>/statistics/<counter>
+   - /sys/class/net/<netdev>/device/infiniband/<ibdev>/ports/<port>/counters/<counter>
+*/
+size_t
+ucx_sampling_sysfs::counters_init()
+{
+    std::vector<string> ndev_names;
+
+    if (!m_fds.empty()) {
+        return m_fds.size();
+    }
+
+    nic_devices_discover(&ndev_names);
+
+    for (auto& ndev_name : ndev_names) {
+        string ib_path = "/sys/class/net/" + ndev_name + "/device/infiniband";
+        DIR *ib_dir;
+        struct dirent *ib_entry;
+
+        counters_dir_add("/sys/class/net/" + ndev_name + "/statistics", ndev_name);
+
+        ib_dir = opendir(ib_path.c_str());
+        if (ib_dir == NULL) {
+            continue;
+        }
+
+        while ((ib_entry = readdir(ib_dir)) != NULL) {
+            string ports_path;
+            DIR *ports_dir;
+            struct dirent *port_entry;
+
+            if (ib_entry->d_name[0] == '.') {
+                continue;
+            }
+
+            ports_path = ib_path + "/" + ib_entry->d_name + "/ports";
+            ports_dir = opendir(ports_path.c_str());
+            if (ports_dir == NULL) {
+                continue;
+            }
+
+            while ((port_entry = readdir(ports_dir)) != NULL) {
+                if (port_entry->d_name[0] == '.') {
+                    continue;
+                }
+
+                counters_dir_add(ports_path + "/" + port_entry->d_name + "/counters",
+                    string(ib_entry->d_name) + "_p" + port_entry->d_name);
+            }
+
+            closedir(ports_dir);
+        }
+
+        closedir(ib_dir);
+    }
+
+    /* Values are served from here, never resized after initialization */
+    m_values.assign(m_fds.size(), 0);
+
+    DEBUG_PRINT("sysfs: %zu counters of %zu devices\n", m_fds.size(), ndev_names.size());
+
+    refresh();
+
+    return m_fds.size();
+}
+
+void
+ucx_sampling_sysfs::counter_name_get(uint32_t index, string *name)
+{
+    if (index < m_names.size()) {
+        *name = "sysfs_" + m_names[index];
+    }
+}
+
+void
+ucx_sampling_sysfs::refresh()
+{
+    char buf[32];
+    ssize_t len;
+    size_t i;
+
+    /* Each counter is a system call, decimated as the ethtool counters */
+    if ((m_rounds_cnt++ & (NIC_COUNTERS_UPDATE_DECIMATION-1)) != 0) {
+        return;
+    }
+
+    for (i = 0; i < m_fds.size(); i++) {
+        len = pread(m_fds[i], buf, sizeof(buf) - 1, 0);
+        if (len > 0) {
+            buf[len] = 0x00;
+            m_values[i] = strtoull(buf, NULL, 10);
+        }
+    }
+}
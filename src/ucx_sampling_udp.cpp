@@ -0,0 +1,38 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+
+#include <utils.h>
+
+#include "ucx_sampling_backend.h"
+
+size_t
+ucx_sampling_udp::counters_init()
+{
+    ucs_stats_aggregate_get_counter_names(&m_names, &m_num_counters);
+    m_num_counters = std::min(m_num_counters, (size_t)UCX_AGGREGATE_SUM_NUM_COUNTERS_MAX);
+    memset(m_values, 0, sizeof(m_values));
+
+    if ((m_num_counters == 0) ||
+        (m_receiver.start(stats_udp_port_get(), m_names, m_num_counters) != 0)) {
+        /* Not the node receiver */
+        m_num_counters = 0;
+    }
+
+    return m_num_counters;
+}
+
+void
+ucx_sampling_udp::counter_name_get(uint32_t index, string *name)
+{
+    if (index < m_num_counters) {
+        *name = string("node_") + m_names[index].class_name + "_" + m_names[index].counter_name;
+    }
+}
@@ -0,0 +1,222 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+
+#include <utils.h>
+
+#include "ucx_sampling_worker.h"
+#include "ucx_stats_tree.h"
+
+thread_local ucx_sampling_worker::thread_state_t ucx_sampling_worker::m_thread_state;
+
+ucx_sampling_worker::ucx_sampling_worker()
+{
+    m_num_counters = 0;
+    m_bind_enable = 0;
+}
+
+int
+ucx_sampling_worker::is_supported()
+{
+    return ucx_stats_tree_nodes_persistent();
+}
+
+void
+ucx_sampling_worker::thread_bind(const void *ucp_worker)
+{
+    thread_state_t *state = &m_thread_state;
+
+    m_bind_enable = 1;
+
+    if (state->worker != NULL) {
+        worker_release();
+    }
+
+    state->bound = 1;
+    state->bound_worker = ucp_worker;
+    state->claim_attempts = 0;
+}
+
+void
+ucx_sampling_worker::counter_names_set(const std::vector<std::string>& names)
+{
+    uint32_t i;
+
+    m_num_counters = (uint32_t)std::min(names.size(), (size_t)UCX_AGGREGATE_SUM_NUM_COUNTERS_MAX);
+
+    m_counter_index.clear();
+    for (i = 0; i < m_num_counters; i++) {
+        m_counter_index[names[i]] = (int32_t)i;
+    }
+}
+
+void
+ucx_sampling_worker::workers_find(const ucs_stats_node_t *node,
+    std::vector<const ucs_stats_node_t *> *workers)
+{
+    ucs_stats_node_t *child;
+
+    UCX_STATS_TREE_FOR_EACH_CHILD(child, node) {
+        if (strcmp(child->cls->name, UCX_SAMPLING_WORKER_CLASS_NAME) == 0) {
+            workers->push_back(child);
+        }
+        else {
+            workers_find(child, workers);
+        }
+    }
+}
+
+const ucs_stats_node_t *
+ucx_sampling_worker::worker_claim()
+{
+    thread_state_t *state = &m_thread_state;
+    std::vector<const ucs_stats_node_t *> workers;
+    ucs_stats_node_t *root = ucs_stats_get_root();
+    char bound_name[UCS_STAT_NAME_MAX + 1];
+
+    if (root == NULL) {
+        return NULL;
+    }
+
+    /* Bound to no worker, or not bound while other threads are */
+    if (state->bound ? (state->bound_worker == NULL) : m_bind_enable.load()) {
+        return NULL;
+    }
+
+    snprintf(bound_name, sizeof(bound_name), UCX_SAMPLING_WORKER_NODE_NAME_FMT, state->bound_worker);
+
+    std::lock_guard<std::mutex> lock(m_claim_lock);
+
+    workers_find(root, &workers);
+    for (auto worker : workers) {
+        if (state->bound && (strncmp(worker->name, bound_name, sizeof(bound_name)) != 0)) {
+            continue;
+        }
+
+        if (m_claimed_workers.insert(worker).second) {
+            DEBUG_PRINT("Thread %zu claimed UCP worker %s\n",
+                (size_t)std::hash<std::thread::id>()(std::this_thread::get_id()), worker->name);
+            return worker;
+        }
+    }
+
+    return NULL;
+}
+
+void
+ucx_sampling_worker::worker_release()
+{
+    thread_state_t *state = &m_thread_state;
+    uint32_t i;
+
+    {
+        std::lock_guard<std::mutex> lock(m_claim_lock);
+        m_claimed_workers.erase(state->worker);
+    }
+
+    /* The next worker counters add to the totals of the thread */
+    for (i = 0; i < m_num_counters; i++) {
+        state->retired_values[i] = state->values[i];
+        state->prev_raw_values[i] = 0;
+    }
+
+    state->worker = NULL;
+    state->claim_attempts = 0;
+}
+
+int
+ucx_sampling_worker::worker_is_active(const ucs_stats_node_t *worker)
+{
+    ucs_stats_node_t *child;
+
+    UCX_STATS_TREE_FOR_EACH_CHILD(child, worker->parent) {
+        if (child == worker) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+const ucx_sampling_worker::class_mapping_t&
+ucx_sampling_worker::class_mapping_get(const ucs_stats_class_t *cls)
+{
+    auto it = m_thread_state.class_mappings.find(cls);
+    class_mapping_t mapping;
+    unsigned k;
+
+    if (likely(it != m_thread_state.class_mappings.end())) {
+        return it->second;
+    }
+
+    for (k = 0; k < cls->num_counters; k++) {
+        auto index = m_counter_index.find(std::string(cls->name) + "_" + cls->counter_names[k]);
+
+        mapping.push_back((index != m_counter_index.end()) ? index->second : -1);
+    }
+
+    return m_thread_state.class_mappings.emplace(cls, mapping).first->second;
+}
+
+void
+ucx_sampling_worker::subtree_aggregate(const ucs_stats_node_t *node)
+{
+    const class_mapping_t& mapping = class_mapping_get(node->cls);
+    ucs_stats_node_t *child;
+    size_t k;
+
+    for (k = 0; k < mapping.size(); k++) {
+        if (mapping[k] >= 0) {
+            m_thread_state.raw_values[mapping[k]] += node->counters[k];
+        }
+    }
+
+    UCX_STATS_TREE_FOR_EACH_CHILD(child, node) {
+        subtree_aggregate(child);
+    }
+}
+
+void
+ucx_sampling_worker::thread_refresh()
+{
+    thread_state_t *state = &m_thread_state;
+    uint32_t i;
+
+    /* Worker destroyed, or claimed in creation order while the application binds */
+    if ((state->worker != NULL) &&
+        (unlikely(!worker_is_active(state->worker)) ||
+         unlikely(!state->bound && m_bind_enable.load(std::memory_order_relaxed)))) {
+        worker_release();
+    }
+
+    if (unlikely(state->worker == NULL)) {
+        /* Resolve the worker once, retry (decimated) until the thread owns one */
+        if ((state->claim_attempts++ & (UCX_SAMPLING_WORKER_CLAIM_RETRY - 1)) != 0) {
+            return;
+        }
+
+        state->worker = worker_claim();
+        if (state->worker == NULL) {
+            return;
+        }
+    }
+
+    memset(state->raw_values, 0, m_num_counters * sizeof(state->raw_values[0]));
+    subtree_aggregate(state->worker);
+
+    /* Destroyed endpoints / interfaces of the worker: keep the totals monotonic */
+    for (i = 0; i < m_num_counters; i++) {
+        if (unlikely(state->raw_values[i] < state->prev_raw_values[i])) {
+            state->retired_values[i] += (state->prev_raw_values[i] - state->raw_values[i]);
+        }
+        state->prev_raw_values[i] = state->raw_values[i];
+        state->values[i] = state->raw_values[i] + state->retired_values[i];
+    }
+}
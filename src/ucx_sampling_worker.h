@@ -0,0 +1,128 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+#if !defined(_UCX_SAMPLING_WORKER_H_)
+#define _UCX_SAMPLING_WORKER_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <ucx_sampling_backend.h>
+
+/* Stats class name of the UCP worker nodes */
+#define UCX_SAMPLING_WORKER_CLASS_NAME      "ucp_worker"
+
+/* Stats node name of a UCP worker (UCX: "-%p" of the ucp_worker_h) */
+#define UCX_SAMPLING_WORKER_NODE_NAME_FMT   "-%p"
+
+/* Thread without a worker: retry the claim every N refreshes (must be a power of 2) */
+#define UCX_SAMPLING_WORKER_CLAIM_RETRY     1024
+
+/*
+   Per UCP worker aggregate-sum counters.
+
+   The application binds each thread to its UCP worker (scorep_ucx_worker_bind()).
+   Until a thread of the process binds, each thread claims the next unclaimed
+   UCP worker stats node (in creation order) the first time it reads the
+   counters. The claim is cached per thread; from then on, the thread reads
+   the aggregate of its worker subtree only, in the aggregate-sum counters
+   layout. The claim is dropped when the worker node leaves the tree (worker
+   destroyed), the thread keeps its totals and claims again.
+
+   The live UCX statistics tree is walked without the UCX stats lock, so the
+   per worker counters are only used when the destroyed nodes are kept until
+   the UCX cleanup (ucx_stats_tree_nodes_persistent()).
+*/
+class ucx_sampling_worker {
+public:
+   ucx_sampling_worker();
+
+   /* Can the per worker counters be used with this UCX configuration? */
+   static int
+   is_supported();
+
+   /* Bind the calling thread to a UCP worker (ucp_worker_h), NULL: no worker */
+   void
+   thread_bind(const void *ucp_worker);
+
+   /* Set the aggregate-sum counter names ("<class>_<counter>", aggregate index order) */
+   void
+   counter_names_set(const std::vector<std::string>& names);
+
+   /* Refresh the worker subtree aggregate of the calling thread */
+   void
+   thread_refresh();
+
+   /* Get a counter of the calling thread worker (monotonic corrected) */
+   uint64_t
+   thread_value_get(uint32_t index) {
+       return m_thread_state.values[index];
+   }
+
+private:
+   /* Aggregate index of each counter of a stats class (-1: not aggregated) */
+   typedef std::vector<int32_t> class_mapping_t;
+
+   typedef struct thread_state {
+       /* Claimed worker node, NULL until claimed */
+       const ucs_stats_node_t *worker;
+       uint32_t claim_attempts;
+
+       /* Bound by the application, and the bound UCP worker */
+       int bound;
+       const void *bound_worker;
+
+       /* Stats class -> aggregate index mapping (cached per thread) */
+       std::unordered_map<const ucs_stats_class_t *, class_mapping_t> class_mappings;
+
+       uint64_t raw_values[UCX_AGGREGATE_SUM_NUM_COUNTERS_MAX];
+       uint64_t prev_raw_values[UCX_AGGREGATE_SUM_NUM_COUNTERS_MAX];
+       uint64_t retired_values[UCX_AGGREGATE_SUM_NUM_COUNTERS_MAX];
+       uint64_t values[UCX_AGGREGATE_SUM_NUM_COUNTERS_MAX];
+   } thread_state_t;
+
+   /* Claim the bound, or the next unclaimed, worker node for the calling thread */
+   const ucs_stats_node_t *
+   worker_claim();
+
+   /* Release the worker of the calling thread (the totals are kept) */
+   void
+   worker_release();
+
+   /* Is a worker node still an active child of its parent? */
+   static int
+   worker_is_active(const ucs_stats_node_t *worker);
+
+   /* Collect the worker nodes (not nested) in creation order */
+   void
+   workers_find(const ucs_stats_node_t *node, std::vector<const ucs_stats_node_t *> *workers);
+
+   const class_mapping_t&
+   class_mapping_get(const ucs_stats_class_t *cls);
+
+   void
+   subtree_aggregate(const ucs_stats_node_t *node);
+
+   /* Aggregate-sum counter name -> index */
+   std::unordered_map<std::string, int32_t> m_counter_index;
+   uint32_t m_num_counters;
+
+   /* Worker nodes claimed by the threads */
+   std::mutex m_claim_lock;
+   std::set<const ucs_stats_node_t *> m_claimed_workers;
+
+   /* A thread was bound by the application: no creation order claims */
+   std::atomic<int> m_bind_enable;
+
+   static thread_local thread_state_t m_thread_state;
+};
+
+#endif /* _UCX_SAMPLING_WORKER_H_ */
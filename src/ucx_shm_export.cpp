@@ -0,0 +1,172 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+#include <utils.h>
+
+#include "ucx_shm_export.h"
+
+ucx_shm_export::ucx_shm_export()
+{
+    m_sampling = NULL;
+    m_segment = NULL;
+    m_slot = NULL;
+    m_num_counters = 0;
+    m_period_nsec = 0;
+    m_next_publish_nsec = 0;
+}
+
+ucx_shm_export::~ucx_shm_export()
+{
+    detach();
+}
+
+int
+ucx_shm_export::attach(ucx_sampling *sampling, uint64_t period_msec)
+{
+    char shm_name[256];
+    struct stat shm_stat;
+    uint64_t magic = 0;
+    int32_t pid = (int32_t)getpid();
+    uint32_t i;
+    void *addr;
+    int fd;
+
+    m_sampling = sampling;
+    m_period_nsec = period_msec * 1000000ULL;
+    m_num_counters = (uint32_t)std::min(m_sampling->counters_num_get(),
+                                        (size_t)UCX_SHM_EXPORT_COUNTERS_MAX);
+
+    snprintf(shm_name, sizeof(shm_name), UCX_SHM_EXPORT_NAME_FORMAT, job_id_get().c_str());
+    m_shm_name = shm_name;
+
+    fd = shm_open(shm_name, O_CREAT | O_RDWR, 0644);
+    if (fd < 0) {
+        printf("Warning: could not open the shared-memory segment %s, errno=%d\n", shm_name, errno);
+        return -1;
+    }
+
+    /* All writers size the segment the same: the first one (re)sizes it */
+    if ((fstat(fd, &shm_stat) != 0) ||
+        (((size_t)shm_stat.st_size < sizeof(ucx_shm_export_segment_t)) &&
+         (ftruncate(fd, sizeof(ucx_shm_export_segment_t)) != 0))) {
+        printf("Warning: could not size the shared-memory segment %s, errno=%d\n", shm_name, errno);
+        close(fd);
+        return -1;
+    }
+
+    addr = mmap(NULL, sizeof(ucx_shm_export_segment_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        printf("Warning: could not map the shared-memory segment %s, errno=%d\n", shm_name, errno);
+        return -1;
+    }
+
+    m_segment = (ucx_shm_export_segment_t *)addr;
+    m_segment->header.num_attached.fetch_add(1);
+
+    /* The first writer publishes the counter names (same for all the ranks) */
+    if (m_segment->header.magic.compare_exchange_strong(magic, UCX_SHM_EXPORT_MAGIC_INIT)) {
+        for (i = 0; i < m_num_counters; i++) {
+            std::string name;
+
+            m_sampling->counter_name_get(i, &name);
+            strncpy(m_segment->header.names[i], name.c_str(), UCX_SHM_EXPORT_NAME_LEN - 1);
+            m_segment->header.names[i][UCX_SHM_EXPORT_NAME_LEN - 1] = '\0';
+        }
+        m_segment->header.num_counters = m_num_counters;
+        m_segment->header.magic.store(UCX_SHM_EXPORT_MAGIC, std::memory_order_release);
+    }
+
+    /* Claim a free slot, or the slot of an exited process (previous run) */
+    for (i = 0; (i < UCX_SHM_EXPORT_RANKS_MAX) && (m_slot == NULL); i++) {
+        ucx_shm_export_slot_t *slot = &m_segment->slots[i];
+        int32_t slot_pid = slot->pid.load();
+
+        if ((slot_pid != 0) && ((kill(slot_pid, 0) == 0) || (errno != ESRCH))) {
+            continue;
+        }
+
+        if (slot->pid.compare_exchange_strong(slot_pid, pid)) {
+            slot->rank = -1;
+            m_slot = slot;
+        }
+    }
+
+    if (m_slot == NULL) {
+        printf("Warning: no free slot in the shared-memory segment %s\n", shm_name);
+        detach();
+        return -1;
+    }
+
+    DEBUG_PRINT("Shared-memory export: %s, slot %ld\n", shm_name, m_slot - m_segment->slots);
+
+    return 0;
+}
+
+void
+ucx_shm_export::detach()
+{
+    if (m_segment == NULL) {
+        return;
+    }
+
+    if (m_slot != NULL) {
+        m_slot->pid.store(0);
+        m_slot = NULL;
+    }
+
+    /* The last writer removes the segment */
+    if (m_segment->header.num_attached.fetch_sub(1) == 1) {
+        shm_unlink(m_shm_name.c_str());
+    }
+
+    munmap(m_segment, sizeof(ucx_shm_export_segment_t));
+    m_segment = NULL;
+}
+
+void
+ucx_shm_export::rank_set(int rank)
+{
+    if (m_slot != NULL) {
+        m_slot->rank = rank;
+    }
+}
+
+void
+ucx_shm_export::publish()
+{
+    struct timespec now;
+    uint64_t seq;
+
+    if ((m_slot == NULL) || m_publishing.test_and_set(std::memory_order_acquire)) {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    /* Seqlock write: odd while the slot is updated */
+    seq = m_slot->seq.load(std::memory_order_relaxed);
+    m_slot->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    m_slot->timestamp_nsec = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+    m_sampling->snapshot_copy(0, m_num_counters, m_slot->values);
+
+    m_slot->seq.store(seq + 2, std::memory_order_release);
+
+    m_publishing.clear(std::memory_order_release);
+}
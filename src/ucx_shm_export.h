@@ -0,0 +1,87 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+#if !defined(_UCX_SHM_EXPORT_H_)
+#define _UCX_SHM_EXPORT_H_
+
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <ucx_shm_layout.h>
+#include <ucx_sampling.h>
+
+/* Default shared-memory export period (milli seconds) */
+#define UCX_SHM_EXPORT_PERIOD_MSEC_DEFAULT  100
+
+/* Live shared-memory export of the latest counters snapshot of this rank */
+class ucx_shm_export {
+public:
+   ucx_shm_export();
+
+   ~ucx_shm_export();
+
+   /*
+      Attach to (or create) the job segment and claim a slot.
+
+      returns: 0 on success, -1 otherwise.
+   */
+   int
+   attach(ucx_sampling *sampling, uint64_t period_msec);
+
+   /* Set the MPI rank of the slot */
+   void
+   rank_set(int rank);
+
+   /* Is a new snapshot due? (cheap, coarse clock) */
+   inline int
+   publish_due();
+
+   /* Publish the current backends snapshot (never blocks) */
+   void
+   publish();
+
+private:
+   void
+   detach();
+
+   ucx_sampling *m_sampling;
+
+   std::string m_shm_name;
+   ucx_shm_export_segment_t *m_segment;
+   ucx_shm_export_slot_t *m_slot;
+   uint32_t m_num_counters;
+
+   uint64_t m_period_nsec;
+   uint64_t m_next_publish_nsec;
+
+   /* Skip the snapshot if another thread is publishing */
+   std::atomic_flag m_publishing = ATOMIC_FLAG_INIT;
+};
+
+inline int
+ucx_shm_export::publish_due()
+{
+    struct timespec now;
+    uint64_t now_nsec;
+
+    if (m_slot == NULL) {
+        return 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    now_nsec = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+    if (now_nsec < m_next_publish_nsec) {
+        return 0;
+    }
+
+    m_next_publish_nsec = now_nsec + m_period_nsec;
+    return 1;
+}
+
+#endif /* _UCX_SHM_EXPORT_H_ */
@@ -0,0 +1,64 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+#if !defined(_UCX_SHM_LAYOUT_H_)
+#define _UCX_SHM_LAYOUT_H_
+
+#include <stdint.h>
+#include <atomic>
+
+/*
+   Live shared-memory export layout (one segment per job and node).
+
+   Each rank owns a slot, updated through a seqlock: the sequence number is
+   odd while the slot is written. Readers map the segment read-only and retry
+   on a changed or odd sequence number, so they never perturb the writers.
+*/
+
+#define UCX_SHM_EXPORT_NAME_FORMAT      "/scorep_ucx.%s"
+
+/* "UCXSHM01" */
+#define UCX_SHM_EXPORT_MAGIC            0x31304d4853584355ULL
+#define UCX_SHM_EXPORT_MAGIC_INIT       1
+
+#define UCX_SHM_EXPORT_RANKS_MAX        256
+#define UCX_SHM_EXPORT_COUNTERS_MAX     256
+#define UCX_SHM_EXPORT_NAME_LEN         64
+
+typedef struct ucx_shm_export_header {
+    /* 0 - new, UCX_SHM_EXPORT_MAGIC_INIT - names written, UCX_SHM_EXPORT_MAGIC - ready */
+    std::atomic<uint64_t> magic;
+
+    /* Number of attached writers (the last one removes the segment) */
+    std::atomic<uint32_t> num_attached;
+
+    uint32_t num_counters;
+
+    char names[UCX_SHM_EXPORT_COUNTERS_MAX][UCX_SHM_EXPORT_NAME_LEN];
+} ucx_shm_export_header_t;
+
+typedef struct alignas(64) ucx_shm_export_slot {
+    /* Seqlock sequence number */
+    std::atomic<uint64_t> seq;
+
+    /* Owner process, 0 - free slot */
+    std::atomic<int32_t> pid;
+
+    /* MPI rank (-1 until known) */
+    int32_t rank;
+
+    /* CLOCK_MONOTONIC time of the snapshot */
+    uint64_t timestamp_nsec;
+
+    uint64_t values[UCX_SHM_EXPORT_COUNTERS_MAX];
+} ucx_shm_export_slot_t;
+
+typedef struct ucx_shm_export_segment {
+    ucx_shm_export_header_t header;
+    ucx_shm_export_slot_t slots[UCX_SHM_EXPORT_RANKS_MAX];
+} ucx_shm_export_segment_t;
+
+#endif /* _UCX_SHM_LAYOUT_H_ */
@@ -0,0 +1,260 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+#if !defined(_UCX_SIDECAR_FORMAT_H_)
+#define _UCX_SIDECAR_FORMAT_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+/*
+   Columnar per-rank counters sidecar file.
+
+   file:   header, blocks...
+   header: magic[8] "UCXSIDE1", uint32 version, int32 rank, uint32 num_counters,
+           uint32 hostname length, hostname, (uint32 name length, name) per counter
+   block:  uint32 magic, uint32 num_samples, uint32 payload size, payload
+   payload (columns, each block decodes on its own):
+           timestamps - varint first timestamp, then zigzag varint delta-of-delta
+           counter    - varint first value, then zigzag varint delta (per counter)
+
+   Timestamps are CLOCK_REALTIME nano seconds (comparable across the nodes).
+*/
+
+#define UCX_SIDECAR_MAGIC               "UCXSIDE1"
+#define UCX_SIDECAR_VERSION             1
+#define UCX_SIDECAR_BLOCK_MAGIC         0x4b4c4255 /* "UBLK" */
+#define UCX_SIDECAR_FILENAME_FORMAT     "%s/ucx_counters.%s.%d.ucxc"
+
+/* Number of samples per block (per writer buffer, a block is decoded as a whole) */
+#define UCX_SIDECAR_BLOCK_SAMPLES       1024
+
+typedef struct ucx_sidecar_header {
+    int32_t rank;
+    std::string hostname;
+    std::vector<std::string> names;
+} ucx_sidecar_header_t;
+
+static inline uint64_t
+ucx_sidecar_zigzag_encode(int64_t value)
+{
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static inline int64_t
+ucx_sidecar_zigzag_decode(uint64_t value)
+{
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static inline void
+ucx_sidecar_varint_put(std::vector<uint8_t> *out, uint64_t value)
+{
+    while (value >= 0x80) {
+        out->push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    out->push_back((uint8_t)value);
+}
+
+/* returns: The number of bytes read, 0 on a truncated buffer */
+static inline size_t
+ucx_sidecar_varint_get(const uint8_t *in, size_t size, uint64_t *value)
+{
+    uint64_t result = 0;
+    size_t i;
+
+    for (i = 0; (i < size) && (i < 10); i++) {
+        result |= (uint64_t)(in[i] & 0x7f) << (7 * i);
+        if (!(in[i] & 0x80)) {
+            *value = result;
+            return i + 1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+   Encode a block of samples.
+
+   samples - row major: num_samples x (timestamp, num_counters values).
+*/
+static inline void
+ucx_sidecar_block_encode(const uint64_t *samples, uint32_t num_samples, uint32_t num_counters,
+    std::vector<uint8_t> *payload)
+{
+    uint32_t stride = num_counters + 1;
+    int64_t prev_delta = 0;
+    uint32_t i;
+    uint32_t j;
+
+    payload->clear();
+    if (num_samples == 0) {
+        return;
+    }
+
+    /* Timestamps: delta-of-delta */
+    ucx_sidecar_varint_put(payload, samples[0]);
+    for (i = 1; i < num_samples; i++) {
+        int64_t delta = (int64_t)(samples[i * stride] - samples[(i - 1) * stride]);
+
+        ucx_sidecar_varint_put(payload, ucx_sidecar_zigzag_encode(delta - prev_delta));
+        prev_delta = delta;
+    }
+
+    /* Counters: delta (mostly small for the cumulative counters) */
+    for (j = 1; j < stride; j++) {
+        ucx_sidecar_varint_put(payload, samples[j]);
+        for (i = 1; i < num_samples; i++) {
+            ucx_sidecar_varint_put(payload, ucx_sidecar_zigzag_encode(
+                (int64_t)(samples[i * stride + j] - samples[(i - 1) * stride + j])));
+        }
+    }
+}
+
+/* Decode a block of samples (row major), returns 0 on success */
+static inline int
+ucx_sidecar_block_decode(const uint8_t *payload, size_t size, uint32_t num_samples,
+    uint32_t num_counters, uint64_t *samples)
+{
+    uint32_t stride = num_counters + 1;
+    size_t offset = 0;
+    int64_t delta = 0;
+    uint64_t value;
+    size_t len;
+    uint32_t i;
+    uint32_t j;
+
+    for (j = 0; (j < stride) && (num_samples > 0); j++) {
+        for (i = 0; i < num_samples; i++) {
+            len = ucx_sidecar_varint_get(payload + offset, size - offset, &value);
+            if (len == 0) {
+                return -1;
+            }
+            offset += len;
+
+            if (i == 0) {
+                samples[j] = value;
+            }
+            else if (j == 0) {
+                delta += ucx_sidecar_zigzag_decode(value);
+                samples[i * stride] = samples[(i - 1) * stride] + delta;
+            }
+            else {
+                samples[i * stride + j] = samples[(i - 1) * stride + j] +
+                                              ucx_sidecar_zigzag_decode(value);
+            }
+        }
+    }
+
+    return 0;
+}
+
+static inline void
+ucx_sidecar_string_write(FILE *file, const std::string& str)
+{
+    uint32_t len = (uint32_t)str.size();
+
+    fwrite(&len, sizeof(len), 1, file);
+    fwrite(str.data(), 1, len, file);
+}
+
+static inline int
+ucx_sidecar_string_read(FILE *file, std::string *str)
+{
+    uint32_t len;
+
+    if ((fread(&len, sizeof(len), 1, file) != 1) || (len > 4096)) {
+        return -1;
+    }
+
+    str->resize(len);
+    return (fread(&(*str)[0], 1, len, file) == len) ? 0 : -1;
+}
+
+static inline void
+ucx_sidecar_header_write(FILE *file, const ucx_sidecar_header_t *header)
+{
+    uint32_t version = UCX_SIDECAR_VERSION;
+    uint32_t num_counters = (uint32_t)header->names.size();
+
+    fwrite(UCX_SIDECAR_MAGIC, 1, 8, file);
+    fwrite(&version, sizeof(version), 1, file);
+    fwrite(&header->rank, sizeof(header->rank), 1, file);
+    fwrite(&num_counters, sizeof(num_counters), 1, file);
+    ucx_sidecar_string_write(file, header->hostname);
+    for (auto& name : header->names) {
+        ucx_sidecar_string_write(file, name);
+    }
+}
+
+/* returns 0 on success */
+static inline int
+ucx_sidecar_header_read(FILE *file, ucx_sidecar_header_t *header)
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t num_counters;
+    uint32_t i;
+
+    if ((fread(magic, 1, 8, file) != 8) || (memcmp(magic, UCX_SIDECAR_MAGIC, 8) != 0) ||
+        (fread(&version, sizeof(version), 1, file) != 1) || (version != UCX_SIDECAR_VERSION) ||
+        (fread(&header->rank, sizeof(header->rank), 1, file) != 1) ||
+        (fread(&num_counters, sizeof(num_counters), 1, file) != 1) ||
+        (ucx_sidecar_string_read(file, &header->hostname) != 0)) {
+        return -1;
+    }
+
+    header->names.resize(num_counters);
+    for (i = 0; i < num_counters; i++) {
+        if (ucx_sidecar_string_read(file, &header->names[i]) != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static inline void
+ucx_sidecar_block_write(FILE *file, uint32_t num_samples, const std::vector<uint8_t>& payload)
+{
+    uint32_t block[3] = {UCX_SIDECAR_BLOCK_MAGIC, num_samples, (uint32_t)payload.size()};
+
+    fwrite(block, sizeof(block), 1, file);
+    fwrite(payload.data(), 1, payload.size(), file);
+}
+
+/*
+   Read the next block (samples: row major, resized).
+
+   returns: The number of samples, 0 at the end of the file (or a corrupted block).
+*/
+static inline uint32_t
+ucx_sidecar_block_read(FILE *file, uint32_t num_counters, std::vector<uint8_t> *payload,
+    std::vector<uint64_t> *samples)
+{
+    uint32_t block[3];
+
+    if ((fread(block, sizeof(block), 1, file) != 1) || (block[0] != UCX_SIDECAR_BLOCK_MAGIC)) {
+        return 0;
+    }
+
+    payload->resize(block[2]);
+    samples->resize((size_t)block[1] * (num_counters + 1));
+    if ((fread(payload->data(), 1, block[2], file) != block[2]) ||
+        (ucx_sidecar_block_decode(payload->data(), block[2], block[1], num_counters,
+                                  samples->data()) != 0)) {
+        return 0;
+    }
+
+    return block[1];
+}
+
+#endif /* _UCX_SIDECAR_FORMAT_H_ */
@@ -0,0 +1,211 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <chrono>
+
+#include <utils.h>
+
+#include "ucx_sidecar_writer.h"
+
+ucx_sidecar_writer::ucx_sidecar_writer()
+{
+    m_sampling = NULL;
+    m_num_counters = 0;
+    m_period_usec = UCX_SIDECAR_PERIOD_USEC_DEFAULT;
+    m_file = NULL;
+    m_active = 0;
+    m_active_samples = 0;
+    m_pending = -1;
+    m_pending_samples = 0;
+    m_writer_stop = 0;
+    m_running = 0;
+    m_samples_total = 0;
+    m_bytes_total = 0;
+    m_start_nsec = 0;
+    m_elapsed_nsec = 0;
+    m_cpu_nsec = 0;
+}
+
+/* CPU time of the calling thread (nano seconds) */
+static uint64_t
+thread_cpu_nsec_get()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+ucx_sidecar_writer::~ucx_sidecar_writer()
+{
+    stop();
+}
+
+int
+ucx_sidecar_writer::start(ucx_sampling *sampling, int rank, const char *dir, uint64_t period_usec)
+{
+    ucx_sidecar_header_t header;
+    char filename[1024];
+    char hostname[256];
+    uint32_t i;
+
+    if (m_file != NULL) {
+        return 0;
+    }
+
+    m_sampling = sampling;
+    m_num_counters = (uint32_t)m_sampling->counters_num_get();
+    m_period_usec = period_usec;
+
+    snprintf(filename, sizeof(filename), UCX_SIDECAR_FILENAME_FORMAT,
+        (dir != NULL) ? dir : ".", job_id_get().c_str(), rank);
+    m_file = fopen(filename, "wb");
+    if (m_file == NULL) {
+        printf("Warning: could not open the sidecar file %s, errno=%d\n", filename, errno);
+        return -1;
+    }
+
+    if (gethostname(hostname, sizeof(hostname)) != 0) {
+        strcpy(hostname, "unknown");
+    }
+    hostname[sizeof(hostname) - 1] = '\0';
+
+    header.rank = rank;
+    header.hostname = hostname;
+    for (i = 0; i < m_num_counters; i++) {
+        std::string name;
+
+        m_sampling->counter_name_get(i, &name);
+        header.names.push_back(name);
+    }
+    ucx_sidecar_header_write(m_file, &header);
+
+    m_buffers[0].resize((size_t)UCX_SIDECAR_BLOCK_SAMPLES * (m_num_counters + 1));
+    m_buffers[1].resize((size_t)UCX_SIDECAR_BLOCK_SAMPLES * (m_num_counters + 1));
+
+    m_writer_stop = 0;
+    m_start_nsec = time_nsec_get();
+    m_running = 1;
+    m_writer = std::thread(&ucx_sidecar_writer::writer_run, this);
+    m_sampler = std::thread(&ucx_sidecar_writer::sampler_run, this);
+
+    return 0;
+}
+
+void
+ucx_sidecar_writer::stop()
+{
+    if (m_file == NULL) {
+        return;
+    }
+
+    m_running = 0;
+    m_sampler.join();
+
+    /* The last (partial) block */
+    if (m_active_samples > 0) {
+        buffer_submit();
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_writer_stop = 1;
+        m_cond.notify_all();
+    }
+    m_writer.join();
+
+    fclose(m_file);
+    m_file = NULL;
+    m_elapsed_nsec = time_nsec_get() - m_start_nsec;
+
+    DEBUG_PRINT("Sidecar: %lu samples, %lu bytes (%.2f bytes/sample)\n", m_samples_total,
+        m_bytes_total, m_samples_total ? (double)m_bytes_total / m_samples_total : 0.0);
+}
+
+void
+ucx_sidecar_writer::sampler_run()
+{
+    auto next = std::chrono::steady_clock::now();
+    struct timespec now;
+    uint64_t *sample;
+
+    while (m_running.load(std::memory_order_relaxed)) {
+        m_sampling->backends_refresh();
+        clock_gettime(CLOCK_REALTIME, &now);
+
+        sample = &m_buffers[m_active][(size_t)m_active_samples * (m_num_counters + 1)];
+        sample[0] = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+        m_sampling->snapshot_copy(0, m_num_counters, &sample[1]);
+
+        if (++m_active_samples == UCX_SIDECAR_BLOCK_SAMPLES) {
+            buffer_submit();
+        }
+
+        next += std::chrono::microseconds(m_period_usec);
+        std::this_thread::sleep_until(next);
+    }
+
+    m_cpu_nsec += thread_cpu_nsec_get();
+}
+
+void
+ucx_sidecar_writer::buffer_submit()
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    /* The writer is still busy with the other buffer */
+    m_cond.wait(lock, [this] { return (m_pending < 0); });
+
+    m_pending = (int)m_active;
+    m_pending_samples = m_active_samples;
+    m_active ^= 1;
+    m_active_samples = 0;
+
+    m_cond.notify_all();
+}
+
+void
+ucx_sidecar_writer::writer_run()
+{
+    std::vector<uint8_t> payload;
+
+    payload.reserve((size_t)UCX_SIDECAR_BLOCK_SAMPLES * (m_num_counters + 1) * 2);
+
+    while (1) {
+        std::unique_lock<std::mutex> lock(m_lock);
+        uint32_t num_samples;
+        int buffer;
+
+        m_cond.wait(lock, [this] { return ((m_pending >= 0) || m_writer_stop); });
+        if (m_pending < 0) {
+            /* Stopped, nothing pending */
+            break;
+        }
+
+        buffer = m_pending;
+        num_samples = m_pending_samples;
+        lock.unlock();
+
+        /* Encode and write outside the lock */
+        ucx_sidecar_block_encode(m_buffers[buffer].data(), num_samples, m_num_counters, &payload);
+        ucx_sidecar_block_write(m_file, num_samples, payload);
+        m_samples_total += num_samples;
+        m_bytes_total += payload.size();
+
+        lock.lock();
+        m_pending = -1;
+        m_cond.notify_all();
+    }
+
+    m_cpu_nsec += thread_cpu_nsec_get();
+}
@@ -0,0 +1,103 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+#if !defined(_UCX_SIDECAR_WRITER_H_)
+#define _UCX_SIDECAR_WRITER_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <ucx_sidecar_format.h>
+#include <ucx_sampling.h>
+
+/* Default sidecar sampling period (micro seconds) */
+#define UCX_SIDECAR_PERIOD_USEC_DEFAULT     500
+
+/*
+   Columnar per-rank counters sidecar file writer.
+
+   A sampler thread refreshes the backends (serialized with the Score-P
+   locations) and records a consistent snapshot of all the counters every
+   period into the active buffer. Full buffers are handed to a background writer thread (double
+   buffering), which encodes them column-wise and writes the file.
+*/
+class ucx_sidecar_writer {
+public:
+   ucx_sidecar_writer();
+
+   ~ucx_sidecar_writer();
+
+   /*
+      Create the rank file and start the sampler and writer threads.
+
+      returns: 0 on success, -1 otherwise.
+   */
+   int
+   start(ucx_sampling *sampling, int rank, const char *dir, uint64_t period_usec);
+
+   /* Stop the threads, write the last samples and close the file */
+   void
+   stop();
+
+   /* Number of samples written */
+   uint64_t
+   samples_total_get() {
+       return m_samples_total;
+   }
+
+   /* CPU time of the sampler and writer threads, as a fraction of the elapsed time (after stop) */
+   double
+   cpu_fraction_get() {
+       return m_elapsed_nsec ? ((double)m_cpu_nsec / m_elapsed_nsec) : 0.0;
+   }
+
+private:
+   void
+   sampler_run();
+
+   void
+   writer_run();
+
+   /* Hand the active buffer over to the writer (waits for the writer, not the application) */
+   void
+   buffer_submit();
+
+   ucx_sampling *m_sampling;
+   uint32_t m_num_counters;
+   uint64_t m_period_usec;
+   FILE *m_file;
+
+   /* Double buffer: samples (row major) */
+   std::vector<uint64_t> m_buffers[2];
+   uint32_t m_active;
+   uint32_t m_active_samples;
+
+   /* Buffer handed to the writer (-1: none) */
+   int m_pending;
+   uint32_t m_pending_samples;
+   int m_writer_stop;
+   std::mutex m_lock;
+   std::condition_variable m_cond;
+
+   std::atomic<int> m_running;
+   std::thread m_sampler;
+   std::thread m_writer;
+
+   /* Statistics */
+   uint64_t m_samples_total;
+   uint64_t m_bytes_total;
+   uint64_t m_start_nsec;
+   uint64_t m_elapsed_nsec;
+   std::atomic<uint64_t> m_cpu_nsec;
+};
+
+#endif /* _UCX_SIDECAR_WRITER_H_ */
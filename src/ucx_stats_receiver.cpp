@@ -0,0 +1,302 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <algorithm>
+
+#include <utils.h>
+#include <scorep_plugin_ucx_config.h>
+
+#include "ucx_stats_receiver.h"
+
+ucx_stats_receiver::ucx_stats_receiver()
+{
+    m_lock_fd = -1;
+    m_running = 0;
+    m_num_counters = 0;
+    m_datagrams = 0;
+    m_dumps = 0;
+    m_dumps_dropped = 0;
+}
+
+ucx_stats_receiver::~ucx_stats_receiver()
+{
+    stop();
+}
+
+int
+ucx_stats_receiver::start(int port, const ucs_stats_aggrgt_counter_name_t *names, size_t num_names)
+{
+    char lock_name[256];
+    const char *address = UCX_STATS_UDP_ADDRESS_DEFAULT;
+    struct sockaddr_in addr;
+    int num_threads = UCX_STATS_RECEIVER_THREADS_DEFAULT;
+    int enable = 1;
+    size_t i;
+    int fd;
+
+    /*
+       One receiver per node and job: the first process to lock the job file.
+       The file is not removed at stop, a later process would lock a new file
+       while a current receiver still holds the unlinked one.
+    */
+    snprintf(lock_name, sizeof(lock_name), "/dev/shm/scorep_ucx.%s.udp.lock", job_id_get().c_str());
+    m_lock_fd = open(lock_name, O_CREAT | O_RDWR, 0644);
+    if ((m_lock_fd < 0) || (flock(m_lock_fd, LOCK_EX | LOCK_NB) != 0)) {
+        if (m_lock_fd >= 0) {
+            close(m_lock_fd);
+            m_lock_fd = -1;
+        }
+        return -1;
+    }
+
+    m_num_counters = num_names;
+    for (i = 0; i < num_names; i++) {
+        m_counter_index[std::string(names[i].class_name) + "_" + names[i].counter_name] = (int32_t)i;
+    }
+
+    const char *threads_env = getenv(ENV_SCOREP_UCX_PLUGIN_UDP_RECEIVER_THREADS);
+    if (threads_env != NULL) {
+        num_threads = std::max(atoi(threads_env), 1);
+    }
+
+    /* Loopback by default: the statistics are not exposed to other hosts */
+    const char *address_env = getenv(ENV_SCOREP_UCX_PLUGIN_UDP_ADDRESS);
+    if (address_env != NULL) {
+        address = address_env;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, address, &addr.sin_addr) != 1) {
+        printf("Warning: invalid UCX statistics receiver address %s\n", address);
+        stop();
+        return -1;
+    }
+
+    for (i = 0; i < (size_t)num_threads; i++) {
+        fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd < 0) {
+            break;
+        }
+
+        if ((setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) != 0) ||
+            (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)) {
+            printf("Warning: could not bind the UCX statistics receiver %s:%d, errno=%d\n", address,
+                port, errno);
+            close(fd);
+            break;
+        }
+
+        m_fds.push_back(fd);
+    }
+
+    if (m_fds.empty()) {
+        stop();
+        return -1;
+    }
+
+    m_running = 1;
+    for (auto fd : m_fds) {
+        m_threads.push_back(std::thread(&ucx_stats_receiver::receiver_run, this, fd));
+    }
+
+    printf("UCX statistics receiver: %s:%d, %zu sockets (UCX_STATS_DEST=udp:%s:%d)\n",
+        address, port, m_fds.size(),
+        (addr.sin_addr.s_addr == htonl(INADDR_ANY)) ? "<this node>" : address, port);
+
+    return 0;
+}
+
+void
+ucx_stats_receiver::stop()
+{
+    m_running = 0;
+
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+    m_threads.clear();
+
+    for (auto fd : m_fds) {
+        close(fd);
+    }
+
+    if (!m_fds.empty()) {
+        DEBUG_PRINT("UCX statistics receiver: %lu datagrams, %lu dumps (%lu dropped), %zu senders\n",
+            m_datagrams.load(), m_dumps.load(), m_dumps_dropped.load(), m_senders.size());
+    }
+    m_fds.clear();
+
+    /* Release the election (the lock file is kept) */
+    if (m_lock_fd >= 0) {
+        close(m_lock_fd);
+        m_lock_fd = -1;
+    }
+}
+
+void
+ucx_stats_receiver::receiver_run(int fd)
+{
+    static thread_local char buffers[UCX_STATS_RECEIVER_BATCH][UCX_STATS_RECEIVER_DATAGRAM_MAX];
+    struct mmsghdr msgs[UCX_STATS_RECEIVER_BATCH];
+    struct iovec iovs[UCX_STATS_RECEIVER_BATCH];
+    struct sockaddr_in senders[UCX_STATS_RECEIVER_BATCH];
+    struct pollfd pfd = {fd, POLLIN, 0};
+    dumps_t dumps;
+    int num_msgs;
+    int i;
+
+    while (m_running) {
+        if (poll(&pfd, 1, UCX_STATS_RECEIVER_POLL_MSEC) <= 0) {
+            continue;
+        }
+
+        memset(msgs, 0, sizeof(msgs));
+        for (i = 0; i < UCX_STATS_RECEIVER_BATCH; i++) {
+            iovs[i].iov_base = buffers[i];
+            iovs[i].iov_len = sizeof(buffers[i]);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = &senders[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(senders[i]);
+        }
+
+        /* Drain a batch of datagrams with a single system call */
+        num_msgs = recvmmsg(fd, msgs, UCX_STATS_RECEIVER_BATCH, MSG_DONTWAIT, NULL);
+        for (i = 0; i < num_msgs; i++) {
+            std::string sender((const char *)&senders[i], sizeof(senders[i]));
+
+            datagram_handle(&dumps, sender, buffers[i], msgs[i].msg_len);
+        }
+        m_datagrams += std::max(num_msgs, 0);
+    }
+}
+
+void
+ucx_stats_receiver::datagram_handle(dumps_t *dumps, const std::string& sender, const char *data,
+    size_t size)
+{
+    const ucx_stats_packet_hdr_t *hdr = (const ucx_stats_packet_hdr_t *)data;
+
+    if ((size < sizeof(*hdr)) ||
+        (memcmp(hdr->magic, UCX_STATS_RECEIVER_MAGIC, sizeof(hdr->magic)) != 0) ||
+        (hdr->total_size > UCX_STATS_RECEIVER_DUMP_SIZE_MAX) ||
+        (hdr->frag_size != (size - sizeof(*hdr))) ||
+        ((uint64_t)hdr->frag_offset + hdr->frag_size > hdr->total_size)) {
+        return;
+    }
+
+    dump_t& dump = (*dumps)[sender];
+
+    /* A newer dump of the sender: drop the incomplete one */
+    if ((dump.timestamp != hdr->timestamp) || (dump.total_size != hdr->total_size) ||
+        dump.buffer.empty()) {
+        if (dump.received_size != 0) {
+            m_dumps_dropped++;
+        }
+        dump.timestamp = hdr->timestamp;
+        dump.total_size = hdr->total_size;
+        dump.received_size = 0;
+        dump.buffer.resize(hdr->total_size);
+    }
+
+    memcpy(&dump.buffer[hdr->frag_offset], data + sizeof(*hdr), hdr->frag_size);
+    dump.received_size += hdr->frag_size;
+
+    if (dump.received_size >= dump.total_size) {
+        dump_complete(sender, dump);
+        dump.received_size = 0;
+    }
+}
+
+void
+ucx_stats_receiver::tree_sum(const ucs_stats_node_t *node, std::vector<uint64_t> *sums)
+{
+    ucs_stats_node_t *child;
+    unsigned k;
+
+    for (k = 0; k < node->cls->num_counters; k++) {
+        auto index = m_counter_index.find(std::string(node->cls->name) + "_" + node->cls->counter_names[k]);
+
+        if (index != m_counter_index.end()) {
+            (*sums)[index->second] += node->counters[k];
+        }
+    }
+
+    ucs_list_for_each(child, &node->children[UCS_STATS_ACTIVE_CHILDREN], list) {
+        tree_sum(child, sums);
+    }
+}
+
+void
+ucx_stats_receiver::dump_complete(const std::string& sender, const dump_t& dump)
+{
+    std::vector<uint64_t> sums(m_num_counters, 0);
+    ucs_stats_node_t *root;
+    ucs_status_t status;
+    FILE *stream;
+
+    stream = fmemopen((void *)dump.buffer.data(), dump.total_size, "rb");
+    if (stream == NULL) {
+        return;
+    }
+
+    status = ucs_stats_deserialize(stream, &root);
+    fclose(stream);
+    if (status != UCS_OK) {
+        m_dumps_dropped++;
+        return;
+    }
+
+    tree_sum(root, &sums);
+
+    /* The root node name (host:pid) identifies the UCX process, also across sender sockets */
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+
+        m_senders[(root->name[0] != '\0') ? std::string(root->name) : sender] = sums;
+    }
+
+    ucs_stats_free(root);
+    m_dumps++;
+}
+
+void
+ucx_stats_receiver::counters_sum(uint64_t *values, size_t size)
+{
+    size_t i;
+
+    size = std::min(size, m_num_counters);
+    memset(values, 0, size * sizeof(values[0]));
+
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    for (auto& sender : m_senders) {
+        for (i = 0; i < size; i++) {
+            values[i] += sender.second[i];
+        }
+    }
+}
+
+size_t
+ucx_stats_receiver::senders_num_get()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    return m_senders.size();
+}
@@ -0,0 +1,135 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+#if !defined(_UCX_STATS_RECEIVER_H_)
+#define _UCX_STATS_RECEIVER_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <ucs/stats/libstats.h>
+#include <ucs/stats/stats.h>
+#ifdef __cplusplus
+}
+#endif
+
+/* UCX statistics UDP packet (ucs/stats/client_server.c), must match the UCX statistics client */
+#define UCX_STATS_RECEIVER_MAGIC            "UCSSTAT1"
+
+typedef struct __attribute__((packed)) ucx_stats_packet_hdr {
+   char magic[8];
+   uint64_t timestamp;
+   uint32_t total_size;
+   uint32_t frag_offset;
+   uint32_t frag_size;
+} ucx_stats_packet_hdr_t;
+
+/* Datagrams per recvmmsg() call */
+#define UCX_STATS_RECEIVER_BATCH            64
+
+/* Maximum datagram size */
+#define UCX_STATS_RECEIVER_DATAGRAM_MAX     2048
+
+/* Default number of receiver sockets / threads (SO_REUSEPORT) */
+#define UCX_STATS_RECEIVER_THREADS_DEFAULT  2
+
+/* Receiver threads poll timeout (milli seconds), bounds the stop latency */
+#define UCX_STATS_RECEIVER_POLL_MSEC        100
+
+/* Incomplete dumps older than the newest one of the sender are dropped */
+#define UCX_STATS_RECEIVER_DUMP_SIZE_MAX    (64 * 1024 * 1024)
+
+/*
+   Per node UCX statistics receiver.
+
+   One process per node and job (flock election) binds the job port with
+   several SO_REUSEPORT sockets, each drained by a thread with recvmmsg().
+   The kernel keeps a sender on one socket, so the fragments of a dump are
+   reassembled per thread without locking. A complete dump is deserialized
+   (ucs_stats_deserialize()) and summed into the aggregate-sum counters layout;
+   the latest sums of every sender (UCX process) are kept, also after it exits.
+*/
+class ucx_stats_receiver {
+public:
+   ucx_stats_receiver();
+
+   ~ucx_stats_receiver();
+
+   /*
+      Start the receiver threads, if this process is the node receiver.
+
+      returns: 0 on success, -1 otherwise (not the node receiver, or no port).
+   */
+   int
+   start(int port, const ucs_stats_aggrgt_counter_name_t *names, size_t num_names);
+
+   void
+   stop();
+
+   /* Sum of the latest counters of all the senders */
+   void
+   counters_sum(uint64_t *values, size_t size);
+
+   /* Number of senders (UCX processes) received so far */
+   size_t
+   senders_num_get();
+
+private:
+   /* Dump under reassembly */
+   typedef struct dump {
+       uint64_t timestamp;
+       uint32_t total_size;
+       uint32_t received_size;
+       std::vector<char> buffer;
+   } dump_t;
+
+   /* Per thread: sender address -> dump under reassembly */
+   typedef std::map<std::string, dump_t> dumps_t;
+
+   void
+   receiver_run(int fd);
+
+   void
+   datagram_handle(dumps_t *dumps, const std::string& sender, const char *data, size_t size);
+
+   /* Deserialize a dump and publish its sums */
+   void
+   dump_complete(const std::string& sender, const dump_t& dump);
+
+   void
+   tree_sum(const ucs_stats_node_t *node, std::vector<uint64_t> *sums);
+
+   /* Node receiver election (per job lock file) */
+   int m_lock_fd;
+
+   std::vector<int> m_fds;
+   std::vector<std::thread> m_threads;
+   std::atomic<int> m_running;
+
+   /* Aggregate-sum names: "<class>_<counter>" -> index */
+   std::unordered_map<std::string, int32_t> m_counter_index;
+   size_t m_num_counters;
+
+   /* Sender (root node name: host:pid) -> latest sums */
+   std::mutex m_lock;
+   std::map<std::string, std::vector<uint64_t> > m_senders;
+
+   /* Statistics */
+   std::atomic<uint64_t> m_datagrams;
+   std::atomic<uint64_t> m_dumps;
+   std::atomic<uint64_t> m_dumps_dropped;
+};
+
+#endif /* _UCX_STATS_RECEIVER_H_ */
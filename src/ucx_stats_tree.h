@@ -0,0 +1,52 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+#if !defined(_UCX_STATS_TREE_H_)
+#define _UCX_STATS_TREE_H_
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <ucs/stats/stats.h>
+#ifdef __cplusplus
+}
+#endif
+
+/*
+   Helpers to read the live UCX statistics tree in place (without the UCX
+   stats lock, which is not exported).
+*/
+
+/*
+   Iterate over the active children of a node. A child destroyed during the
+   walk is moved to the inactive children list of its parent (see
+   ucx_stats_tree_nodes_persistent()), so the walk also ends at that list head.
+*/
+#define UCX_STATS_TREE_FOR_EACH_CHILD(_child, _node) \
+    for (_child = ucs_container_of((_node)->children[UCS_STATS_ACTIVE_CHILDREN].next, \
+                                   ucs_stats_node_t, list); \
+         (&(_child)->list != &(_node)->children[UCS_STATS_ACTIVE_CHILDREN]) && \
+         (&(_child)->list != &(_node)->children[UCS_STATS_INACTIVE_CHILDREN]); \
+         _child = ucs_container_of((_child)->list.next, ucs_stats_node_t, list))
+
+/*
+   Are the destroyed statistics nodes kept until the UCX cleanup?
+   With a UCX_STATS_TRIGGER "exit" (the UCX default) the statistics are dumped
+   at exit, so a destroyed node is moved to the inactive children of its parent
+   instead of being freed: a cached node (counter) address stays readable.
+*/
+static inline int
+ucx_stats_tree_nodes_persistent()
+{
+    const char *trigger = getenv("UCX_STATS_TRIGGER");
+
+    return (trigger == NULL) || (strstr(trigger, "exit") != NULL);
+}
+
+#endif /* _UCX_STATS_TREE_H_ */
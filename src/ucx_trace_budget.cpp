@@ -0,0 +1,138 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+#include <stdio.h>
+#include <algorithm>
+
+#include <utils.h>
+#include <scorep_plugin_ucx_config.h>
+
+#include "ucx_trace_budget.h"
+
+ucx_trace_budget::ucx_trace_budget()
+{
+    m_event_rate = 0;
+    m_budget = 0;
+    m_decimation = 1;
+    m_num_counters = 0;
+    m_requested_counters = 0;
+    m_projected_bytes_per_sec = 0;
+    m_start_nsec = 0;
+}
+
+uint32_t
+ucx_trace_budget::compressed_size(uint64_t value)
+{
+    uint32_t size = 1;
+
+    while (value != 0) {
+        size++;
+        value >>= 8;
+    }
+
+    return size;
+}
+
+void
+ucx_trace_budget::plan(double clock_hz, uint64_t delta_t, uint64_t event_rate, uint32_t num_counters,
+    uint32_t reducible_counters, uint64_t budget, uint32_t decimation_max)
+{
+    double max_rate = ((delta_t > 0) && (clock_hz > 0)) ? (clock_hz / delta_t) : 0;
+    double record_bytes;
+
+    m_start_nsec = time_nsec_get();
+    m_budget = budget;
+    m_decimation = 1;
+    m_num_counters = num_counters;
+    m_requested_counters = num_counters;
+    decimation_max = std::max(decimation_max, 1U);
+
+    /* Events are sampled at most once per delta_t */
+    m_event_rate = (event_rate > 0) ? (double)event_rate : max_rate;
+    if ((max_rate > 0) && (m_event_rate > max_rate)) {
+        m_event_rate = max_rate;
+    }
+
+    record_bytes = UCX_TRACE_BUDGET_RECORD_BYTES + (double)num_counters * UCX_TRACE_BUDGET_VALUE_BYTES_MAX;
+    m_projected_bytes_per_sec = m_event_rate * record_bytes;
+
+    if ((m_budget == 0) || (m_projected_bytes_per_sec <= m_budget)) {
+        return;
+    }
+
+    /* Decimate the samples first (keeps all the counters) */
+    m_decimation = (uint32_t)std::min((double)decimation_max,
+                                      (m_projected_bytes_per_sec + m_budget - 1) / m_budget);
+    if (m_decimation == decimation_max) {
+        /* Then record the counters that fit in the budget */
+        double sample_bytes = (double)m_budget * m_decimation / m_event_rate;
+        uint32_t fit = (sample_bytes > UCX_TRACE_BUDGET_RECORD_BYTES) ?
+                       (uint32_t)((sample_bytes - UCX_TRACE_BUDGET_RECORD_BYTES) /
+                                  UCX_TRACE_BUDGET_VALUE_BYTES_MAX) : 0;
+        uint32_t min_counters = std::max(num_counters - std::min(reducible_counters, num_counters), 1U);
+
+        m_num_counters = std::min(num_counters, std::max(fit, min_counters));
+    }
+
+    m_projected_bytes_per_sec = (m_event_rate / m_decimation) *
+        (UCX_TRACE_BUDGET_RECORD_BYTES + (double)m_num_counters * UCX_TRACE_BUDGET_VALUE_BYTES_MAX);
+}
+
+void
+ucx_trace_budget::plan_report()
+{
+    if (m_event_rate == 0) {
+        printf("UCX trace volume: unknown event rate (set %s)\n", ENV_SCOREP_UCX_PLUGIN_TRACE_EVENT_RATE);
+        return;
+    }
+
+    printf("UCX trace volume: %u counters, %.0f events/s, 1 of %u samples, %u of %u counters, "
+           "projected %.0f bytes/s per location",
+           m_requested_counters, m_event_rate, m_decimation, m_num_counters, m_requested_counters,
+           m_projected_bytes_per_sec);
+    if (m_budget) {
+        printf(" (budget %lu bytes/s)", (unsigned long)m_budget);
+    }
+    printf("\n");
+
+    if (m_budget && (m_projected_bytes_per_sec > m_budget)) {
+        printf("Warning: the UCX trace volume budget cannot be met (%s)\n", ENV_SCOREP_UCX_PLUGIN_TRACE_BUDGET);
+    }
+}
+
+void
+ucx_trace_budget::finalize_report(uint64_t value_bytes, const std::vector<const location_t *>& locations)
+{
+    double elapsed_sec = (time_nsec_get() - m_start_nsec) / 1e9;
+    uint64_t events = 0;
+    uint64_t records = 0;
+    double event_rate;
+    double bytes_per_sec;
+
+    if (locations.empty() || (elapsed_sec <= 0)) {
+        return;
+    }
+
+    for (auto location : locations) {
+        events += location->events;
+        records += location->records;
+    }
+
+    /* Per location averages */
+    event_rate = (double)events / locations.size() / elapsed_sec;
+    bytes_per_sec = (double)records * (UCX_TRACE_BUDGET_RECORD_BYTES + value_bytes) /
+                    locations.size() / elapsed_sec;
+
+    printf("UCX trace volume: %zu locations, %.0f events/s, %lu samples, %.0f bytes/s per location "
+           "(projected %.0f bytes/s, %.0f events/s)\n",
+           locations.size(), event_rate, (unsigned long)records, bytes_per_sec,
+           m_projected_bytes_per_sec, m_event_rate);
+
+    if (m_budget && (bytes_per_sec > m_budget)) {
+        printf("Warning: the UCX trace volume exceeded the budget (%lu bytes/s), set %s=%.0f\n",
+            (unsigned long)m_budget, ENV_SCOREP_UCX_PLUGIN_TRACE_EVENT_RATE, event_rate);
+    }
+}
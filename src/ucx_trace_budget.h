@@ -0,0 +1,98 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+#if !defined(_UCX_TRACE_BUDGET_H_)
+#define _UCX_TRACE_BUDGET_H_
+
+#include <stdint.h>
+#include <vector>
+
+/*
+   OTF2 metric record size model (bytes): the record header (type, length,
+   metric reference, number of values) and a value (type, compressed uint64:
+   one length byte followed by the significant bytes).
+*/
+#define UCX_TRACE_BUDGET_RECORD_BYTES           4
+#define UCX_TRACE_BUDGET_VALUE_BYTES_MAX        10
+
+/* Largest decimation factor, then the recorded UCX counters are reduced */
+#define UCX_TRACE_BUDGET_DECIMATION_MAX_DEFAULT 16
+
+/*
+   Trace volume estimator of the UCX metrics.
+
+   Projects the bytes per second per location written by the plugin from the
+   number of recorded counters, the event rate and the Score-P delta_t (the
+   minimal time between two samples of a location). With a budget, a sample
+   decimation factor is chosen, then the recorded counters are reduced if the
+   largest decimation factor is not enough. The recorded events and samples
+   are counted per location, to check the estimate at finalize.
+*/
+class ucx_trace_budget {
+public:
+   /* Per location counts (see ucx_location_t) */
+   typedef struct location {
+       uint64_t events;
+       uint64_t records;
+       /* Events to skip before the next recorded sample */
+       uint32_t countdown;
+       int skip;
+   } location_t;
+
+   ucx_trace_budget();
+
+   /*
+      Plan the recording of a location.
+
+      clock_hz: measurement clock ticks per second.
+      delta_t: Score-P minimal ticks between two samples of a location (0: none).
+      event_rate: expected events per second per location (0: delta_t bound).
+      num_counters: recorded counters, reducible_counters: the ones that can be dropped.
+      budget: bytes per second per location (0: estimate only).
+   */
+   void
+   plan(double clock_hz, uint64_t delta_t, uint64_t event_rate, uint32_t num_counters,
+        uint32_t reducible_counters, uint64_t budget, uint32_t decimation_max);
+
+   /* Sample decimation factor: one recorded sample of N events */
+   uint32_t
+   decimation_get() {
+       return m_decimation;
+   }
+
+   /* Number of recorded counters (after the reduction) */
+   uint32_t
+   counters_num_get() {
+       return m_num_counters;
+   }
+
+   /* Print the plan and the projected volume */
+   void
+   plan_report();
+
+   /*
+      Print the recorded events and samples of the locations against the estimate.
+
+      value_bytes: the average size of the recorded values of a sample.
+   */
+   void
+   finalize_report(uint64_t value_bytes, const std::vector<const location_t *>& locations);
+
+   /* Size of an OTF2 compressed uint64 (value byte model) */
+   static uint32_t
+   compressed_size(uint64_t value);
+
+private:
+   double m_event_rate;
+   uint64_t m_budget;
+   uint32_t m_decimation;
+   uint32_t m_num_counters;
+   uint32_t m_requested_counters;
+   double m_projected_bytes_per_sec;
+   uint64_t m_start_nsec;
+};
+
+#endif /* _UCX_TRACE_BUDGET_H_ */
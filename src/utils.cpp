@@ -1,8 +1,12 @@
 #include <cassert>
 #include <cstdlib>
 #include <iostream>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 #include <utils.h>
+#include <scorep_plugin_ucx_config.h>
 
 std::string
 to_lower(const std::string& input_string)
@@ -41,3 +45,138 @@ parse_metric (const std::string& metric, unsigned long long int *hex_dummy)
     *hex_dummy = strtoull(substrings[1].c_str(), NULL, 16);
     return { substrings[0], std::stoull(substrings[1]) };
 }
+
+
+std::string
+job_id_get()
+{
+    /* Resource manager / MPI launcher job IDs */
+    static const char *job_id_envs[] = {
+        ENV_SCOREP_UCX_PLUGIN_JOB_ID,
+        "SLURM_JOB_ID",
+        "PBS_JOBID",
+        "LSB_JOBID",
+        "OMPI_MCA_orte_ess_jobid",
+        "OMPI_MCA_ess_base_jobid",
+        "PMIX_NAMESPACE"
+    };
+    std::string job_id = "0";
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(job_id_envs); i++) {
+        const char *value = getenv(job_id_envs[i]);
+
+        if ((value != NULL) && (value[0] != '\0')) {
+            job_id = value;
+            break;
+        }
+    }
+
+    /* Usable as a file / shared-memory name */
+    std::replace_if(job_id.begin(), job_id.end(),
+        [](unsigned char c){ return !(std::isalnum(c) || (c == '-') || (c == '_')); }, '_');
+
+    return job_id;
+}
+
+int
+stats_udp_port_get()
+{
+    const char *port = getenv(ENV_SCOREP_UCX_PLUGIN_UDP_PORT);
+    std::string job_id;
+    uint32_t hash = 2166136261u;
+
+    if (port != NULL) {
+        return atoi(port);
+    }
+
+    /* FNV-1a of the job ID: jobs sharing a node use different ports */
+    job_id = job_id_get();
+    for (auto c : job_id) {
+        hash = (hash ^ (unsigned char)c) * 16777619u;
+    }
+
+    return UCX_STATS_UDP_PORT_BASE + (hash % UCX_STATS_UDP_PORT_RANGE);
+}
+
+int
+mpi_rank_env_get()
+{
+    /* MPI launcher / resource manager ranks (available before MPI_Init) */
+    static const char *rank_envs[] = {
+        "OMPI_COMM_WORLD_RANK",
+        "PMIX_RANK",
+        "PMI_RANK",
+        "MV2_COMM_WORLD_RANK",
+        "SLURM_PROCID"
+    };
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(rank_envs); i++) {
+        const char *value = getenv(rank_envs[i]);
+
+        if ((value != NULL) && (value[0] != '\0')) {
+            return atoi(value);
+        }
+    }
+
+    return -1;
+}
+
+uint64_t
+time_nsec_get()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000000000ull) + ts.tv_nsec;
+}
+
+uint64_t
+process_start_nsec_get()
+{
+    unsigned long long start_ticks = 0;
+    struct timespec boot_ts;
+    char buf[1024];
+    uint64_t boot_nsec;
+    uint64_t start_nsec;
+    const char *fields;
+    FILE *file;
+    size_t len;
+    int i;
+
+    file = fopen("/proc/self/stat", "r");
+    if (file == NULL) {
+        return 0;
+    }
+
+    len = fread(buf, 1, sizeof(buf) - 1, file);
+    fclose(file);
+    buf[len] = '\0';
+
+    /* Field 22 (starttime, clock ticks since boot): the fields after the ")" of comm */
+    fields = strrchr(buf, ')');
+    if (fields == NULL) {
+        return 0;
+    }
+
+    for (i = 0; (i < 20) && (fields != NULL); i++) {
+        fields = strchr(fields + 1, ' ');
+    }
+
+    if ((fields == NULL) || (sscanf(fields, "%llu", &start_ticks) != 1)) {
+        return 0;
+    }
+
+    /* Since boot (CLOCK_BOOTTIME) -> monotonic time domain */
+    clock_gettime(CLOCK_BOOTTIME, &boot_ts);
+    boot_nsec = ((uint64_t)boot_ts.tv_sec * 1000000000ull) + boot_ts.tv_nsec;
+    start_nsec = (uint64_t)start_ticks * (1000000000ull / sysconf(_SC_CLK_TCK));
+
+    if (start_nsec > boot_nsec) {
+        return 0;
+    }
+
+    return time_nsec_get() - (boot_nsec - start_nsec);
+}
@@ -0,0 +1,622 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+/*
+   Parallel merge of the per-rank counters sidecar files (ucx_counters.*.ucxc)
+   into a job-wide timeline.
+
+   The rank files are grouped by node. One worker thread per node group
+   k-way merges the node rank files by timestamp, aligns the samples into
+   common time buckets and writes the node rollup: the counter increments
+   of all the node ranks, per bucket. The job rollup then k-way merges the
+   node rollups. Only one decoded block per open rank file (and one line per
+   node rollup) is kept in memory.
+
+   A k-way merge opens at most fan_in files (-f, default 256). The fan-in and
+   the worker threads are lowered to fit RLIMIT_NOFILE, and the memory limit
+   (-m MB, default half of the physical memory) with one decoded block per
+   open rank file. Larger merges are hierarchical: groups of fan_in files are
+   merged into temporary rollups (<output>.part<level>.<index>), which are
+   merged in turn.
+
+   usage: ucx_merge [-b bucket_usec] [-t num_threads] [-f fan_in] [-m memory_mb] [-o output_dir] files...
+
+   output: <output_dir>/node.<hostname>.csv, <output_dir>/job.csv
+           (bucket start time [ns], counter increments...)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <ucx_sidecar_format.h>
+
+/* Largest number of files opened by a k-way merge */
+#define UCX_MERGE_FAN_IN_MAX        256
+
+/* File descriptors kept out of the fan-in budget (stdio, outputs, libraries) */
+#define UCX_MERGE_FD_RESERVED       16
+
+/* Memory of an open rank file, per block value: decoded uint64 and its largest varint */
+#define UCX_MERGE_CURSOR_VALUE_BYTES (sizeof(uint64_t) + 10)
+
+/* Sidecar file cursor (one decoded block) */
+typedef struct rank_cursor {
+    FILE *file;
+    ucx_sidecar_header_t header;
+
+    /* File counter index -> job counter index */
+    std::vector<uint32_t> mapping;
+
+    std::vector<uint8_t> payload;
+    std::vector<uint64_t> samples;
+    uint32_t num_samples;
+    uint32_t pos;
+
+    /* Previous sample values (increments are relative to it) */
+    std::vector<uint64_t> prev_values;
+    int has_prev;
+} rank_cursor_t;
+
+typedef struct node_group {
+    std::string hostname;
+    std::vector<std::string> files;
+    std::string output;
+    uint64_t num_buckets;
+    int status;
+} node_group_t;
+
+/* Job counter names (union of all the files) */
+static std::vector<std::string> job_names;
+static std::map<std::string, uint32_t> job_name_index;
+
+static uint64_t bucket_nsec = 1000000;
+static uint32_t fan_in = UCX_MERGE_FAN_IN_MAX;
+static uint64_t memory_limit = 0;
+
+static int
+cursor_open(rank_cursor_t *cursor, const std::string& filename)
+{
+    cursor->file = fopen(filename.c_str(), "rb");
+    if (cursor->file == NULL) {
+        fprintf(stderr, "Could not open %s\n", filename.c_str());
+        return -1;
+    }
+
+    if (ucx_sidecar_header_read(cursor->file, &cursor->header) != 0) {
+        fprintf(stderr, "Invalid sidecar file %s\n", filename.c_str());
+        fclose(cursor->file);
+        cursor->file = NULL;
+        return -1;
+    }
+
+    cursor->num_samples = 0;
+    cursor->pos = 0;
+    cursor->has_prev = 0;
+    cursor->prev_values.assign(cursor->header.names.size(), 0);
+
+    return 0;
+}
+
+static void
+cursor_close(rank_cursor_t *cursor)
+{
+    if (cursor->file != NULL) {
+        fclose(cursor->file);
+        cursor->file = NULL;
+    }
+
+    /* Release the block buffers */
+    std::vector<uint8_t>().swap(cursor->payload);
+    std::vector<uint64_t>().swap(cursor->samples);
+}
+
+/* Move to the next sample, returns 0 at the end of the file */
+static int
+cursor_next(rank_cursor_t *cursor)
+{
+    if (++cursor->pos < cursor->num_samples) {
+        return 1;
+    }
+
+    cursor->pos = 0;
+    cursor->num_samples = ucx_sidecar_block_read(cursor->file, cursor->header.names.size(),
+                              &cursor->payload, &cursor->samples);
+
+    return (cursor->num_samples > 0);
+}
+
+static inline const uint64_t *
+cursor_sample(const rank_cursor_t *cursor)
+{
+    return &cursor->samples[(size_t)cursor->pos * (cursor->header.names.size() + 1)];
+}
+
+static void
+csv_header_write(FILE *file)
+{
+    fprintf(file, "timestamp_nsec");
+    for (auto& name : job_names) {
+        fprintf(file, ",%s", name.c_str());
+    }
+    fprintf(file, "\n");
+}
+
+static void
+csv_bucket_write(FILE *file, uint64_t bucket, const std::vector<int64_t>& increments)
+{
+    fprintf(file, "%lu", (unsigned long)(bucket * bucket_nsec));
+    for (auto increment : increments) {
+        fprintf(file, ",%ld", (long)increment);
+    }
+    fprintf(file, "\n");
+}
+
+/* k-way merge of rank files into a rollup, returns the number of buckets or -1 */
+static int64_t
+ranks_merge(const std::vector<std::string>& files, const std::string& filename)
+{
+    typedef std::pair<uint64_t, uint32_t> heap_entry_t;
+    std::priority_queue<heap_entry_t, std::vector<heap_entry_t>, std::greater<heap_entry_t> > heap;
+    std::vector<rank_cursor_t> cursors(files.size());
+    std::vector<int64_t> increments(job_names.size(), 0);
+    int64_t num_buckets = 0;
+    uint64_t bucket = 0;
+    int bucket_valid = 0;
+    FILE *output;
+    uint32_t i;
+    uint32_t j;
+
+    output = fopen(filename.c_str(), "w");
+    if (output == NULL) {
+        fprintf(stderr, "Could not open %s\n", filename.c_str());
+        return -1;
+    }
+    csv_header_write(output);
+
+    for (i = 0; i < cursors.size(); i++) {
+        if (cursor_open(&cursors[i], files[i]) != 0) {
+            continue;
+        }
+
+        for (auto& name : cursors[i].header.names) {
+            cursors[i].mapping.push_back(job_name_index.at(name));
+        }
+
+        if (cursor_next(&cursors[i])) {
+            heap.push(std::make_pair(cursor_sample(&cursors[i])[0], i));
+        }
+    }
+
+    while (!heap.empty()) {
+        rank_cursor_t *cursor = &cursors[heap.top().second];
+        uint64_t timestamp = heap.top().first;
+        const uint64_t *sample;
+
+        i = heap.top().second;
+        heap.pop();
+
+        if (!bucket_valid || ((timestamp / bucket_nsec) != bucket)) {
+            if (bucket_valid) {
+                csv_bucket_write(output, bucket, increments);
+                num_buckets++;
+            }
+            bucket = timestamp / bucket_nsec;
+            bucket_valid = 1;
+            std::fill(increments.begin(), increments.end(), 0);
+        }
+
+        /* The first sample of a rank is the baseline */
+        sample = cursor_sample(cursor);
+        for (j = 0; j < cursor->mapping.size(); j++) {
+            if (cursor->has_prev) {
+                increments[cursor->mapping[j]] += (int64_t)(sample[j + 1] - cursor->prev_values[j]);
+            }
+            cursor->prev_values[j] = sample[j + 1];
+        }
+        cursor->has_prev = 1;
+
+        if (cursor_next(cursor)) {
+            heap.push(std::make_pair(cursor_sample(cursor)[0], i));
+        }
+        else {
+            cursor_close(cursor);
+        }
+    }
+
+    if (bucket_valid) {
+        csv_bucket_write(output, bucket, increments);
+        num_buckets++;
+    }
+
+    for (auto& cursor : cursors) {
+        cursor_close(&cursor);
+    }
+
+    fclose(output);
+    return num_buckets;
+}
+
+/* Node rollup reader (one line) */
+typedef struct rollup_cursor {
+    FILE *file;
+    uint64_t timestamp;
+    std::vector<int64_t> increments;
+} rollup_cursor_t;
+
+static int
+rollup_next(rollup_cursor_t *cursor)
+{
+    unsigned long timestamp;
+    long increment;
+    size_t j;
+
+    if (fscanf(cursor->file, "%lu", &timestamp) != 1) {
+        return 0;
+    }
+
+    cursor->timestamp = timestamp;
+    for (j = 0; j < cursor->increments.size(); j++) {
+        if (fscanf(cursor->file, ",%ld", &increment) != 1) {
+            return 0;
+        }
+        cursor->increments[j] = increment;
+    }
+
+    return 1;
+}
+
+/* k-way merge of rollups into a rollup, returns the number of buckets or -1 */
+static int64_t
+rollup_merge(const std::vector<std::string>& files, const std::string& filename)
+{
+    typedef std::pair<uint64_t, uint32_t> heap_entry_t;
+    std::priority_queue<heap_entry_t, std::vector<heap_entry_t>, std::greater<heap_entry_t> > heap;
+    std::vector<rollup_cursor_t> cursors(files.size());
+    std::vector<int64_t> increments(job_names.size(), 0);
+    int64_t num_buckets = 0;
+    uint64_t timestamp = 0;
+    int timestamp_valid = 0;
+    char line[64 * 1024];
+    FILE *output;
+    uint32_t i;
+    size_t j;
+
+    output = fopen(filename.c_str(), "w");
+    if (output == NULL) {
+        fprintf(stderr, "Could not open %s\n", filename.c_str());
+        return -1;
+    }
+    csv_header_write(output);
+
+    for (i = 0; i < files.size(); i++) {
+        cursors[i].file = fopen(files[i].c_str(), "r");
+        cursors[i].increments.resize(job_names.size());
+        if (cursors[i].file == NULL) {
+            fprintf(stderr, "Could not open %s\n", files[i].c_str());
+            continue;
+        }
+
+        /* Skip the CSV header (names may be long: read up to the new line) */
+        while ((fgets(line, sizeof(line), cursors[i].file) != NULL) &&
+               (strchr(line, '\n') == NULL));
+
+        if (rollup_next(&cursors[i])) {
+            heap.push(std::make_pair(cursors[i].timestamp, i));
+        }
+    }
+
+    while (!heap.empty()) {
+        i = heap.top().second;
+        heap.pop();
+
+        if (!timestamp_valid || (cursors[i].timestamp != timestamp)) {
+            if (timestamp_valid) {
+                csv_bucket_write(output, timestamp / bucket_nsec, increments);
+                num_buckets++;
+            }
+            timestamp = cursors[i].timestamp;
+            timestamp_valid = 1;
+            std::fill(increments.begin(), increments.end(), 0);
+        }
+
+        for (j = 0; j < increments.size(); j++) {
+            increments[j] += cursors[i].increments[j];
+        }
+
+        if (rollup_next(&cursors[i])) {
+            heap.push(std::make_pair(cursors[i].timestamp, i));
+        }
+    }
+
+    if (timestamp_valid) {
+        csv_bucket_write(output, timestamp / bucket_nsec, increments);
+        num_buckets++;
+    }
+
+    for (auto& cursor : cursors) {
+        if (cursor.file != NULL) {
+            fclose(cursor.file);
+        }
+    }
+
+    fclose(output);
+    return num_buckets;
+}
+
+/*
+   Hierarchical merge of files into a rollup, at most fan_in open inputs per
+   k-way merge: groups of fan_in files are merged into temporary rollups,
+   until fan_in files are left. files_merge: ranks_merge or rollup_merge.
+*/
+static int64_t
+tree_merge(std::vector<std::string> files, const std::string& filename,
+           int64_t (*files_merge)(const std::vector<std::string>&, const std::string&))
+{
+    std::vector<std::string> parts;
+    std::vector<std::string> group;
+    int64_t num_buckets;
+    uint32_t level = 0;
+    size_t i;
+
+    while (files.size() > fan_in) {
+        parts.clear();
+        for (i = 0; i < files.size(); i += fan_in) {
+            group.assign(files.begin() + i, files.begin() + std::min(i + fan_in, files.size()));
+            parts.push_back(filename + ".part" + std::to_string(level) + "." +
+                            std::to_string(parts.size()));
+            num_buckets = files_merge(group, parts.back());
+
+            /* The inputs of the upper levels are temporary rollups */
+            if (level > 0) {
+                for (auto& part : group) {
+                    unlink(part.c_str());
+                }
+            }
+
+            if (num_buckets < 0) {
+                for (auto& part : parts) {
+                    unlink(part.c_str());
+                }
+                for (i += fan_in; (level > 0) && (i < files.size()); i++) {
+                    unlink(files[i].c_str());
+                }
+                return -1;
+            }
+        }
+
+        files.swap(parts);
+        files_merge = rollup_merge;
+        level++;
+    }
+
+    num_buckets = files_merge(files, filename);
+    if (level > 0) {
+        for (auto& part : files) {
+            unlink(part.c_str());
+        }
+    }
+
+    return num_buckets;
+}
+
+/* Node rollup of the node rank files */
+static void
+node_merge(node_group_t *node)
+{
+    int64_t num_buckets = tree_merge(node->files, node->output, ranks_merge);
+
+    node->num_buckets = std::max(num_buckets, (int64_t)0);
+    node->status = (num_buckets < 0) ? -1 : 0;
+}
+
+/* Job rollup of the node rollups */
+static int
+job_merge(std::vector<node_group_t>& nodes, const std::string& filename)
+{
+    std::vector<std::string> files;
+
+    for (auto& node : nodes) {
+        if (node.status == 0) {
+            files.push_back(node.output);
+        }
+    }
+
+    return (tree_merge(files, filename, rollup_merge) < 0) ? -1 : 0;
+}
+
+/*
+   Fit the fan-in of the concurrent merges into RLIMIT_NOFILE: raise the soft
+   limit up to the hard one if needed, then lower the fan-in (and the number
+   of worker threads) to what is left.
+*/
+static void
+fan_in_limit(uint32_t *num_threads)
+{
+    struct rlimit rlim;
+    uint64_t needed = (uint64_t)*num_threads * (fan_in + 1) + UCX_MERGE_FD_RESERVED;
+    uint64_t limit;
+
+    if (getrlimit(RLIMIT_NOFILE, &rlim) != 0) {
+        fprintf(stderr, "Warning: getrlimit(RLIMIT_NOFILE) failed, fan-in %u\n", fan_in);
+        return;
+    }
+
+    if ((rlim.rlim_cur != RLIM_INFINITY) && (rlim.rlim_cur < needed)) {
+        rlim.rlim_cur = ((rlim.rlim_max == RLIM_INFINITY) || (rlim.rlim_max > needed)) ?
+                        needed : rlim.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &rlim) != 0) {
+            getrlimit(RLIMIT_NOFILE, &rlim);
+        }
+    }
+
+    if ((rlim.rlim_cur == RLIM_INFINITY) || (rlim.rlim_cur >= needed)) {
+        return;
+    }
+
+    /* A merge needs 2 inputs and its output */
+    limit = (rlim.rlim_cur > UCX_MERGE_FD_RESERVED + 3) ?
+            rlim.rlim_cur - UCX_MERGE_FD_RESERVED : 3;
+    *num_threads = std::max(std::min(*num_threads, (uint32_t)(limit / 3)), 1U);
+    fan_in = std::max(std::min(fan_in, (uint32_t)(limit / *num_threads - 1)), 2U);
+
+    fprintf(stderr, "Warning: RLIMIT_NOFILE=%lu, fan-in lowered to %u, %u threads\n",
+        (unsigned long)rlim.rlim_cur, fan_in, *num_threads);
+}
+
+/*
+   Fit the open rank files of the concurrent merges into the memory limit:
+   each one holds a decoded block (and its payload) of num_counters counters.
+   Lowers the worker threads (to 2 open rank files each at least), then the fan-in.
+*/
+static void
+fan_in_memory_limit(uint32_t *num_threads, size_t num_counters)
+{
+    uint64_t cursor_bytes = (uint64_t)UCX_SIDECAR_BLOCK_SAMPLES * (num_counters + 1) *
+                            UCX_MERGE_CURSOR_VALUE_BYTES;
+    uint64_t max_cursors;
+
+    if (memory_limit == 0) {
+        /* Half of the physical memory */
+        memory_limit = (uint64_t)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE) / 2;
+    }
+
+    max_cursors = memory_limit / cursor_bytes;
+    if ((uint64_t)*num_threads * fan_in <= max_cursors) {
+        return;
+    }
+
+    /* A merge needs 2 inputs */
+    *num_threads = std::max(std::min(*num_threads, (uint32_t)(max_cursors / 2)), 1U);
+    fan_in = std::max(std::min(fan_in, (uint32_t)(max_cursors / *num_threads)), 2U);
+
+    fprintf(stderr, "Warning: memory limit %lu MB (%lu KB per rank file), fan-in lowered to %u,"
+        " %u threads\n", (unsigned long)(memory_limit >> 20), (unsigned long)(cursor_bytes >> 10),
+        fan_in, *num_threads);
+}
+
+static void
+usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [-b bucket_usec] [-t num_threads] [-f fan_in] [-m memory_mb]"
+        " [-o output_dir] files...\n", argv0);
+}
+
+int
+main(int argc, char **argv)
+{
+    std::map<std::string, node_group_t> node_groups;
+    std::vector<node_group_t> nodes;
+    std::vector<std::thread> workers;
+    std::atomic<uint32_t> next_node(0);
+    std::string output_dir = ".";
+    size_t max_file_counters = 0;
+    uint32_t num_threads = std::thread::hardware_concurrency();
+    int opt;
+    int i;
+
+    while ((opt = getopt(argc, argv, "b:t:f:m:o:h")) != -1) {
+        switch (opt) {
+        case 'b':
+            bucket_nsec = std::max(strtoull(optarg, NULL, 0), 1ULL) * 1000;
+            break;
+        case 't':
+            num_threads = atoi(optarg);
+            break;
+        case 'f':
+            fan_in = std::max(atoi(optarg), 2);
+            break;
+        case 'm':
+            memory_limit = strtoull(optarg, NULL, 0) << 20;
+            break;
+        case 'o':
+            output_dir = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    /* Group the rank files by node, collect the counter names (headers only) */
+    for (i = optind; i < argc; i++) {
+        rank_cursor_t cursor;
+
+        if (cursor_open(&cursor, argv[i]) != 0) {
+            continue;
+        }
+
+        for (auto& name : cursor.header.names) {
+            if (job_name_index.find(name) == job_name_index.end()) {
+                job_name_index[name] = (uint32_t)job_names.size();
+                job_names.push_back(name);
+            }
+        }
+
+        max_file_counters = std::max(max_file_counters, cursor.header.names.size());
+        node_groups[cursor.header.hostname].hostname = cursor.header.hostname;
+        node_groups[cursor.header.hostname].files.push_back(argv[i]);
+        cursor_close(&cursor);
+    }
+
+    for (auto& node_group : node_groups) {
+        node_group.second.output = output_dir + "/node." + node_group.first + ".csv";
+        nodes.push_back(node_group.second);
+    }
+
+    if (nodes.empty()) {
+        fprintf(stderr, "No valid sidecar files\n");
+        return 1;
+    }
+
+    /* Node rollups: one node group per worker at a time */
+    num_threads = std::max(std::min(num_threads, (uint32_t)nodes.size()), 1U);
+    fan_in_limit(&num_threads);
+    fan_in_memory_limit(&num_threads, max_file_counters);
+    for (uint32_t t = 0; t < num_threads; t++) {
+        workers.emplace_back([&nodes, &next_node] {
+            uint32_t node;
+
+            while ((node = next_node.fetch_add(1)) < nodes.size()) {
+                node_merge(&nodes[node]);
+            }
+        });
+    }
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    for (auto& node : nodes) {
+        printf("%s: %zu ranks, %lu buckets%s\n", node.hostname.c_str(), node.files.size(),
+            (unsigned long)node.num_buckets, (node.status == 0) ? "" : " (failed)");
+    }
+
+    if (job_merge(nodes, output_dir + "/job.csv") != 0) {
+        return 1;
+    }
+
+    printf("job: %zu nodes, %zu counters, bucket=%lu usec\n", nodes.size(), job_names.size(),
+        (unsigned long)(bucket_nsec / 1000));
+
+    return 0;
+}
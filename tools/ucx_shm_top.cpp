@@ -0,0 +1,180 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+/*
+   Live on-node viewer of the UCX counters shared-memory export
+   (SCOREP_UCX_PLUGIN_SHM_EXPORT_ENABLE=1).
+
+   Maps the job segment read-only and shows the per-rank and per-node rates
+   of the counters matching a name pattern. The reader never writes to the
+   segment: the writers are never perturbed.
+
+   usage: ucx_shm_top <job_id> [interval_sec] [counter_pattern] [num_iterations]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <vector>
+#include <algorithm>
+
+#include <ucx_shm_layout.h>
+
+/* Maximum number of displayed counters (columns) */
+#define UCX_SHM_TOP_COLUMNS_MAX     6
+
+/* Seqlock read retries of a slot being written */
+#define UCX_SHM_TOP_READ_RETRIES    100
+
+typedef struct rank_snapshot {
+    int32_t pid;
+    int32_t rank;
+    uint64_t timestamp_nsec;
+    uint64_t values[UCX_SHM_EXPORT_COUNTERS_MAX];
+} rank_snapshot_t;
+
+/* Seqlock read of a slot, returns 1 on a consistent snapshot */
+static int
+slot_read(const ucx_shm_export_slot_t *slot, uint32_t num_counters, rank_snapshot_t *snapshot)
+{
+    uint64_t seq;
+    int retry;
+
+    for (retry = 0; retry < UCX_SHM_TOP_READ_RETRIES; retry++) {
+        seq = slot->seq.load(std::memory_order_acquire);
+        if (seq & 1) {
+            continue;
+        }
+
+        snapshot->pid = slot->pid.load(std::memory_order_relaxed);
+        snapshot->rank = slot->rank;
+        snapshot->timestamp_nsec = slot->timestamp_nsec;
+        memcpy(snapshot->values, slot->values, num_counters * sizeof(uint64_t));
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot->seq.load(std::memory_order_relaxed) == seq) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static double
+rate_get(const rank_snapshot_t *prev, const rank_snapshot_t *cur, uint32_t index)
+{
+    double dt;
+
+    if ((prev->pid != cur->pid) || (cur->timestamp_nsec <= prev->timestamp_nsec) ||
+        (cur->values[index] < prev->values[index])) {
+        return 0;
+    }
+
+    dt = (double)(cur->timestamp_nsec - prev->timestamp_nsec) / 1e9;
+    return (double)(cur->values[index] - prev->values[index]) / dt;
+}
+
+int
+main(int argc, char **argv)
+{
+    const char *job_id = (argc > 1) ? argv[1] : "0";
+    double interval_sec = (argc > 2) ? atof(argv[2]) : 1.0;
+    const char *pattern = (argc > 3) ? argv[3] : "*bytes*";
+    long num_iterations = (argc > 4) ? atol(argv[4]) : -1;
+    const ucx_shm_export_segment_t *segment;
+    std::vector<rank_snapshot_t> prev(UCX_SHM_EXPORT_RANKS_MAX);
+    std::vector<rank_snapshot_t> cur(UCX_SHM_EXPORT_RANKS_MAX);
+    std::vector<uint32_t> columns;
+    char shm_name[256];
+    uint32_t num_counters;
+    uint32_t i;
+    uint32_t j;
+    long iteration;
+    void *addr;
+    int fd;
+
+    snprintf(shm_name, sizeof(shm_name), UCX_SHM_EXPORT_NAME_FORMAT, job_id);
+
+    fd = shm_open(shm_name, O_RDONLY, 0);
+    if (fd < 0) {
+        fprintf(stderr, "Could not open %s (SCOREP_UCX_PLUGIN_SHM_EXPORT_ENABLE=1?)\n", shm_name);
+        return 1;
+    }
+
+    addr = mmap(NULL, sizeof(ucx_shm_export_segment_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        fprintf(stderr, "Could not map %s\n", shm_name);
+        return 1;
+    }
+    segment = (const ucx_shm_export_segment_t *)addr;
+
+    while (segment->header.magic.load(std::memory_order_acquire) != UCX_SHM_EXPORT_MAGIC) {
+        usleep(100000);
+    }
+
+    num_counters = std::min(segment->header.num_counters, (uint32_t)UCX_SHM_EXPORT_COUNTERS_MAX);
+    for (j = 0; (j < num_counters) && (columns.size() < UCX_SHM_TOP_COLUMNS_MAX); j++) {
+        if (fnmatch(pattern, segment->header.names[j], 0) == 0) {
+            columns.push_back(j);
+        }
+    }
+
+    for (iteration = 0; (num_iterations < 0) || (iteration <= num_iterations); iteration++) {
+        std::vector<double> node_rates(columns.size(), 0);
+        uint32_t num_ranks = 0;
+
+        for (i = 0; i < UCX_SHM_EXPORT_RANKS_MAX; i++) {
+            if ((segment->slots[i].pid.load(std::memory_order_relaxed) == 0) ||
+                !slot_read(&segment->slots[i], num_counters, &cur[i])) {
+                cur[i].pid = 0;
+            }
+        }
+
+        if (iteration > 0) {
+            printf("\033[H\033[J%s: counter rates (per second)\n\n%8s", shm_name, "rank");
+            for (j = 0; j < columns.size(); j++) {
+                printf(" %24.24s", segment->header.names[columns[j]]);
+            }
+            printf("\n");
+
+            for (i = 0; i < UCX_SHM_EXPORT_RANKS_MAX; i++) {
+                if (cur[i].pid == 0) {
+                    continue;
+                }
+
+                num_ranks++;
+                printf("%8d", cur[i].rank);
+                for (j = 0; j < columns.size(); j++) {
+                    double rate = rate_get(&prev[i], &cur[i], columns[j]);
+
+                    node_rates[j] += rate;
+                    printf(" %24.1f", rate);
+                }
+                printf("\n");
+            }
+
+            printf("%8s", "node");
+            for (j = 0; j < columns.size(); j++) {
+                printf(" %24.1f", node_rates[j]);
+            }
+            printf("\n\n%u ranks\n", num_ranks);
+            fflush(stdout);
+        }
+
+        prev.swap(cur);
+        usleep((useconds_t)(interval_sec * 1e6));
+    }
+
+    munmap(addr, sizeof(ucx_shm_export_segment_t));
+
+    return 0;
+}
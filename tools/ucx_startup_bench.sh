@@ -0,0 +1,71 @@
+#!/bin/bash
+#
+# Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+#
+# See file LICENSE for terms.
+#
+# Plugin startup scalability benchmark: runs the startup benchmark application
+# with 1..N local ranks (shm transport) and reports, per rank count, the time
+# from the process start to the first sample and the time of each startup phase
+# (max / mean over the ranks, micro seconds).
+#
+# usage: ucx_startup_bench.sh <plugin build dir> [max ranks (256)] [stats: ucx|none]
+#
+#   stats=ucx:  UCX statistics enabled (the real aggregate-sum names / values)
+#   stats=none: UCX statistics disabled (no UCX counter names, temporary metrics)
+#
+# Requires mpirun, mpicc and the Score-P instrumenter (scorep) in PATH.
+
+set -e
+
+PLUGIN_DIR=$(readlink -f "${1:?usage: $0 <plugin build dir> [max ranks] [ucx|none]}")
+MAX_RANKS=${2:-256}
+STATS=${3:-ucx}
+SRC_DIR=$(dirname "$(readlink -f "$0")")
+WORK_DIR=$(mktemp -d "${TMPDIR:-/tmp}/ucx_startup_bench.XXXXXX")
+
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+scorep --mpp=mpi mpicc -O2 "$SRC_DIR/ucx_startup_bench_app.c" -o "$WORK_DIR/app"
+
+export LD_LIBRARY_PATH=$PLUGIN_DIR:$LD_LIBRARY_PATH
+export SCOREP_METRIC_PLUGINS=scorep_plugin_ucx
+export SCOREP_METRIC_SCOREP_PLUGIN_UCX=${SCOREP_METRIC_SCOREP_PLUGIN_UCX:-UCX@1}
+export SCOREP_ENABLE_PROFILING=${SCOREP_ENABLE_PROFILING:-false}
+export SCOREP_ENABLE_TRACING=${SCOREP_ENABLE_TRACING:-true}
+export SCOREP_UCX_PLUGIN_STARTUP_TIMING_ENABLE=1
+export UCX_TLS=shm,self
+
+if [ "$STATS" = "ucx" ]; then
+    export UCX_STATS_DEST=file:/dev/null
+    export UCX_STATS_TRIGGER=exit
+else
+    unset UCX_STATS_DEST UCX_STATS_TRIGGER
+fi
+
+PHASES="plugin_load names_discovery backends_init metric_properties mpi_init_wait mpi_init_update first_sample"
+
+printf "%6s" "ranks"
+for phase in $PHASES; do
+    printf " %22s" "$phase(max/mean)"
+done
+printf "\n"
+
+ranks=1
+while [ "$ranks" -le "$MAX_RANKS" ]; do
+    # Every run starts without the names file of a previous run
+    (cd "$WORK_DIR" && rm -rf ucx_plugin_metric_names.txt scorep-* &&
+     mpirun -np "$ranks" --oversubscribe --mca pml ucx -x UCX_TLS -x LD_LIBRARY_PATH \
+         ./app > "run.$ranks.log" 2>&1) || echo "Warning: run with $ranks ranks failed ($WORK_DIR/run.$ranks.log)"
+
+    printf "%6d" "$ranks"
+    for phase in $PHASES; do
+        grep "^UCX plugin startup:" "$WORK_DIR/run.$ranks.log" |
+            sed -n "s/.* ${phase}_usec=\([0-9]*\).*/\1/p" |
+            awk '{ if ($1 > max) max = $1; sum += $1; n++ }
+                 END { if (n) printf " %22s", max "/" int(sum / n); else printf " %22s", "-" }'
+    done
+    printf "\n"
+
+    ranks=$((ranks * 2))
+done
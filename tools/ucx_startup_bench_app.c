@@ -0,0 +1,34 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+/*
+   Startup benchmark application (see ucx_startup_bench.sh): MPI_Init and a few
+   collectives, so that every rank takes its first plugin sample.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <mpi.h>
+
+int
+main(int argc, char **argv)
+{
+    int iterations = (argc > 1) ? atoi(argv[1]) : 10;
+    int value = 1;
+    int sum;
+    int i;
+
+    MPI_Init(&argc, &argv);
+
+    for (i = 0; i < iterations; i++) {
+        MPI_Allreduce(&value, &sum, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+
+    MPI_Finalize();
+
+    return 0;
+}
@@ -0,0 +1,22 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+/*
+   Print the UCX statistics receiver port of the job (udp backend), e.g.:
+   export UCX_STATS_DEST=udp:localhost:$(ucx_stats_port)
+*/
+
+#include <stdio.h>
+
+#include <utils.h>
+
+int
+main()
+{
+    printf("%d\n", stats_udp_port_get());
+
+    return 0;
+}
@@ -0,0 +1,93 @@
+/**
+* Copyright (C) Huawei Technologies Co., Ltd. 2020.  ALL RIGHTS RESERVED.
+*
+* See file LICENSE for terms.
+*/
+
+/*
+   Trace size comparison: absolute vs. delta encoded UCX metrics.
+
+   Generates a synthetic UCX aggregate-sum counters workload (compute phases
+   without traffic, communication bursts of varying message sizes) and
+   estimates the size of the OTF2 metric values written for each mode.
+   OTF2 stores 64-bit integers compressed: one length byte followed by the
+   significant bytes of the value.
+
+   usage: ucx_trace_size_compare [num_counters] [num_samples] [seed]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <vector>
+#include <random>
+
+/* Size of an OTF2 compressed uint64 */
+static size_t
+otf2_compressed_size(uint64_t value)
+{
+    size_t size = 1;
+
+    while (value != 0) {
+        size++;
+        value >>= 8;
+    }
+
+    return size;
+}
+
+int
+main(int argc, char **argv)
+{
+    uint32_t num_counters = (argc > 1) ? atoi(argv[1]) : 32;
+    uint64_t num_samples = (argc > 2) ? strtoull(argv[2], NULL, 10) : 1000000;
+    uint32_t seed = (argc > 3) ? atoi(argv[3]) : 1;
+    std::vector<uint64_t> values(num_counters, 0);
+    std::vector<uint64_t> increments(num_counters, 0);
+    std::mt19937_64 rng(seed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    size_t absolute_size = 0;
+    size_t delta_size = 0;
+    uint64_t sample;
+    uint32_t i;
+    int in_burst = 0;
+
+    for (sample = 0; sample < num_samples; sample++) {
+        /* Alternate compute phases and communication bursts */
+        if (uniform(rng) < (in_burst ? 0.01 : 0.002)) {
+            in_burst = !in_burst;
+        }
+
+        for (i = 0; i < num_counters; i++) {
+            uint64_t increment = 0;
+
+            /* A quarter of the counters never change (e.g. unused protocols) */
+            if ((i % 4) != 3) {
+                if (in_burst) {
+                    /* bytes counters (even) vs. message/packet counters (odd) */
+                    increment = (i % 2) ? (1 + (rng() % 16)) :
+                                    ((uint64_t)1 << (6 + (rng() % 14)));
+                }
+                else if (uniform(rng) < 0.01) {
+                    /* Background traffic (keepalive, progress) */
+                    increment = 1 + (rng() % 64);
+                }
+            }
+
+            values[i] += increment;
+            increments[i] = increment;
+
+            absolute_size += otf2_compressed_size(values[i]);
+            delta_size += otf2_compressed_size(increments[i]);
+        }
+    }
+
+    printf("counters=%u samples=%lu\n", num_counters, (unsigned long)num_samples);
+    printf("absolute: %zu bytes (%.2f bytes/value)\n", absolute_size,
+        (double)absolute_size / (double)(num_samples * num_counters));
+    printf("delta:    %zu bytes (%.2f bytes/value)\n", delta_size,
+        (double)delta_size / (double)(num_samples * num_counters));
+    printf("ratio:    %.2fx\n", (double)absolute_size / (double)delta_size);
+
+    return 0;
+}